@@ -1,18 +1,33 @@
 #ifndef BRICLI_CONFIG_H
 #define BRICLI_CONFIG_H
 
-// The length of the internal arguments buffer, default 70
-#define BRICLI_ARGUMENT_BUFFER_LEN 70
-
 // The maximum number of arguments BriCLI can parse, default 3
 #define BRICLI_MAX_ARGUMENTS 3
 
 // The maximum length any user command can be, default 10
 #define BRICLI_MAX_COMMAND_LEN 10
 
-// The maximum length a PrintF message can be, default 80
+// The character that splits a command name into a subtree for "help <name>", default '_'
+#define BRICLI_SUBTREE_SEPARATOR '_'
+
+// The size of the chunk PrintF formats into, longer messages are sent in pieces, default 80
 #define BRICLI_PRINT_MESSAGE_SIZE 80
 
+// The size of the scratch a single conversion too long for the PrintF chunk is formatted into, default 320
+#define BRICLI_PRINT_LONG_SIZE 320
+
+// The width keys are padded to when emitted records are rendered as text, default 16
+#define BRICLI_EMIT_KEY_WIDTH 16
+
+// The longest command line that can be handed to a worker job, default 80
+#define BRICLI_JOB_LINE_SIZE 80
+
+// The size of the buffer a worker job's output is held in until it is released, default 256
+#define BRICLI_JOB_OUTPUT_SIZE 256
+
+// The longest message other threads can post with Bricli_PostWrite, default 80
+#define BRICLI_POST_SIZE 80
+
 // When on, BriCLI will automatically report command handler errors to the user, default on
 #define BRICLI_SHOW_COMMAND_ERRORS 1
 
@@ -28,8 +43,14 @@
 // When on, enables the use of VT100 colour commands, default on
 #define BRICLI_USE_COLOUR 1
 
-// When on, BriCLI will use the thread safe strtok_r in place of strtok, default off
-#define BRICLI_USE_REENTRANT 0
+// When on, PrintF formats %d, %i, %u, %x and %X itself instead of using snprintf, default on
+#define BRICLI_USE_FAST_FORMAT 1
+
+// When on, BriCLI will use vectorised blob decoding where the host supports it, default on
+#define BRICLI_USE_SIMD 1
+
+// When on, state shared with workers and posting threads is accessed atomically, turn off for single threaded builds, default on
+#define BRICLI_USE_THREADS 1
 
 // Enables the use of VT100 text colours, default on
 #define BRICLI_USE_TEXT_COLOURS 1
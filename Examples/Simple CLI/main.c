@@ -23,6 +23,8 @@ static BricliCommand_t _commandList[] =
 
 };
 
+static const BricliConfig_t _config = { _commandList, BRICLI_STATIC_ARRAY_SIZE(_commandList), "\n", NULL, ">> " };
+
 static int CustomWrite(uint32_t length, const char* data)
 {
     return printf("%s", data);
@@ -31,13 +33,10 @@ static int CustomWrite(uint32_t length, const char* data)
 int main(int argc, char const *argv[])
 {
     // Setup the CLI
-    _cli.Eol = "\n";
+    _cli.Config = &_config;
     _cli.BspWrite = CustomWrite;
     _cli.RxBuffer = _rxBuffer;
     _cli.RxBufferSize = RX_BUFFER_SIZE;
-    _cli.CommandList = _commandList;
-    _cli.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(_commandList);
-    _cli.Prompt = ">> ";
 
     // Send the initial prompt.
     Bricli_SendPrompt(&_cli);
@@ -0,0 +1,238 @@
+/**
+ * @brief Interactive latency benchmark for the Socket Server example.
+ *
+ * Floods the server with pipelined bulk commands from several connections while a single
+ * interactive connection times "who" round trips, then prints the latency percentiles.
+ * Run the server first, then: SocketBench [socket path] [bulk clients] [--no-lanes]
+ * --no-lanes leaves the bulk clients in the interactive lane for comparison.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define DEFAULT_SOCKET_PATH "/tmp/bricli.sock"  // Socket used when no path is given.
+#define DEFAULT_BULK_CLIENTS 8                  // Bulk connections used when no count is given.
+#define PIPELINE_DEPTH      32                  // Commands each bulk client keeps in flight.
+#define SAMPLE_COUNT        2000                // Interactive round trips measured.
+#define PROMPT              ">> "               // The server's prompt, ends every reply.
+
+static const char *_path = DEFAULT_SOCKET_PATH;
+static bool _useLanes = true;
+static volatile bool _isRunning = true;
+static uint64_t _bulkCommands = 0;
+static pthread_mutex_t _bulkLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Gets a monotonic timestamp.
+ *
+ * @return The time in nanoseconds.
+ */
+static uint64_t Bench_Now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ull) + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * @brief Connects to the server.
+ *
+ * @return The connected socket, exits on failure.
+ */
+static int Bench_Connect(void)
+{
+    struct sockaddr_un address = { 0 };
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, _path, sizeof(address.sun_path) - 1);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        perror("Failed to connect");
+        exit(1);
+    }
+    return fd;
+}
+
+/**
+ * @brief Reads until the received data ends with the prompt.
+ *
+ * @param fd The connection to read.
+ * @return True once the prompt was seen, false if the connection closed.
+ */
+static bool Bench_ReadPrompt(int fd)
+{
+    char buffer[256];
+    size_t length = 0;
+
+    while (true)
+    {
+        ssize_t received = recv(fd, buffer + length, sizeof(buffer) - length, 0);
+
+        if (received <= 0)
+        {
+            return false;
+        }
+        length += (size_t)received;
+        if (length >= strlen(PROMPT) && memcmp(buffer + length - strlen(PROMPT), PROMPT, strlen(PROMPT)) == 0)
+        {
+            return true;
+        }
+
+        // Only the tail matters, keep it and drop the rest.
+        if (length == sizeof(buffer))
+        {
+            memmove(buffer, buffer + length - strlen(PROMPT), strlen(PROMPT));
+            length = strlen(PROMPT);
+        }
+    }
+}
+
+/**
+ * @brief Bulk client, keeps PIPELINE_DEPTH echo commands in flight until stopped.
+ *
+ * @param argument Unused.
+ * @return Always NULL.
+ */
+static void *Bench_Bulk(void *argument)
+{
+    char batch[PIPELINE_DEPTH * 16];
+    size_t batchLength = 0;
+    int fd = Bench_Connect();
+    uint64_t completed = 0;
+
+    (void)argument;
+    Bench_ReadPrompt(fd);
+    if (_useLanes)
+    {
+        send(fd, "priority bulk\n", 14, 0);
+        Bench_ReadPrompt(fd);
+    }
+
+    for (uint32_t i = 0; i < PIPELINE_DEPTH; i++)
+    {
+        batchLength += (size_t)sprintf(batch + batchLength, "echo bulk%02u\n", i);
+    }
+
+    while (_isRunning)
+    {
+        char buffer[1024];
+        uint32_t replies = 0;
+
+        send(fd, batch, batchLength, 0);
+
+        // Every reply ends in a newline followed by the prompt.
+        while (replies < PIPELINE_DEPTH)
+        {
+            ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+
+            if (received <= 0)
+            {
+                close(fd);
+                return NULL;
+            }
+            for (ssize_t j = 0; j < received; j++)
+            {
+                replies += (buffer[j] == '\n');
+            }
+        }
+        completed += PIPELINE_DEPTH;
+    }
+
+    pthread_mutex_lock(&_bulkLock);
+    _bulkCommands += completed;
+    pthread_mutex_unlock(&_bulkLock);
+    close(fd);
+    return NULL;
+}
+
+/**
+ * @brief Orders latency samples for qsort.
+ */
+static int Bench_Compare(const void *a, const void *b)
+{
+    uint64_t left = *(const uint64_t *)a;
+    uint64_t right = *(const uint64_t *)b;
+
+    return (left > right) - (left < right);
+}
+
+int main(int argc, char const *argv[])
+{
+    static uint64_t samples[SAMPLE_COUNT];
+    uint32_t bulkClients = DEFAULT_BULK_CLIENTS;
+    pthread_t threads[256];
+    uint64_t start;
+    double seconds;
+    int fd;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--no-lanes") == 0)
+        {
+            _useLanes = false;
+        }
+        else if (argv[i][0] >= '0' && argv[i][0] <= '9')
+        {
+            bulkClients = (uint32_t)atoi(argv[i]);
+        }
+        else
+        {
+            _path = argv[i];
+        }
+    }
+    if (bulkClients > 256)
+    {
+        bulkClients = 256;
+    }
+
+    fd = Bench_Connect();
+    Bench_ReadPrompt(fd);
+
+    for (uint32_t i = 0; i < bulkClients; i++)
+    {
+        pthread_create(&threads[i], NULL, Bench_Bulk, NULL);
+    }
+
+    // Give the bulk clients time to build up a backlog before measuring.
+    usleep(200000);
+
+    start = Bench_Now();
+    for (uint32_t i = 0; i < SAMPLE_COUNT; i++)
+    {
+        uint64_t sent = Bench_Now();
+
+        send(fd, "who\n", 4, 0);
+        if (!Bench_ReadPrompt(fd))
+        {
+            fprintf(stderr, "Connection closed\n");
+            return 1;
+        }
+        samples[i] = Bench_Now() - sent;
+        usleep(500);
+    }
+    seconds = (double)(Bench_Now() - start) / 1e9;
+
+    _isRunning = false;
+    for (uint32_t i = 0; i < bulkClients; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    close(fd);
+
+    qsort(samples, SAMPLE_COUNT, sizeof(samples[0]), Bench_Compare);
+    printf("%u bulk clients, lanes %s\n", bulkClients, _useLanes ? "on" : "off");
+    printf("interactive latency us: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+           samples[SAMPLE_COUNT / 2] / 1e3, samples[(SAMPLE_COUNT * 90) / 100] / 1e3,
+           samples[(SAMPLE_COUNT * 99) / 100] / 1e3, samples[SAMPLE_COUNT - 1] / 1e3);
+    printf("bulk throughput: %.0f commands/s\n", (double)_bulkCommands / seconds);
+    return 0;
+}
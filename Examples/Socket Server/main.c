@@ -0,0 +1,516 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "bricli.h"
+
+#define RX_BUFFER_SIZE      128                 // Size of each session's RX Buffer.
+#define TX_BUFFER_SIZE      256                 // Size of each session's TX Buffer.
+#define MAX_EVENTS          64                  // Number of epoll events handled per wait.
+#define BULK_QUANTUM        4                   // Commands the bulk lane may run per scheduling round.
+#define DEFAULT_SOCKET_PATH "/tmp/bricli.sock"  // Socket used when no path is given.
+
+/**
+ * @brief Priority classes, interactive sessions are always served before bulk ones.
+ */
+typedef enum _Lane_t
+{
+    LaneInteractive,
+    LaneBulk,
+    LaneCount
+} Lane_t;
+
+/**
+ * @brief Per connection state, everything else is shared between sessions.
+ */
+typedef struct _Session_t
+{
+    BricliHandle_t      Cli;
+    int                 Fd;
+    bool                IsClosing;
+    bool                IsWatchingOutput;
+    bool                IsQueued;
+    Lane_t              Lane;
+    struct _Session_t   *Next;
+    uint32_t            InputOffset;
+    uint32_t            InputLength;
+    char                Input[RX_BUFFER_SIZE];
+    char                RxBuffer[RX_BUFFER_SIZE];
+    char                TxBuffer[TX_BUFFER_SIZE];
+} Session_t;
+
+/**
+ * @brief Sessions with input waiting to be run, in the order they became ready.
+ */
+typedef struct _ReadyQueue_t
+{
+    Session_t   *Head;
+    Session_t   *Tail;
+    uint32_t    Count;
+} ReadyQueue_t;
+
+static int _epollFd = -1;
+static uint32_t _sessionCount = 0;
+static ReadyQueue_t _lanes[LaneCount];
+
+static int Who_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char *args[]);
+static int Echo_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char *args[]);
+static int Status_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char *args[]);
+static int Quit_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char *args[]);
+static int Priority_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char *args[]);
+
+// Handlers are given the session's handle, so they are shared by every session without globals.
+static BricliCommand_t _commandList[] =
+{
+    { "who",      NULL, "Shows this session's id and the number of sessions.", NULL, 0, NULL, Who_Handler,      &_sessionCount, 0 },
+    { "echo",     NULL, "Echoes what is sent",                                  NULL, 0, NULL, Echo_Handler,     NULL,           0 },
+    { "status",   NULL, "Prints the server status as a record.",                NULL, 0, NULL, Status_Handler,   &_sessionCount, 0 },
+    { "quit",     NULL, "Closes this session",                                  NULL, 0, NULL, Quit_Handler,     NULL,           0 },
+    { "priority", NULL, "Sets this session's lane, interactive or bulk.",       NULL, 0, NULL, Priority_Handler, NULL,           0 }
+};
+
+// Shared by every session, only the per-session buffers and state are allocated per connection.
+static const BricliConfig_t _config =
+{
+    _commandList,
+    BRICLI_STATIC_ARRAY_SIZE(_commandList),
+    "\n",
+    NULL,
+    ">> "
+};
+
+/**
+ * @brief Switches a session between waiting for input and waiting for its output to drain.
+ *
+ * A session whose output is backed up is not read, so a client that does not read its
+ * replies is slowed down rather than filling the server's memory.
+ *
+ * @param session The session to update.
+ * @param watch True to be told when the socket can take more output.
+ */
+static void Session_WatchOutput(Session_t *session, bool watch)
+{
+    struct epoll_event event = { 0 };
+
+    if (session->IsWatchingOutput == watch)
+    {
+        return;
+    }
+
+    event.events = watch ? EPOLLOUT : EPOLLIN;
+    event.data.ptr = session;
+    epoll_ctl(_epollFd, EPOLL_CTL_MOD, session->Fd, &event);
+    session->IsWatchingOutput = watch;
+}
+
+/**
+ * @brief Session aware, non-blocking BSP write shared by every session.
+ *
+ * @param cli The session's BriCLI instance.
+ * @param length The number of characters in data.
+ * @param data The data to send.
+ * @return The number of characters accepted, 0 if the socket is busy.
+ */
+static int Session_Write(BricliHandle_t *cli, uint32_t length, const char *data)
+{
+    Session_t *session = (Session_t *)cli->UserData;
+    ssize_t sent = send(session->Fd, data, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    if (sent < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            Session_WatchOutput(session, true);
+            return 0;
+        }
+        session->IsClosing = true;
+        return BricliBadFunction;
+    }
+
+    // Anything not accepted stays queued in the TX buffer until EPOLLOUT.
+    if ((uint32_t)sent < length)
+    {
+        Session_WatchOutput(session, true);
+    }
+    return (int)sent;
+}
+
+/**
+ * @brief Accepts a new connection and gives it its own BriCLI instance.
+ *
+ * @param listenFd The listening socket.
+ */
+static void Session_Open(int listenFd)
+{
+    struct epoll_event event = { 0 };
+    BricliHandle_t defaults = BRICLI_HANDLE_DEFAULT;
+    Session_t *session = NULL;
+    int fd = accept(listenFd, NULL, NULL);
+
+    if (fd < 0)
+    {
+        return;
+    }
+
+    session = calloc(1, sizeof(Session_t));
+    if (session == NULL)
+    {
+        close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    session->Fd = fd;
+    session->Cli = defaults;
+    session->Cli.Config = &_config;
+    session->Cli.SessionWrite = Session_Write;
+    session->Cli.UserData = session;
+    session->Cli.RxBuffer = session->RxBuffer;
+    session->Cli.RxBufferSize = RX_BUFFER_SIZE;
+    session->Cli.TxBuffer = session->TxBuffer;
+    session->Cli.TxBufferSize = TX_BUFFER_SIZE;
+    session->Cli.NonBlockingTx = true;
+
+    event.events = EPOLLIN;
+    event.data.ptr = session;
+    epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &event);
+    _sessionCount++;
+
+    Bricli_SendPrompt(&session->Cli);
+}
+
+/**
+ * @brief Adds a session to the back of its lane, if it is not already waiting.
+ *
+ * @param session The session with input waiting.
+ */
+static void Session_Enqueue(Session_t *session)
+{
+    ReadyQueue_t *lane = &_lanes[session->Lane];
+
+    if (session->IsQueued)
+    {
+        return;
+    }
+
+    session->Next = NULL;
+    if (lane->Tail == NULL)
+    {
+        lane->Head = session;
+    }
+    else
+    {
+        lane->Tail->Next = session;
+    }
+    lane->Tail = session;
+    lane->Count++;
+    session->IsQueued = true;
+}
+
+/**
+ * @brief Takes the session at the front of a lane.
+ *
+ * @param lane The lane to take from.
+ * @return The session, NULL if the lane is empty.
+ */
+static Session_t *Session_Dequeue(ReadyQueue_t *lane)
+{
+    Session_t *session = lane->Head;
+
+    if (session != NULL)
+    {
+        lane->Head = session->Next;
+        if (lane->Head == NULL)
+        {
+            lane->Tail = NULL;
+        }
+        lane->Count--;
+        session->IsQueued = false;
+    }
+    return session;
+}
+
+/**
+ * @brief Closes a session's connection and releases its memory.
+ *
+ * @param session The session to close.
+ */
+static void Session_Close(Session_t *session)
+{
+    ReadyQueue_t *lane = &_lanes[session->Lane];
+
+    // Closing sessions are rare, so a walk of the lane is fine.
+    if (session->IsQueued)
+    {
+        Session_t **link = &lane->Head;
+
+        while (*link != session)
+        {
+            link = &(*link)->Next;
+        }
+        *link = session->Next;
+        if (lane->Tail == session)
+        {
+            lane->Tail = NULL;
+            for (Session_t *last = lane->Head; last != NULL; last = last->Next)
+            {
+                lane->Tail = last;
+            }
+        }
+        lane->Count--;
+    }
+
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, session->Fd, NULL);
+    close(session->Fd);
+    free(session);
+    _sessionCount--;
+}
+
+/**
+ * @brief Feeds a session's input into its BriCLI instance until one command has run.
+ *
+ * @param session The session with data waiting.
+ * @return True if the session may have more input to run.
+ */
+static bool Session_Step(Session_t *session)
+{
+    if (session->InputOffset == session->InputLength)
+    {
+        ssize_t received = recv(session->Fd, session->Input, sizeof(session->Input), 0);
+
+        if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            session->IsClosing = true;
+            return false;
+        }
+        else if (received < 0)
+        {
+            // Drained, epoll queues the session again once more arrives.
+            return false;
+        }
+        session->InputOffset = 0;
+        session->InputLength = (uint32_t)received;
+    }
+
+    while (session->InputOffset < session->InputLength)
+    {
+        char rxChar = session->Input[session->InputOffset++];
+
+        Bricli_ReceiveCharacter(&session->Cli, rxChar);
+        if (rxChar == '\n' || session->Cli.State == BricliStatePaging)
+        {
+            Bricli_Parse(&session->Cli);
+            break;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Gives a session its turn, running at most one command.
+ *
+ * @param session The session taken from its lane.
+ */
+static void Session_Run(Session_t *session)
+{
+    // A session whose output is backed up waits for EPOLLOUT to queue it again.
+    if (!session->Cli.IsTxBusy && Session_Step(session) && !session->IsClosing)
+    {
+        Session_Enqueue(session);
+    }
+    else if (session->IsClosing && !session->Cli.IsTxBusy)
+    {
+        Session_Close(session);
+    }
+}
+
+/**
+ * @brief Runs one scheduling round.
+ *
+ * Every waiting interactive session runs one command, then the bulk lane runs up to BULK_QUANTUM
+ * commands round robin. New input is picked up between rounds, so an interactive command waits
+ * behind at most one quantum of bulk work while bulk sessions still always make progress.
+ */
+static void Server_Dispatch(void)
+{
+    for (uint32_t turns = _lanes[LaneInteractive].Count; turns > 0; turns--)
+    {
+        Session_Run(Session_Dequeue(&_lanes[LaneInteractive]));
+    }
+
+    for (uint32_t turns = BULK_QUANTUM; turns > 0 && _lanes[LaneBulk].Head != NULL; turns--)
+    {
+        Session_Run(Session_Dequeue(&_lanes[LaneBulk]));
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    const char *path = (argc > 1) ? argv[1] : DEFAULT_SOCKET_PATH;
+    struct sockaddr_un address = { 0 };
+    struct epoll_event events[MAX_EVENTS];
+    struct epoll_event event = { 0 };
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    // Setup the listening socket.
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    unlink(path);
+    if (listenFd < 0 || bind(listenFd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(listenFd, SOMAXCONN) < 0)
+    {
+        perror("Failed to listen");
+        return 1;
+    }
+
+    _epollFd = epoll_create1(0);
+    event.events = EPOLLIN;
+    event.data.ptr = NULL; // NULL marks the listening socket.
+    epoll_ctl(_epollFd, EPOLL_CTL_ADD, listenFd, &event);
+
+    printf("Listening on %s, %zu bytes per session\n", path, sizeof(Session_t));
+
+    // Every session is served from this one thread, polling for new input between rounds while busy.
+    while (true)
+    {
+        bool isBusy = (_lanes[LaneInteractive].Head != NULL || _lanes[LaneBulk].Head != NULL);
+        int count = epoll_wait(_epollFd, events, MAX_EVENTS, isBusy ? 0 : -1);
+
+        for (int i = 0; i < count; i++)
+        {
+            Session_t *session = (Session_t *)events[i].data.ptr;
+
+            if (session == NULL)
+            {
+                Session_Open(listenFd);
+                continue;
+            }
+
+            if (events[i].events & EPOLLOUT)
+            {
+                Session_WatchOutput(session, false);
+                Bricli_OnTxComplete(&session->Cli);
+            }
+
+            // Closing sessions are dropped once their output has been sent, the rest wait for their turn.
+            if (session->IsClosing && (!session->Cli.IsTxBusy || (events[i].events & (EPOLLHUP | EPOLLERR))))
+            {
+                Session_Close(session);
+            }
+            else if (!session->Cli.IsTxBusy)
+            {
+                Session_Enqueue(session);
+            }
+        }
+
+        Server_Dispatch();
+    }
+    return 0;
+}
+
+/**
+ * @brief Who command handler, identifies the calling session.
+ *
+ * @param cli The session's BriCLI instance.
+ * @param context The command's context pointer.
+ * @param numberOfArgs The number of arguments received
+ * @param args The string array of arguments.
+ * @return A BriCLI Error code, 0 for success.
+ */
+static int Who_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char *args[])
+{
+    Session_t *session = (Session_t *)cli->UserData;
+
+    (void)numberOfArgs;
+    (void)args;
+    return Bricli_PrintF(cli, "Session %d of %u%s", session->Fd, *(uint32_t *)context, Bricli_GetSendEol(cli));
+}
+
+/**
+ * @brief Echo command handler, returns whatever was sent!
+ *
+ * @param cli The session's BriCLI instance.
+ * @param context The command's context pointer.
+ * @param numberOfArgs The number of arguments received
+ * @param args The string array of arguments.
+ * @return A BriCLI Error code, 0 for success.
+ */
+static int Echo_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char *args[])
+{
+    (void)context;
+    if (numberOfArgs < 1)
+    {
+        Bricli_WriteStringLine(cli, "Must provide 1 argument!");
+        return -1;
+    }
+
+    return Bricli_PrintF(cli, "You sent: %s%s", args[0], Bricli_GetSendEol(cli));
+}
+
+/**
+ * @brief Status command handler, prints the server status as a structured record.
+ *
+ * @param cli The session's BriCLI instance.
+ * @param context The command's context pointer.
+ * @param numberOfArgs The number of arguments received
+ * @param args The string array of arguments.
+ * @return A BriCLI Error code, 0 for success.
+ */
+static int Status_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char *args[])
+{
+    (void)numberOfArgs;
+    (void)args;
+    Bricli_EmitBegin(cli);
+    Bricli_EmitUInt(cli, "sessions", *(uint32_t *)context);
+    Bricli_EmitUInt(cli, "session_bytes", sizeof(Session_t));
+    Bricli_EmitUInt(cli, "commands", BRICLI_STATIC_ARRAY_SIZE(_commandList));
+    return Bricli_EmitEnd(cli);
+}
+
+/**
+ * @brief Quit command handler, closes the calling session once its output is sent.
+ *
+ * @param cli The session's BriCLI instance.
+ * @param context The command's context pointer.
+ * @param numberOfArgs The number of arguments received
+ * @param args The string array of arguments.
+ * @return Always returns 0 for success.
+ */
+static int Quit_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char *args[])
+{
+    (void)context;
+    (void)numberOfArgs;
+    (void)args;
+    ((Session_t *)cli->UserData)->IsClosing = true;
+    return 0;
+}
+
+/**
+ * @brief Priority command handler, moves the calling session between lanes.
+ *
+ * @param cli The session's BriCLI instance.
+ * @param context The command's context pointer.
+ * @param numberOfArgs The number of arguments received
+ * @param args The string array of arguments.
+ * @return A BriCLI Error code, 0 for success.
+ */
+static int Priority_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char *args[])
+{
+    Session_t *session = (Session_t *)cli->UserData;
+
+    (void)context;
+    if (numberOfArgs < 1 || (strcmp(args[0], "interactive") != 0 && strcmp(args[0], "bulk") != 0))
+    {
+        Bricli_WriteStringLine(cli, "Must provide interactive or bulk!");
+        return -1;
+    }
+
+    // The session is out of its lane while it runs, so the change applies from its next turn.
+    session->Lane = (strcmp(args[0], "bulk") == 0) ? LaneBulk : LaneInteractive;
+    return 0;
+}
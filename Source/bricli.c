@@ -12,151 +12,285 @@
  **/
 
 /* INCLUDES */
-// Fix for "strtok_r" not found on default C99 GNU builds.
-#ifdef __GNUC__
-    #define _GNU_SOURCE
-#endif // __GNUC__
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
+#include <limits.h>
+#include <float.h>
 #include "bricli.h"
 
+// Only use the vectorised hex decoder where the target actually provides SSE2.
+#if BRICLI_USE_SIMD && defined(__SSE2__)
+    #define BRICLI_HEX_USE_SSE2 1
+    #include <emmintrin.h>
+#else
+    #define BRICLI_HEX_USE_SSE2 0
+#endif // BRICLI_USE_SIMD && __SSE2__
+
 /* CONSTANTS */
 
-#if BRICLI_USE_COLOUR
-static const char *_colourReset = "\e[0m";
+// Layout of BricliColours_t, each group of options covers the same eight colours.
+#define BRICLI_COLOURS_PER_GROUP    8
+
+// Attribute flags tracked in BricliColourState_t.
+#define BRICLI_ATTRIBUTE_BOLD       0x01
+#define BRICLI_ATTRIBUTE_UNDERLINE  0x02
+
+// Builds an SGR table entry with its length worked out at compile time.
+#define BRICLI_SGR(code) { code, sizeof(code) - 1 }
 
+// VT100 escape sequences indexed directly by BricliColours_t, disabled options are left NULL.
+static const BricliIoVec_t _sgrTable[BricliColourReset + 1] =
+{
+#if BRICLI_USE_COLOUR
 #if BRICLI_USE_TEXT_COLOURS
-static const char *_colourTable[] =
-{
-    "\e[0;30m", // Black
-    "\e[0;31m", // Red
-    "\e[0;32m", // Green
-    "\e[0;33m", // Yellow
-    "\e[0;34m", // Blue
-    "\e[0;35m", // Magenta
-    "\e[0;36m", // Cyan
-    "\e[0;37m"  // White
-};
+    [BricliTextBlack]           = BRICLI_SGR(BRICLI_TEXT_BLACK),
+    [BricliTextRed]             = BRICLI_SGR(BRICLI_TEXT_RED),
+    [BricliTextGreen]           = BRICLI_SGR(BRICLI_TEXT_GREEN),
+    [BricliTextYellow]          = BRICLI_SGR(BRICLI_TEXT_YELLOW),
+    [BricliTextBlue]            = BRICLI_SGR(BRICLI_TEXT_BLUE),
+    [BricliTextMagenta]         = BRICLI_SGR(BRICLI_TEXT_MAGENTA),
+    [BricliTextCyan]            = BRICLI_SGR(BRICLI_TEXT_CYAN),
+    [BricliTextWhite]           = BRICLI_SGR(BRICLI_TEXT_WHITE),
 #endif // BRICLI_USE_TEXT_COLOURS
-
 #if BRICLI_USE_BOLD
-static const char *_boldTable[] =
-{
-    "\e[1;30m", // Bold Black
-    "\e[1;31m", // Bold Red
-    "\e[1;32m", // Bold Green
-    "\e[1;33m", // Bold Yellow
-    "\e[1;34m", // Bold Blue
-    "\e[1;35m", // Bold Magenta
-    "\e[1;36m", // Bold Cyan
-    "\e[1;37m"  // Bold White
-};
+    [BricliTextBoldBlack]       = BRICLI_SGR(BRICLI_BOLD_BLACK),
+    [BricliTextBoldRed]         = BRICLI_SGR(BRICLI_BOLD_RED),
+    [BricliTextBoldGreen]       = BRICLI_SGR(BRICLI_BOLD_GREEN),
+    [BricliTextBoldYellow]      = BRICLI_SGR(BRICLI_BOLD_YELLOW),
+    [BricliTextBoldBlue]        = BRICLI_SGR(BRICLI_BOLD_BLUE),
+    [BricliTextBoldMagenta]     = BRICLI_SGR(BRICLI_BOLD_MAGENTA),
+    [BricliTextBoldCyan]        = BRICLI_SGR(BRICLI_BOLD_CYAN),
+    [BricliTextBoldWhite]       = BRICLI_SGR(BRICLI_BOLD_WHITE),
 #endif // BRICLI_USE_BOLD
-
 #if BRICLI_USE_UNDERLINE
-static const char *_underlineTable[] =
-{
-    "\e[4;30m", // Underline Black
-    "\e[4;31m", // Underline Red
-    "\e[4;32m", // Underline Green
-    "\e[4;33m", // Underline Yellow
-    "\e[4;34m", // Underline Blue
-    "\e[4;35m", // Underline Magenta
-    "\e[4;36m", // Underline Cyan
-    "\e[4;37m"  // Underline White
-};
+    [BricliUnderlineBlack]      = BRICLI_SGR(BRICLI_UL_BLACK),
+    [BricliUnderlineRed]        = BRICLI_SGR(BRICLI_UL_RED),
+    [BricliUnderlineGreen]      = BRICLI_SGR(BRICLI_UL_GREEN),
+    [BricliUnderlineYellow]     = BRICLI_SGR(BRICLI_UL_YELLOW),
+    [BricliUnderlineBlue]       = BRICLI_SGR(BRICLI_UL_BLUE),
+    [BricliUnderlineMagenta]    = BRICLI_SGR(BRICLI_UL_MAGENTA),
+    [BricliUnderlineCyan]       = BRICLI_SGR(BRICLI_UL_CYAN),
+    [BricliUnderlineWhite]      = BRICLI_SGR(BRICLI_UL_WHITE),
 #endif // BRICLI_USE_UNDERLINE
-
 #if BRICLI_USE_BACKGROUNDS
-static const char *_backgroundTable[] =
-{
-    "\e[40m", // Black Background
-    "\e[41m", // Red Background
-    "\e[42m", // Green Background
-    "\e[43m", // Yellow Background
-    "\e[44m", // Blue Background
-    "\e[45m", // Magenta Background
-    "\e[46m", // Cyan Background
-    "\e[47m"  // White Background
-};
+    [BricliBackgroundBlack]     = BRICLI_SGR(BRICLI_BKGND_BLACK),
+    [BricliBackgroundRed]       = BRICLI_SGR(BRICLI_BKGND_RED),
+    [BricliBackgroundGreen]     = BRICLI_SGR(BRICLI_BKGND_GREEN),
+    [BricliBackgroundYellow]    = BRICLI_SGR(BRICLI_BKGND_YELLOW),
+    [BricliBackgroundBlue]      = BRICLI_SGR(BRICLI_BKGND_BLUE),
+    [BricliBackgroundMagenta]   = BRICLI_SGR(BRICLI_BKGND_MAGENTA),
+    [BricliBackgroundCyan]      = BRICLI_SGR(BRICLI_BKGND_CYAN),
+    [BricliBackgroundWhite]     = BRICLI_SGR(BRICLI_BKGND_WHITE),
 #endif // BRICLI_USE_BACKGROUNDS
+    [BricliColourReset]         = BRICLI_SGR(BRICLI_COLOUR_RESET),
 #endif // BRICLI_USE_COLOUR
+};
+
+// Runs of padding characters written by the PrintF formatter.
+static const char _padSpaces[] = "                ";
+static const char _padZeros[] = "0000000000000000";
+
+#if BRICLI_USE_FAST_FORMAT
+// Two character decimal representations of 0 to 99, used to convert integers two digits at a time.
+static const char _digitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char _hexLower[] = "0123456789abcdef";
+static const char _hexUpper[] = "0123456789ABCDEF";
+#endif // BRICLI_USE_FAST_FORMAT
 
 /* LOCAL FUNCTIONS */
 
+#if !BRICLI_USE_THREADS
 /**
- * @brief Extracts arguments from a given argument string. Arguments must be separated by spaces.
+ * @brief Sets a flag and returns its old value, BRICLI_ATOMIC_EXCHANGE when threading is off.
  *
- * @param arguments     Pointer to the argument string to look for arguments in.
- * @param output        Pointer to a char* array to store each of the found arguments in.
+ * @param flag  Pointer to the flag to set.
+ * @param value The value to store.
  *
- * @return The number of arguments found.
+ * @return The value the flag held before.
  */
-static uint32_t Bricli_ExtractArguments(char *arguments, char *output[])
+static bool Bricli_ExchangeFlag(volatile bool *flag, bool value)
 {
-    char seperator[] = " ";
-    uint8_t argumentsFound = 0;
-    
-#if BRICLI_USE_REENTRANT
-    char *savePointer = NULL;
-#endif // BRICLI_USE_REENTRANT
+    bool previous = *flag;
 
-    // Make sure we actually have something to work with.
-    if (arguments == NULL || output == NULL)
+    *flag = value;
+    return previous;
+}
+
+/**
+ * @brief Stores desired if the value still equals expected, BRICLI_ATOMIC_CAS when threading is off.
+ *
+ * @param value     Pointer to the value to update.
+ * @param expected  The value expected, updated to the current value on failure.
+ * @param desired   The value to store.
+ *
+ * @return True if desired was stored.
+ */
+static bool Bricli_CompareExchange(volatile uint32_t *value, uint32_t *expected, uint32_t desired)
+{
+    if (*value != *expected)
     {
-        return 0;
+        *expected = *value;
+        return false;
+    }
+    *value = desired;
+    return true;
+}
+#endif // BRICLI_USE_THREADS
+
+/**
+ * @brief Counts the worker jobs that have been submitted but not yet released.
+ *
+ * @param cli Pointer to the BriCLI instance to use.
+ *
+ * @return The number of jobs in flight, 0 when there is no job pool.
+ */
+static uint32_t Bricli_JobsInFlight(BricliHandle_t *cli)
+{
+    return (cli->JobPool != NULL) ? cli->JobPool->JobTail - cli->JobPool->JobHead : 0;
+}
+
+/**
+ * @brief Checks whether commands can be started in the background.
+ *
+ * @param cli Pointer to the BriCLI instance to use.
+ *
+ * @return True if the instance has a pool of background job slots.
+ */
+static bool Bricli_HasBackgroundJobs(BricliHandle_t *cli)
+{
+    return cli->JobPool != NULL && cli->JobPool->BackgroundJobs != NULL;
+}
+
+/**
+ * @brief Checks whether paged output is in progress.
+ *
+ * @param cli Pointer to the BriCLI instance to use.
+ *
+ * @return True while a producer is being paged.
+ */
+static bool Bricli_IsPaging(BricliHandle_t *cli)
+{
+    return cli->Pager != NULL && cli->Pager->Producer != NULL;
+}
+
+/**
+ * @brief Tokenises the next argument in place, advancing the cursor past it.
+ *
+ * A backslash makes the following character literal, both inside and outside of quotes.
+ * Escapes are resolved by compacting the argument in place so no copy is needed.
+ * Separators and closing quotes are replaced with NUL characters and tokenising never
+ * reads past the NUL terminating the argument string.
+ *
+ * @param cursor    Pointer to the current position in the argument string, updated on return.
+ *                  Set to NULL if a quoted argument was never closed.
+ * @param token     Pointer to the span to store the argument in.
+ *
+ * @return True if an argument was found, false at the end of the string or on a malformed argument.
+ */
+static bool Bricli_NextToken(char **cursor, BricliSpan_t *token)
+{
+    char *tokenStart = *cursor;
+    char *read = NULL;
+    char *write = NULL;
+    bool isQuoted = false;
+
+    // Skip any separators before the next token.
+    while (*tokenStart == ' ')
+    {
+        tokenStart++;
+    }
+
+    if (*tokenStart == '\0')
+    {
+        *cursor = tokenStart;
+        return false;
     }
 
-    // Split the arguments.
-    #if BRICLI_USE_REENTRANT
-        char *token = (char *)strtok_r(arguments, seperator, &savePointer);
-    #else
-        char *token = (char *)strtok(arguments, seperator);
-    #endif // BRICLI_USE_REENTRANT
-    while (token != NULL && argumentsFound < BRICLI_MAX_ARGUMENTS)
+    // This is actually a string argument, need to skip to the next quote mark.
+    if (*tokenStart == '\"')
     {
+        isQuoted = true;
+        tokenStart++;
+    }
 
-        // This is actually a string argument, need to skip to the next quote mark.
-        if (*token == '\"')
+    // Copy the token down over any escape characters, the write position never passes the read position.
+    read = tokenStart;
+    write = tokenStart;
+    while (*read != '\0')
+    {
+        if (*read == '\\' && *(read + 1) != '\0')
+        {
+            read++;
+        }
+        else if ((isQuoted && *read == '\"') || (!isQuoted && *read == ' '))
         {
-            // Skip past the speech mark.
-            token++;
+            break;
+        }
+        *write++ = *read++;
+    }
 
-            // If we aren't useing re-entrancy we need to calculate the next token point ahead of time.
-            #if !BRICLI_USE_REENTRANT
-                char* savePointer = token + strlen(token) + 1;
-            #endif // !BRICLI_USE_REENTRANT
+    if (isQuoted && *read != '\"')
+    {
+        // User didn't close out their speech mark so just bail out.
+        *cursor = NULL;
+        return false;
+    }
 
-            // If strtok_r nulled out a space we need to re-add it.
-            if (savePointer != NULL && *(savePointer - 1) == '\0')
-            {
-                *(savePointer - 1) = ' ';
-            }
+    token->Data = tokenStart;
+    token->Length = (uint32_t)(write - tokenStart);
 
-            // Look for the closing quote mark.
-            char *quoteToken = strchr(savePointer, '\"');
-            if (quoteToken == NULL)
-            {
-                // User didn't close out their speech mark so just bail out.
-                return 0;
-            }
+    // Step past the separator, unless the token ran to the end of the string, and terminate the token.
+    if (*read != '\0')
+    {
+        read++;
+    }
+    *write = '\0';
+    *cursor = read;
+    return true;
+}
 
-            // Replace the closing mark with a null character and step forward the save pointer.
-            *quoteToken = '\0';
-            savePointer = quoteToken + 1;
-        }
+/**
+ * @brief Extracts arguments from a given argument string. Arguments must be separated by spaces.
+ *
+ * The length of every argument is recorded as it is found so handlers never need to call strlen.
+ *
+ * @param arguments     Pointer to the argument string to look for arguments in.
+ * @param output        Pointer to a span array to store each of the found arguments in.
+ *
+ * @return The number of arguments found.
+ */
+static uint32_t Bricli_ExtractArguments(char *arguments, BricliSpan_t output[])
+{
+    uint32_t argumentsFound = 0;
+    char *cursor = arguments;
+
+    // Make sure we actually have something to work with.
+    if (arguments == NULL || output == NULL)
+    {
+        return 0;
+    }
 
-        // Store this token and increment the arguments counter.
-        output[argumentsFound] = token;
+    while (argumentsFound < BRICLI_MAX_ARGUMENTS && Bricli_NextToken(&cursor, &output[argumentsFound]))
+    {
         argumentsFound++;
+    }
 
-        // Get the next token.
-        #if BRICLI_USE_REENTRANT
-            token = (char *)strtok_r(NULL, seperator, &savePointer);
-        #else
-            token = (char *)strtok(NULL, seperator);
-        #endif // BRICLI_USE_REENTRANT
+    // A malformed argument invalidates the whole set.
+    if (cursor == NULL)
+    {
+        return 0;
     }
 
     // Return how many arguments we were able to find.
@@ -164,593 +298,4310 @@ static uint32_t Bricli_ExtractArguments(char *arguments, char *output[])
 }
 
 /**
- * @brief Update the state of a given BriCLI handle, calling the event handler if set.
- * 
- * @param cli Pointer to the BriCLI instance to use.
- * @param newState The new state to set on the BriCLI instance.
+ * @brief Converts a single hex character into its nibble value.
+ *
+ * @param hexChar The character to convert.
+ *
+ * @return The nibble value, or -1 if the character is not valid hex.
  */
-static inline void Bricli_ChangeState(BricliHandle_t* cli, BricliStates_t newState)
+static inline int Bricli_HexValue(char hexChar)
 {
-    BricliStates_t currentState = cli->State;
+    if (hexChar >= '0' && hexChar <= '9')
+    {
+        return hexChar - '0';
+    }
 
-    // Update our state and call the OnStateChanged event if set.
-    cli->State = newState;
-    if (cli->OnStateChanged != NULL)
+    // Fold upper case onto lower case before checking the letter range.
+    hexChar |= 0x20;
+    if (hexChar >= 'a' && hexChar <= 'f')
     {
-        cli->OnStateChanged(currentState, newState);
+        return hexChar - 'a' + 10;
     }
+    return -1;
 }
 
-/* FUNCTION DEFINITIONS */
-
-#if BRICLI_USE_COLOUR
+#if BRICLI_HEX_USE_SSE2
 /**
- * @brief Sets the various colour options of a VT100 terminal.
+ * @brief Decodes hex text 32 characters at a time using SSE2.
  *
- * @param colourId The enum ID of the colour option to be written.
+ * Both input halves are loaded before the 16 decoded bytes are stored, so the output
+ * may alias the input as long as it never runs ahead of it.
+ *
+ * @param input     Pointer to the hex text.
+ * @param output    Pointer to store the decoded bytes at.
+ * @param pairs     The number of hex character pairs available in input.
+ *
+ * @return The number of bytes decoded, stopping early at the first block containing an invalid character.
  */
-void Bricli_SetColour(BricliHandle_t *cli, BricliColours_t colourId)
+static uint32_t Bricli_DecodeHexSse2(const char *input, uint8_t *output, uint32_t pairs)
 {
-    char *colourMessage = NULL;
+    const __m128i belowZero = _mm_set1_epi8('0' - 1);
+    const __m128i aboveNine = _mm_set1_epi8('9' + 1);
+    const __m128i belowA = _mm_set1_epi8('a' - 1);
+    const __m128i aboveF = _mm_set1_epi8('f' + 1);
+    const __m128i lowerCase = _mm_set1_epi8(0x20);
+    const __m128i lowByte = _mm_set1_epi16(0x00FF);
+    uint32_t decoded = 0;
 
-    // Reset the VT100 terminal colour settings.
-    if (colourId == BricliColourReset)
+    while ((pairs - decoded) >= 16)
     {
-        colourMessage = (char *)_colourReset;
+        __m128i packed[2];
+
+        for (int half = 0; half < 2; half++)
+        {
+            __m128i chars = _mm_loadu_si128((const __m128i *)&input[(decoded * 2) + (half * 16)]);
+            __m128i lower = _mm_or_si128(chars, lowerCase);
+
+            // Classify every character, signed compares also reject anything above 0x7F.
+            __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(chars, belowZero), _mm_cmplt_epi8(chars, aboveNine));
+            __m128i isAlpha = _mm_and_si128(_mm_cmpgt_epi8(lower, belowA), _mm_cmplt_epi8(lower, aboveF));
+            if (_mm_movemask_epi8(_mm_or_si128(isDigit, isAlpha)) != 0xFFFF)
+            {
+                // Leave the offending block to the scalar decoder so it can report the error.
+                return decoded;
+            }
+
+            __m128i nibbles = _mm_or_si128(
+                _mm_and_si128(isDigit, _mm_sub_epi8(chars, _mm_set1_epi8('0'))),
+                _mm_and_si128(isAlpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10)))
+            );
+
+            // Each 16-bit lane holds the high nibble in its low byte and the low nibble in its high byte.
+            packed[half] = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nibbles, lowByte), 4), _mm_srli_epi16(nibbles, 8));
+        }
+
+        _mm_storeu_si128((__m128i *)&output[decoded], _mm_packus_epi16(packed[0], packed[1]));
+        decoded += 16;
     }
-#if BRICLI_USE_TEXT_COLOURS
-    // Text colours.
-    else if (colourId <= BricliTextWhite)
+
+    return decoded;
+}
+#endif // BRICLI_HEX_USE_SSE2
+
+/**
+ * @brief Converts a single base64 character into its 6-bit value.
+ *
+ * @param base64Char The character to convert.
+ *
+ * @return The 6-bit value, or -1 if the character is not in the base64 alphabet.
+ */
+static inline int Bricli_Base64Value(char base64Char)
+{
+    if (base64Char >= 'A' && base64Char <= 'Z')
     {
-        colourMessage = (char *)_colourTable[colourId];
+        return base64Char - 'A';
     }
-#endif // BRICLI_USE_TEXT_COLOURSs
-#if BRICLI_USE_BOLD
-    // Bold colours
-    else if (colourId <= BricliTextBoldWhite)
+    else if (base64Char >= 'a' && base64Char <= 'z')
     {
-        colourMessage = (char *)_boldTable[colourId - BricliTextWhite];
+        return base64Char - 'a' + 26;
     }
-#endif // BRICLI_USE_BOLD
-#if BRICLI_USE_UNDERLINE
-    // Underline colours.
-    else if (colourId <= BricliUnderlineWhite)
+    else if (base64Char >= '0' && base64Char <= '9')
     {
-        colourMessage = (char *)_underlineTable[colourId - BricliTextBoldWhite];
+        return base64Char - '0' + 52;
     }
-#endif // BRICLI_USE_UNDERLINE
-#if BRICLI_USE_BACKGROUNDS
-    // Background colours.
-    else if (colourId <= BricliBackgroundWhite)
+    else if (base64Char == '+')
     {
-        colourMessage = (char *)_backgroundTable[colourId - BricliUnderlineWhite];
+        return 62;
     }
-#endif // BRICLI_USE_BACKGROUNDS
-
-    // Send the colour message if we have one.
-    if (colourMessage != NULL)
+    else if (base64Char == '/')
     {
-        Bricli_WriteString(cli, colourMessage);
+        return 63;
     }
-}
-#endif // BRICLI_USE_COLOUR
-
-int Bricli_ParseEscapeCode(BricliHandle_t *cli)
-{
-    //  // Check if this is an up arrow or not.
-    //  if (cli->PendingBytes >= BRICLI_ARROW_LEN && (strncmp(cli->RxBuffer, BRICLI_UP_ARROW, cli->BRICLI_ARROW_LEN) ==0) )
-    //    {
-    //      // Up Arrow pressed.
-    //    }
-    (void)&cli;
-    return BricliOk;
+    return -1;
 }
 
 /**
- * @brief Removes a command from the receive buffer, moving any remaining commands to the front.
- * 
- * @param cli Pointer to a BriCLI instance.
+ * @brief Checks whether the RX buffer currently ends with the EOL.
+ *
+ * @param cli Pointer to the BriCLI instance to use.
+ *
+ * @return The length of the EOL if the buffer ends with it, zero otherwise.
  */
-void Bricli_ClearCommand(BricliHandle_t *cli)
+static size_t Bricli_EndsWithEol(BricliHandle_t *cli)
 {
-    size_t nextCommand = 0;
-    
-    // If there is another command it will always be EOL length past our old command.
-    nextCommand = strlen(cli->RxBuffer) + strlen(cli->Eol);
+    size_t eolLength = 0;
 
-    // If the next command is out of bounds or more than we have just clear the whole buffer.
-    if (nextCommand >= cli->RxBufferSize || nextCommand >= cli->PendingBytes)
+    if (Bricli_GetEol(cli) == NULL)
     {
-        Bricli_ClearBuffer(cli);
+        return 0;
     }
-    else
+
+    eolLength = strlen(Bricli_GetEol(cli));
+    if (eolLength == 0 || cli->PendingBytes < eolLength ||
+        memcmp(&cli->RxBuffer[cli->PendingBytes - eolLength], Bricli_GetEol(cli), eolLength) != 0)
     {
-        // Remove the number of bytes we have handled.
-        cli->PendingBytes -= nextCommand;
-        
-        // Shift next command to start of buffer
-        memmove(cli->RxBuffer, &cli->RxBuffer[nextCommand], cli->PendingBytes);
-        memset(&cli->RxBuffer[cli->PendingBytes], 0, nextCommand);
+        return 0;
     }
+    return eolLength;
 }
 
 /**
-* @brief Default runner for performing common BriCLI functionality.
-*
-* @param cli Pointer to the CLI instance to use.
-* @return The error code from Bricli_ParseCommand.
-*/
-int Bricli_Parse(BricliHandle_t *cli)
+ * @brief Joins a continued line onto the command before it.
+ *
+ * If the RX buffer ends with an unescaped backslash followed by the EOL both are removed,
+ * so the next line is received straight onto the end of the current command.
+ *
+ * @param cli Pointer to the BriCLI instance to use.
+ */
+static void Bricli_JoinContinuation(BricliHandle_t *cli)
 {
-    size_t numberOfCommands;
-    int result = BricliOk;
+    size_t eolLength = Bricli_EndsWithEol(cli);
+    uint32_t backslashes = 0;
 
-    // First do a non-invasive check for an EOL delimeter.
-    if (!Bricli_CheckForEol(cli, false))
+    // Make sure the buffer ends with an EOL that has room for a backslash before it.
+    if (eolLength == 0 || cli->PendingBytes < (eolLength + 1))
     {
-        goto cleanup;
+        return;
     }
 
-    // Edge case: Eol has been sent on it's own
-    // giving us a zero-length command.
-    if (cli->PendingBytes == strlen(cli->Eol))
+    // Count the backslashes directly before the EOL, an escaped backslash does not continue the line.
+    for (uint32_t i = cli->PendingBytes - eolLength; i > 0 && cli->RxBuffer[i - 1] == '\\'; i--)
     {
-        Bricli_SendPrompt(cli);
-        Bricli_ClearBuffer(cli);
-        goto cleanup;
+        backslashes++;
     }
 
-    // Look for an EOL, repeating for as long as we have commands in the buffer.
-    numberOfCommands = Bricli_SplitOnEol(cli);
-    while(numberOfCommands > 0)
+    if ((backslashes % 2) == 1)
     {
-        // Handle the command.
-        result = Bricli_ParseCommand(cli);
+        cli->PendingBytes -= (uint32_t)(eolLength + 1);
+        memset(&cli->RxBuffer[cli->PendingBytes], 0, eolLength + 1);
+    }
+}
 
-        // Remove the command we just handled
-        Bricli_ClearCommand(cli);
+/**
+ * @brief Checks whether a newly received space ends the name of a streaming command.
+ *
+ * Streaming only starts for the first command in the RX buffer, so chunks are always
+ * delivered in order with any earlier commands.
+ *
+ * @param cli Pointer to the BriCLI instance to use.
+ */
+static void Bricli_CheckForStream(BricliHandle_t *cli)
+{
+    uint32_t nameLength = cli->PendingBytes - 1;
 
-        // Reset our internal state.
-        Bricli_ChangeState(cli, BricliStateIdle);
+    // The space must directly follow a command name at the start of the buffer.
+    if (nameLength == 0 || nameLength > BRICLI_MAX_COMMAND_LEN || memchr(cli->RxBuffer, ' ', nameLength) != NULL ||
+        (Bricli_GetEol(cli) != NULL && strstr(cli->RxBuffer, Bricli_GetEol(cli)) != NULL))
+    {
+        return;
+    }
 
-        // Track that we have handled this command.
-        numberOfCommands--;
+    for (uint32_t i = 0; i < Bricli_GetCommandListLength(cli); i++)
+    {
+        BricliCommand_t *command = &Bricli_GetCommandList(cli)[i];
 
-        // If we just handled the last command send the CLI prompt.
-        if (numberOfCommands == 0)
+        if (command->StreamReader != NULL && strncmp(command->Name, cli->RxBuffer, nameLength) == 0 &&
+            command->Name[nameLength] == '\0')
         {
-            Bricli_SendPrompt(cli);
+            cli->StreamCommand = command;
+            cli->StreamOffset = cli->PendingBytes;
+            cli->StreamResult = BricliOk;
+            return;
         }
     }
-
-cleanup:
-    return result;
 }
 
-
 /**
- * @brief Parses the given command against the provided CLI instance.
+ * @brief Hands the streamed argument bytes received so far to the command's reader.
  *
- * @param cli Pointer to a BriCLI instance.
- * @param data The full command string received including any arguments.
+ * Any trailing bytes that could be the start of a multi-character EOL are held back
+ * so the reader never sees part of the EOL.
  *
- * @return Pass through return from the given command handler.
+ * @param cli Pointer to the BriCLI instance to use.
  */
-int Bricli_ParseCommand(BricliHandle_t *cli)
+static void Bricli_DeliverStreamChunk(BricliHandle_t *cli)
 {
-    char command[BRICLI_MAX_COMMAND_LEN + 1] = {0};
-    char arguments[BRICLI_ARGUMENT_BUFFER_LEN] = {0};
-    uint32_t commandLength = 0;
-    uint32_t argumentLength = 0;
+    uint32_t heldBack = 0;
+    uint32_t chunkLength = 0;
+    size_t eolLength = (Bricli_GetEol(cli) == NULL) ? 0 : strlen(Bricli_GetEol(cli));
 
-    // Error check our arguments.
-    if (cli->RxBuffer == NULL)
-    {
-        cli->LastError = BricliErrorInternal;
-        return BricliBadParameter;
-    }
-    else if (cli == NULL || cli->CommandList == NULL)
+    // Find the longest buffer suffix that is also a prefix of the EOL.
+    for (uint32_t i = (uint32_t)eolLength - 1; eolLength > 1 && i > 0; i--)
     {
-        cli->LastError = BricliErrorInternal;
-        return BricliBadHandle;
+        if ((cli->PendingBytes - cli->StreamOffset) >= i &&
+            memcmp(&cli->RxBuffer[cli->PendingBytes - i], Bricli_GetEol(cli), i) == 0)
+        {
+            heldBack = i;
+            break;
+        }
     }
 
-    // Update our state.
-    Bricli_ChangeState(cli, BricliStateParsing);
-
-    // If this is actually an escape sequence handle it separately.
-    if (cli->RxBuffer[0] == '\e')
+    chunkLength = cli->PendingBytes - cli->StreamOffset - heldBack;
+    if (chunkLength == 0)
     {
-        return Bricli_ParseEscapeCode(cli);
+        return;
     }
 
-    // Look for arguments.
-    char *argData = strchr(cli->RxBuffer, ' ');
-
-    // Split the command and arguments if needed.
-    if (argData != NULL)
+    // Once the reader reports an error the rest of the stream is discarded.
+    if (cli->StreamResult >= 0)
     {
-        // Calculate length of command and skip the first space in argData.
-        commandLength = argData - cli->RxBuffer;
-        argData++;
-
-        // Copy the arguments into our local buffer, ensuring we don't overflow.
-        argumentLength = strlen(argData);
-        if (argumentLength > BRICLI_ARGUMENT_BUFFER_LEN)
+        int readerResult = cli->StreamCommand->StreamReader(&cli->RxBuffer[cli->StreamOffset], chunkLength, false);
+        if (readerResult < 0)
         {
-            argumentLength = BRICLI_ARGUMENT_BUFFER_LEN;
+            cli->StreamResult = readerResult;
         }
-        memcpy(arguments, argData, argumentLength);
     }
-    else
+
+    // Drop the delivered bytes, keeping anything held back.
+    memmove(&cli->RxBuffer[cli->StreamOffset], &cli->RxBuffer[cli->StreamOffset + chunkLength], heldBack);
+    cli->PendingBytes = cli->StreamOffset + heldBack;
+    memset(&cli->RxBuffer[cli->PendingBytes], 0, chunkLength);
+}
+
+/**
+ * @brief Update the state of a given BriCLI handle, calling the event handler if set.
+ * 
+ * @param cli Pointer to the BriCLI instance to use.
+ * @param newState The new state to set on the BriCLI instance.
+ */
+static inline void Bricli_ChangeState(BricliHandle_t* cli, BricliStates_t newState)
+{
+    BricliStates_t currentState = cli->State;
+
+    // Update our state and call the OnStateChanged event if set.
+    cli->State = newState;
+    if (cli->OnStateChanged != NULL)
+    {
+        cli->OnStateChanged(currentState, newState);
+    }
+}
+
+/**
+ * @brief Checks whether received characters should be echoed back.
+ *
+ * @param cli Pointer to the BriCLI instance to use.
+ *
+ * @return True if LocalEcho is on and the output is meant for a terminal.
+ */
+static bool Bricli_IsEchoing(BricliHandle_t *cli)
+{
+    return cli->LocalEcho && !Bricli_IsMachineOutput(cli);
+}
+
+/**
+ * @brief Reports an error as a record when the output is meant for a machine.
+ *
+ * @param cli       Pointer to the BriCLI instance to use.
+ * @param code      The error code.
+ * @param message   Description of the error.
+ * @param command   The command the error relates to, NULL to leave it out.
+ *
+ * @return True if the error was emitted, false if it should be written as text instead.
+ */
+static bool Bricli_EmitError(BricliHandle_t *cli, int code, const char *message, const char *command)
+{
+    if (!Bricli_IsMachineOutput(cli))
+    {
+        return false;
+    }
+
+    Bricli_EmitBegin(cli);
+    Bricli_EmitInt(cli, "error", code);
+    Bricli_EmitString(cli, "message", message);
+    if (command != NULL)
+    {
+        Bricli_EmitString(cli, "command", command);
+    }
+    Bricli_EmitEnd(cli);
+    return true;
+}
+
+/**
+ * @brief Reports a finished command's result, displaying any error it returned.
+ *
+ * @param cli       Pointer to the BriCLI instance to use.
+ * @param result    The command's result.
+ */
+static void Bricli_ReportResult(BricliHandle_t *cli, int result)
+{
+    // Check the result code.
+    if (result < 0)
+    {
+        // If enabled, display the error code to the user.
+#if BRICLI_SHOW_COMMAND_ERRORS
+        const char *message = (result == BricliTimedOut) ? "Command timed out"
+                            : (result == BricliCancelled) ? "Command cancelled"
+                            : "Command returned error";
+
+        if (Bricli_EmitError(cli, result, message, NULL))
+        {
+            // Reported as a record.
+        }
+        else if (result == BricliTimedOut || result == BricliCancelled)
+        {
+            BRICLI_PRINTF_COLOURED(cli, BricliTextRed, "%s%s", message, Bricli_GetSendEol(cli));
+        }
+        else
+        {
+            BRICLI_PRINTF_COLOURED(cli, BricliTextRed, "%s: %d%s", message, result, Bricli_GetSendEol(cli));
+        }
+#endif // BRICLI_SHOW_COMMAND_ERRORS
+
+        cli->LastError = BricliErrorCommand;
+    }
+
+    if (cli->TxFlushPolicy == BricliFlushAfterHandler)
+    {
+        Bricli_Flush(cli);
+    }
+}
+
+/**
+ * @brief Calls the handler for a matched command and reports any error it returns.
+ *
+ * @param cli           Pointer to the BriCLI instance to use.
+ * @param cliCommand    Pointer to the command being executed.
+ * @param arguments     Pointer to the in-buffer argument string, may be NULL.
+ *
+ * @return Pass through return from the command handler.
+ */
+static int Bricli_RunHandler(BricliHandle_t *cli, BricliCommand_t *cliCommand, char *arguments)
+{
+    BricliSpan_t argumentSpans[BRICLI_MAX_ARGUMENTS] = {0};
+    uint32_t numberOfArguments = 0;
+    bool wasPending = cli->IsPending;
+    int result = BricliBadFunction;
+
+    // Commands run while another is pending, or from within another's handler, share its
+    // cancellation and time budget rather than starting their own.
+    bool hasOwnBudget = !wasPending && (cli->Capture == NULL || !cli->Capture->IsNested);
+
+    // Extract additional arguments, lazy commands pull them on demand through Bricli_NextArg
+    // and streaming commands are given the raw argument text instead.
+    if (cliCommand->Flags & BricliCommandLazyArguments)
+    {
+        cli->ArgumentCursor = arguments;
+    }
+    else if (cliCommand->StreamReader == NULL)
+    {
+        numberOfArguments = Bricli_ExtractArguments(arguments, argumentSpans);
+    }
+
+    if (hasOwnBudget)
+    {
+        cli->IsTimedOut = false;
+        cli->HasDeadline = (cliCommand->TimeoutMs > 0 && cli->GetTick != NULL);
+        if (cli->HasDeadline)
+        {
+            cli->Deadline = cli->GetTick() + cliCommand->TimeoutMs;
+        }
+    }
+
+    // Call the command's handler function, preferring the handle aware then span based signatures when provided.
+    Bricli_ChangeState(cli, BricliStateHandlerRunning);
+    if (cliCommand->StreamReader != NULL)
+    {
+        // Deliver whatever is left as the final chunk, unless an earlier chunk already failed.
+        result = cli->StreamResult;
+        if (result >= 0)
+        {
+            result = cliCommand->StreamReader((arguments == NULL) ? "" : arguments,
+                                              (arguments == NULL) ? 0 : (uint32_t)strlen(arguments), true);
+        }
+        cli->StreamResult = BricliOk;
+    }
+    else if (cliCommand->SpanHandler != NULL && cliCommand->ContextHandler == NULL)
+    {
+        result = cliCommand->SpanHandler(numberOfArguments, argumentSpans);
+    }
+    else if (cliCommand->Handler != NULL || cliCommand->ContextHandler != NULL)
+    {
+        char *ArgumentsFound[BRICLI_MAX_ARGUMENTS] = {0};
+
+        // Spans always point into the RX buffer and are NUL terminated by the tokeniser.
+        for (uint32_t i = 0; i < numberOfArguments; i++)
+        {
+            ArgumentsFound[i] = (char *)argumentSpans[i].Data;
+        }
+        if (cliCommand->ContextHandler != NULL)
+        {
+            result = cliCommand->ContextHandler(cli, cliCommand->Context, numberOfArguments, ArgumentsFound);
+        }
+        else
+        {
+            result = cliCommand->Handler(numberOfArguments, ArgumentsFound);
+        }
+    }
+    cli->ArgumentCursor = NULL;
+
+    // Deferred commands report their result when Bricli_Complete is called.
+    if (!wasPending && cli->IsPending)
+    {
+        return BricliPending;
+    }
+
+    // A handler that overran its budget is reported as timed out, whether or not it noticed.
+    if (hasOwnBudget && Bricli_IsCancelled(cli) && cli->IsTimedOut)
+    {
+        result = BricliTimedOut;
+    }
+    // A cancellation lasts until the command it was aimed at has finished.
+    if (hasOwnBudget)
+    {
+        cli->HasDeadline = false;
+        BRICLI_ATOMIC_STORE(&cli->IsCancelled, false);
+    }
+
+    Bricli_ChangeState(cli, BricliStateFinished);
+    Bricli_ReportResult(cli, result);
+    return result;
+}
+
+/**
+ * @brief Working state for a streaming PrintF. Output is gathered into a fixed size chunk
+ *        which is written out each time it fills, so the message length is unbounded.
+ */
+typedef struct _BricliFormatter_t
+{
+    BricliHandle_t *Cli;                        // Instance the output is written to.
+    char Chunk[BRICLI_PRINT_MESSAGE_SIZE];      // Staging area for formatted output.
+    uint32_t Used;                              // Bytes currently held in the chunk.
+    uint32_t Total;                             // Total bytes emitted so far, used by %n.
+    int Result;                                 // First error returned by a write, otherwise the last result.
+} BricliFormatter_t;
+
+/**
+ * @brief A single fetched conversion argument, widened so one snprintf call per kind suffices.
+ */
+typedef union _BricliFormatValue_t
+{
+    intmax_t Signed;
+    uintmax_t Unsigned;
+    double Double;
+    long double LongDouble;
+    void *Pointer;
+} BricliFormatValue_t;
+
+/**
+ * @brief Records a write result, keeping the first error seen.
+ *
+ * @param formatter Pointer to the formatter to update.
+ * @param result    Result returned by the write.
+ */
+static void Bricli_FormatterResult(BricliFormatter_t *formatter, int result)
+{
+    if (formatter->Result >= 0)
+    {
+        formatter->Result = result;
+    }
+}
+
+/**
+ * @brief Writes out any output held in the formatter's chunk.
+ *
+ * @param formatter Pointer to the formatter to flush.
+ */
+static void Bricli_FormatterFlush(BricliFormatter_t *formatter)
+{
+    if (formatter->Used > 0)
+    {
+        Bricli_FormatterResult(formatter, Bricli_Write(formatter->Cli, formatter->Used, formatter->Chunk));
+        formatter->Used = 0;
+    }
+}
+
+/**
+ * @brief Appends raw text to the formatter output.
+ *
+ * Text which cannot fit into an empty chunk is written straight through rather than copied.
+ *
+ * @param formatter Pointer to the formatter to append to.
+ * @param data      Text to append.
+ * @param length    Length of the text.
+ */
+static void Bricli_FormatterPut(BricliFormatter_t *formatter, const char *data, uint32_t length)
+{
+    formatter->Total += length;
+    while (length > 0)
+    {
+        if (formatter->Used == 0 && length >= sizeof(formatter->Chunk))
+        {
+            Bricli_FormatterResult(formatter, Bricli_Write(formatter->Cli, length, data));
+            return;
+        }
+
+        uint32_t space = sizeof(formatter->Chunk) - formatter->Used;
+        uint32_t copyLength = (length < space) ? length : space;
+        memcpy(&formatter->Chunk[formatter->Used], data, copyLength);
+        formatter->Used += copyLength;
+        data += copyLength;
+        length -= copyLength;
+
+        if (formatter->Used == sizeof(formatter->Chunk))
+        {
+            Bricli_FormatterFlush(formatter);
+        }
+    }
+}
+
+/**
+ * @brief Appends a run of padding characters to the formatter output.
+ *
+ * @param formatter Pointer to the formatter to append to.
+ * @param padChar   Padding character to use, either ' ' or '0'.
+ * @param count     Number of characters to append.
+ */
+static void Bricli_FormatterPad(BricliFormatter_t *formatter, char padChar, uint32_t count)
+{
+    const char *padding = (padChar == '0') ? _padZeros : _padSpaces;
+
+    while (count > 0)
+    {
+        uint32_t padLength = (count < sizeof(_padSpaces) - 1) ? count : (uint32_t)(sizeof(_padSpaces) - 1);
+        Bricli_FormatterPut(formatter, padding, padLength);
+        count -= padLength;
+    }
+}
+
+#if BRICLI_USE_FAST_FORMAT
+/**
+ * @brief Writes the digits of a value backwards from the end of a buffer.
+ *
+ * Decimal values are converted two digits at a time using _digitPairs.
+ *
+ * @param end           Pointer to one past the last character of the buffer.
+ * @param value         The value to convert.
+ * @param conversion    The conversion character, 'x' or 'X' for hex, anything else for decimal.
+ *
+ * @return Pointer to the first digit written.
+ */
+static char *Bricli_FormatDigits(char *end, uintmax_t value, char conversion)
+{
+    if (conversion == 'x' || conversion == 'X')
+    {
+        const char *hexDigits = (conversion == 'x') ? _hexLower : _hexUpper;
+
+        do
+        {
+            *--end = hexDigits[value & 0x0F];
+            value >>= 4;
+        } while (value != 0);
+        return end;
+    }
+
+    while (value >= 100)
+    {
+        uint32_t pair = (uint32_t)(value % 100) * 2;
+        value /= 100;
+        *--end = _digitPairs[pair + 1];
+        *--end = _digitPairs[pair];
+    }
+
+    if (value >= 10)
+    {
+        *--end = _digitPairs[value * 2 + 1];
+        *--end = _digitPairs[value * 2];
+    }
+    else
+    {
+        *--end = (char)('0' + value);
+    }
+    return end;
+}
+
+/**
+ * @brief Appends a %d, %i, %u, %x or %X conversion without going through snprintf.
+ *
+ * Only handles a field width with the '-' and '0' flags, anything more involved is left to snprintf.
+ *
+ * @param formatter     Pointer to the formatter to append to.
+ * @param value         The value to format.
+ * @param isSigned      True if the signed member of value is valid.
+ * @param conversion    The conversion character.
+ * @param width         Minimum field width, negative if none was given.
+ * @param leftAlign     True to pad on the right.
+ * @param zeroPad       True to pad with leading zeros.
+ */
+static void Bricli_FormatterInteger(BricliFormatter_t *formatter, const BricliFormatValue_t *value, bool isSigned,
+                                    char conversion, int width, bool leftAlign, bool zeroPad)
+{
+    // Large enough for the 20 decimal digits of a 64 bit value.
+    char digits[24];
+    char *end = &digits[sizeof(digits)];
+    bool negative = isSigned && (value->Signed < 0);
+    uintmax_t magnitude = !isSigned ? value->Unsigned
+                        : negative ? (uintmax_t)0 - (uintmax_t)value->Signed
+                        : (uintmax_t)value->Signed;
+    char *start = Bricli_FormatDigits(end, magnitude, conversion);
+    uint32_t length = (uint32_t)(end - start) + (negative ? 1 : 0);
+    uint32_t padding = (width > 0 && (uint32_t)width > length) ? (uint32_t)width - length : 0;
+
+    if (!leftAlign && !zeroPad)
+    {
+        Bricli_FormatterPad(formatter, ' ', padding);
+    }
+    if (negative)
+    {
+        Bricli_FormatterPut(formatter, "-", 1);
+    }
+    if (!leftAlign && zeroPad)
+    {
+        Bricli_FormatterPad(formatter, '0', padding);
+    }
+    Bricli_FormatterPut(formatter, start, (uint32_t)(end - start));
+    if (leftAlign)
+    {
+        Bricli_FormatterPad(formatter, ' ', padding);
+    }
+}
+#endif // BRICLI_USE_FAST_FORMAT
+
+/**
+ * @brief Formats a single widened value with snprintf.
+ *
+ * @param output    Destination for the formatted text.
+ * @param size      Size of the destination.
+ * @param spec      Normalised conversion specification to use.
+ * @param kind      Which member of the value is valid, one of 'd', 'u', 'f', 'L' or 'p'.
+ * @param value     The value to format.
+ *
+ * @return Pass through return from snprintf.
+ */
+static int Bricli_FormatValue(char *output, size_t size, const char *spec, char kind, const BricliFormatValue_t *value)
+{
+    switch (kind)
+    {
+        case 'd': return snprintf(output, size, spec, value->Signed);
+        case 'u': return snprintf(output, size, spec, value->Unsigned);
+        case 'f': return snprintf(output, size, spec, value->Double);
+        case 'L': return snprintf(output, size, spec, value->LongDouble);
+        default:  return snprintf(output, size, spec, value->Pointer);
+    }
+}
+
+/**
+ * @brief Works out an upper bound on the length of a numeric or pointer conversion, ignoring the field width.
+ *
+ * The bound is never below the real length, so a conversion given at least this much room is
+ * formatted once and never truncated.
+ *
+ * @param conversion    The conversion character.
+ * @param kind          Which member of the value is valid, one of 'd', 'u', 'f', 'L' or 'p'.
+ * @param precision     The precision, negative if none was given.
+ * @param value         The value to be formatted.
+ *
+ * @return The largest number of characters the conversion can produce.
+ */
+static uint32_t Bricli_FormatBound(char conversion, char kind, int precision, const BricliFormatValue_t *value)
+{
+    uint32_t digits = (precision >= 0) ? (uint32_t)precision : 6;
+
+    switch (kind)
+    {
+        case 'd':
+        case 'u':
+            // 22 octal digits of a 64 bit value, or the zero padded precision, plus a sign or prefix.
+            return ((precision > 22) ? (uint32_t)precision : 22) + 2;
+        case 'p':
+            return 24;
+        default:
+            break;
+    }
+
+    if (conversion == 'f' || conversion == 'F')
+    {
+        long double magnitude = (kind == 'L') ? value->LongDouble : (long double)value->Double;
+        uint32_t integerDigits = 1;
+
+        magnitude = (magnitude < 0) ? -magnitude : magnitude;
+        if (magnitude <= LDBL_MAX)
+        {
+            while (magnitude >= 1e16L)
+            {
+                magnitude /= 1e16L;
+                integerDigits += 16;
+            }
+            while (magnitude >= 10.0L)
+            {
+                magnitude /= 10.0L;
+                integerDigits++;
+            }
+        }
+
+        // Sign, point, a digit for rounding up and one for any error in the estimate.
+        return integerDigits + digits + 4;
+    }
+
+    // Sign, "0x1.", up to 16 hex digits when no precision is given and an exponent of up to "p+16383".
+    return digits + 30;
+}
+
+/**
+ * @brief Formats a single conversion too long for the chunk through a larger scratch buffer.
+ *
+ * The scratch only takes up stack during this call. A value that does not fit in it either is
+ * written as far as it goes followed by "...", and reported with BricliCopyWouldOverflow.
+ *
+ * @param formatter Pointer to the formatter to append to.
+ * @param spec      Normalised conversion specification to use.
+ * @param kind      Which member of the value is valid.
+ * @param value     The value to format.
+ * @param width     Field width to pad to by hand, 0 if any width is part of spec.
+ * @param leftAlign True to pad on the right.
+ */
+static void Bricli_FormatterLongValue(BricliFormatter_t *formatter, const char *spec, char kind, const BricliFormatValue_t *value,
+                                      uint32_t width, bool leftAlign)
+{
+    char scratch[BRICLI_PRINT_LONG_SIZE];
+    int length = Bricli_FormatValue(scratch, sizeof(scratch), spec, kind, value);
+
+    if (length < 0)
+    {
+        Bricli_FormatterResult(formatter, BricliBadParameter);
+        return;
+    }
+
+    bool isTruncated = ((uint32_t)length >= sizeof(scratch));
+    uint32_t textLength = isTruncated ? (uint32_t)(sizeof(scratch) - 1) : (uint32_t)length;
+    uint32_t padding = (width > textLength) ? width - textLength : 0;
+
+    if (!leftAlign)
+    {
+        Bricli_FormatterPad(formatter, ' ', padding);
+    }
+    Bricli_FormatterPut(formatter, scratch, textLength);
+    if (isTruncated)
+    {
+        Bricli_FormatterPut(formatter, "...", 3);
+        Bricli_FormatterResult(formatter, BricliCopyWouldOverflow);
+    }
+    if (leftAlign)
+    {
+        Bricli_FormatterPad(formatter, ' ', padding);
+    }
+}
+
+/**
+ * @brief Formats a single numeric or pointer conversion directly into the chunk.
+ *
+ * The chunk is written out first if the conversion might not fit in the space left, so each value
+ * is formatted exactly once. Field widths too wide for the chunk are padded with spaces by hand.
+ * A conversion whose bound reaches a whole chunk is measured first, and if it really is that long
+ * it is formatted a second time through Bricli_FormatterLongValue.
+ *
+ * @param formatter Pointer to the formatter to append to.
+ * @param spec      Normalised conversion specification to use.
+ * @param kind      Which member of the value is valid.
+ * @param value     The value to format.
+ * @param bound     Upper bound on the formatted length, see Bricli_FormatBound.
+ * @param width     Field width to pad to by hand, 0 if any width is part of spec.
+ * @param leftAlign True to pad on the right.
+ */
+static void Bricli_FormatterValue(BricliFormatter_t *formatter, const char *spec, char kind, const BricliFormatValue_t *value,
+                                  uint32_t bound, uint32_t width, bool leftAlign)
+{
+    uint32_t space = sizeof(formatter->Chunk) - formatter->Used;
+
+    if (bound >= sizeof(formatter->Chunk))
+    {
+        int needed = Bricli_FormatValue(NULL, 0, spec, kind, value);
+        if (needed < 0)
+        {
+            Bricli_FormatterResult(formatter, BricliBadParameter);
+            return;
+        }
+        if ((uint32_t)needed >= sizeof(formatter->Chunk))
+        {
+            Bricli_FormatterLongValue(formatter, spec, kind, value, width, leftAlign);
+            return;
+        }
+        bound = (uint32_t)needed;
+    }
+
+    // Padding in front of the value is written straight out, so the chunk must only hold the value.
+    if (bound >= space || (width > 0 && !leftAlign))
+    {
+        Bricli_FormatterFlush(formatter);
+        space = sizeof(formatter->Chunk);
+    }
+
+    int length = Bricli_FormatValue(&formatter->Chunk[formatter->Used], space, spec, kind, value);
+    if (length < 0 || (uint32_t)length >= space)
+    {
+        Bricli_FormatterResult(formatter, (length < 0) ? BricliBadParameter : BricliCopyWouldOverflow);
+        return;
+    }
+
+    uint32_t padding = (width > (uint32_t)length) ? width - (uint32_t)length : 0;
+    if (!leftAlign)
+    {
+        formatter->Total += padding;
+        while (padding > 0)
+        {
+            uint32_t padLength = (padding < sizeof(_padSpaces) - 1) ? padding : (uint32_t)(sizeof(_padSpaces) - 1);
+            Bricli_FormatterResult(formatter, Bricli_Write(formatter->Cli, padLength, _padSpaces));
+            padding -= padLength;
+        }
+    }
+
+    formatter->Used += (uint32_t)length;
+    formatter->Total += (uint32_t)length;
+    Bricli_FormatterPad(formatter, ' ', padding);
+}
+
+/**
+ * @brief Handles a single conversion specification from a PrintF format string.
+ *
+ * Strings and characters are padded and copied by hand so they are never limited by the chunk
+ * size, everything else is widened and handed to snprintf with a normalised specification.
+ *
+ * @param formatter Pointer to the formatter to append to.
+ * @param format    Pointer to the '%' starting the specification.
+ * @param args      Pointer to the variadic argument list.
+ *
+ * @return Pointer to the first character following the specification.
+ */
+static const char *Bricli_FormatConversion(BricliFormatter_t *formatter, const char *format, va_list *args)
+{
+    // '%', five flags, two 11 digit numbers, '.', a length modifier, the conversion and a NUL.
+    char spec[32];
+    uint32_t specLength = 1;
+    const char *cursor = format + 1;
+    bool leftAlign = false;
+    bool zeroPad = false;
+    bool plainFlags = true;
+    int width = -1;
+    int precision = -1;
+    char lengthModifier = '\0';
+    char lengthSuffix = '\0';
+    BricliFormatValue_t value = {0};
+    char kind = 'd';
+
+    spec[0] = '%';
+
+    // Flags, each is only kept once so the specification stays bounded.
+    while (*cursor == '-' || *cursor == '+' || *cursor == ' ' || *cursor == '#' || *cursor == '0')
+    {
+        leftAlign |= (*cursor == '-');
+        zeroPad |= (*cursor == '0');
+        plainFlags &= (*cursor == '-' || *cursor == '0');
+        if (memchr(spec, *cursor, specLength) == NULL)
+        {
+            spec[specLength++] = *cursor;
+        }
+        cursor++;
+    }
+
+    // Field width, a negative '*' width means left aligned.
+    if (*cursor == '*')
+    {
+        width = va_arg(*args, int);
+        if (width < 0)
+        {
+            width = (width == INT_MIN) ? 0 : -width;
+            if (!leftAlign)
+            {
+                leftAlign = true;
+                spec[specLength++] = '-';
+            }
+        }
+        cursor++;
+    }
+    else
+    {
+        while (*cursor >= '0' && *cursor <= '9')
+        {
+            width = ((width < 0) ? 0 : width * 10) + (*cursor++ - '0');
+        }
+    }
+
+    // Precision, a negative '*' precision is treated as if it were omitted.
+    if (*cursor == '.')
+    {
+        precision = 0;
+        cursor++;
+        if (*cursor == '*')
+        {
+            precision = va_arg(*args, int);
+            cursor++;
+        }
+        else
+        {
+            while (*cursor >= '0' && *cursor <= '9')
+            {
+                precision = precision * 10 + (*cursor++ - '0');
+            }
+        }
+    }
+
+    // Length modifier, "hh" and "ll" are stored as 'H' and 'q'.
+    switch (*cursor)
+    {
+        case 'h':
+            lengthModifier = (cursor[1] == 'h') ? 'H' : 'h';
+            cursor += (cursor[1] == 'h') ? 2 : 1;
+            break;
+        case 'l':
+            lengthModifier = (cursor[1] == 'l') ? 'q' : 'l';
+            cursor += (cursor[1] == 'l') ? 2 : 1;
+            break;
+        case 'j':
+        case 'z':
+        case 't':
+        case 'L':
+            lengthModifier = *cursor++;
+            break;
+        default:
+            break;
+    }
+
+    switch (*cursor)
+    {
+        case '\0':
+            // Truncated specification, emit it as written.
+            Bricli_FormatterPut(formatter, format, (uint32_t)(cursor - format));
+            return cursor;
+
+        case '%':
+            Bricli_FormatterPut(formatter, "%", 1);
+            return cursor + 1;
+
+        case 'c':
+        case 's':
+        {
+            char character = '\0';
+            const char *text = &character;
+            uint32_t textLength = 1;
+
+            if (*cursor == 'c')
+            {
+                character = (char)va_arg(*args, int);
+            }
+            else
+            {
+                text = va_arg(*args, const char *);
+                text = (text == NULL) ? "(null)" : text;
+                if (precision >= 0)
+                {
+                    const char *end = memchr(text, '\0', (size_t)precision);
+                    textLength = (end == NULL) ? (uint32_t)precision : (uint32_t)(end - text);
+                }
+                else
+                {
+                    textLength = (uint32_t)strlen(text);
+                }
+            }
+
+            uint32_t padding = (width > 0 && (uint32_t)width > textLength) ? (uint32_t)width - textLength : 0;
+            if (!leftAlign)
+            {
+                Bricli_FormatterPad(formatter, ' ', padding);
+            }
+            Bricli_FormatterPut(formatter, text, textLength);
+            if (leftAlign)
+            {
+                Bricli_FormatterPad(formatter, ' ', padding);
+            }
+            return cursor + 1;
+        }
+
+        case 'n':
+            switch (lengthModifier)
+            {
+                case 'H': *va_arg(*args, signed char *) = (signed char)formatter->Total; break;
+                case 'h': *va_arg(*args, short *) = (short)formatter->Total; break;
+                case 'l': *va_arg(*args, long *) = (long)formatter->Total; break;
+                case 'q': *va_arg(*args, long long *) = (long long)formatter->Total; break;
+                case 'j': *va_arg(*args, intmax_t *) = (intmax_t)formatter->Total; break;
+                case 'z': *va_arg(*args, size_t *) = (size_t)formatter->Total; break;
+                case 't': *va_arg(*args, ptrdiff_t *) = (ptrdiff_t)formatter->Total; break;
+                default:  *va_arg(*args, int *) = (int)formatter->Total; break;
+            }
+            return cursor + 1;
+
+        case 'd':
+        case 'i':
+            switch (lengthModifier)
+            {
+                case 'H': value.Signed = (signed char)va_arg(*args, int); break;
+                case 'h': value.Signed = (short)va_arg(*args, int); break;
+                case 'l': value.Signed = va_arg(*args, long); break;
+                case 'q': value.Signed = va_arg(*args, long long); break;
+                case 'j': value.Signed = va_arg(*args, intmax_t); break;
+                case 'z': value.Signed = (intmax_t)va_arg(*args, size_t); break;
+                case 't': value.Signed = va_arg(*args, ptrdiff_t); break;
+                default:  value.Signed = va_arg(*args, int); break;
+            }
+            lengthSuffix = 'j';
+            break;
+
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            switch (lengthModifier)
+            {
+                case 'H': value.Unsigned = (unsigned char)va_arg(*args, unsigned int); break;
+                case 'h': value.Unsigned = (unsigned short)va_arg(*args, unsigned int); break;
+                case 'l': value.Unsigned = va_arg(*args, unsigned long); break;
+                case 'q': value.Unsigned = va_arg(*args, unsigned long long); break;
+                case 'j': value.Unsigned = va_arg(*args, uintmax_t); break;
+                case 'z': value.Unsigned = va_arg(*args, size_t); break;
+                case 't': value.Unsigned = (uintmax_t)va_arg(*args, ptrdiff_t); break;
+                default:  value.Unsigned = va_arg(*args, unsigned int); break;
+            }
+            lengthSuffix = 'j';
+            kind = 'u';
+            break;
+
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            if (lengthModifier == 'L')
+            {
+                value.LongDouble = va_arg(*args, long double);
+                lengthSuffix = 'L';
+                kind = 'L';
+            }
+            else
+            {
+                value.Double = va_arg(*args, double);
+                kind = 'f';
+            }
+            break;
+
+        case 'p':
+            value.Pointer = va_arg(*args, void *);
+            kind = 'p';
+            break;
+
+        default:
+            // Unknown conversion, emit it as written without consuming an argument.
+            Bricli_FormatterPut(formatter, format, (uint32_t)(cursor + 1 - format));
+            return cursor + 1;
+    }
+
+#if BRICLI_USE_FAST_FORMAT
+    // The common integer conversions are handled without snprintf.
+    if ((kind == 'd' || (kind == 'u' && *cursor != 'o')) && precision < 0 && plainFlags)
+    {
+        Bricli_FormatterInteger(formatter, &value, (kind == 'd'), *cursor, width, leftAlign, zeroPad);
+        return cursor + 1;
+    }
+#endif // BRICLI_USE_FAST_FORMAT
+
+    uint32_t bound = Bricli_FormatBound(*cursor, kind, precision, &value);
+    uint32_t padWidth = 0;
+
+    // Build the normalised specification for snprintf. Space padding wider than the chunk is added by hand.
+    if (width >= 0 && ((uint32_t)width < sizeof(formatter->Chunk) || (zeroPad && !leftAlign)))
+    {
+        specLength += (uint32_t)snprintf(&spec[specLength], sizeof(spec) - specLength, "%d", width);
+        bound = ((uint32_t)width > bound) ? (uint32_t)width : bound;
+    }
+    else if (width > 0)
+    {
+        padWidth = (uint32_t)width;
+    }
+    if (precision >= 0)
+    {
+        specLength += (uint32_t)snprintf(&spec[specLength], sizeof(spec) - specLength, ".%d", precision);
+    }
+    if (lengthSuffix != '\0')
+    {
+        spec[specLength++] = lengthSuffix;
+    }
+    spec[specLength++] = *cursor;
+    spec[specLength] = '\0';
+    Bricli_FormatterValue(formatter, spec, kind, &value, bound, padWidth, leftAlign);
+    return cursor + 1;
+}
+
+/**
+ * @brief Writes several pieces of data in order without touching the colour state.
+ *
+ * Pieces are coalesced into the TX buffer when they fit. Otherwise they are handed to
+ * BspWriteV without being copied, or written one at a time with BspWrite if no vector
+ * hook is set.
+ *
+ * @param cli       Pointer to a BriCLI instance.
+ * @param vectors   Array of data pieces to be written.
+ * @param count     The number of entries in vectors.
+ *
+ * @return An error code, negative indicates a problem occurred.
+ */
+static int Bricli_WriteVRaw(BricliHandle_t *cli, const BricliIoVec_t *vectors, uint32_t count)
+{
+    uint32_t totalLength = 0;
+    int result = BricliOk;
+
+    if (cli != NULL && cli->Capture != NULL)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (Bricli_CaptureWrite(cli, vectors[i].Length, vectors[i].Data) != BricliOk)
+            {
+                return BricliCopyWouldOverflow;
+            }
+        }
+        return BricliOk;
+    }
+
+    if (cli == NULL || !Bricli_HasTransport(cli) || (vectors == NULL && count > 0))
+    {
+        return BricliBadHandle;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        totalLength += vectors[i].Length;
+    }
+
+    // Remember whether the line was left open, as Bricli_WriteRaw does.
+    for (uint32_t i = count; i > 0; i--)
+    {
+        const BricliIoVec_t *vector = &vectors[i - 1];
+
+        if (vector->Length > 0 && (vector->Data[0] != '\x1b' || Bricli_IsMachineOutput(cli)))
+        {
+            cli->IsMidLine = (vector->Data[vector->Length - 1] != '\n' && vector->Data[vector->Length - 1] != '\r');
+            break;
+        }
+    }
+
+    // Small writes are cheapest coalesced with whatever else is buffered.
+    if (cli->TxBuffer != NULL && !cli->NonBlockingTx && (cli->TxPending + totalLength) <= cli->TxBufferSize)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            memcpy(&cli->TxBuffer[cli->TxPending], vectors[i].Data, vectors[i].Length);
+            cli->TxPending += vectors[i].Length;
+        }
+        return BricliOk;
+    }
+
+    // Hand everything to the transport in one go, keeping any buffered data in order first.
+    // Non-blocking instances always go through the queue so partial writes can be resumed.
+    if (cli->BspWriteV != NULL && cli->SessionWrite == NULL && !cli->NonBlockingTx)
+    {
+        result = Bricli_Flush(cli);
+        int vectorResult = cli->BspWriteV(vectors, count);
+        return (result < 0) ? result : vectorResult;
+    }
+
+    // Fall back to writing each piece in turn, keeping the first error.
+    for (uint32_t i = 0; i < count; i++)
+    {
+        int pieceResult = Bricli_WriteRaw(cli, vectors[i].Length, vectors[i].Data);
+        if (result >= 0)
+        {
+            result = pieceResult;
+        }
+    }
+    return result;
+}
+
+/* FUNCTION DEFINITIONS */
+
+/**
+ * @brief Works out the escape sequence needed to move the terminal to a colour option.
+ *
+ * Nothing is produced when the option is disabled or would not change what the terminal shows.
+ * The foreground, background and attributes are tracked separately, matching what each code
+ * changes: plain text codes reset everything first, bold and underline codes add their attribute,
+ * and background codes only change the background.
+ *
+ * @param cli       Pointer to a BriCLI instance.
+ * @param colourId  The enum ID of the colour option.
+ * @param segments  Output for the escape sequence.
+ *
+ * @return The number of escape sequences written to segments, zero or one.
+ */
+static uint32_t Bricli_SelectColour(BricliHandle_t *cli, BricliColours_t colourId, BricliIoVec_t segments[])
+{
+    BricliColourState_t *state = &cli->ColourState;
+    uint8_t colour = (uint8_t)((colourId % BRICLI_COLOURS_PER_GROUP) + 1);
+    BricliColourState_t next = *state;
+
+    if ((uint32_t)colourId > BricliColourReset || _sgrTable[colourId].Data == NULL || Bricli_IsMachineOutput(cli))
+    {
+        return 0;
+    }
+
+    if (colourId == BricliColourReset)
+    {
+        next.Foreground = 0;
+        next.Background = 0;
+        next.Attributes = 0;
+    }
+    else if (colourId < BricliTextBoldBlack)
+    {
+        next.Foreground = colour;
+        next.Background = 0;
+        next.Attributes = 0;
+    }
+    else if (colourId < BricliUnderlineBlack)
+    {
+        next.Foreground = colour;
+        next.Attributes |= BRICLI_ATTRIBUTE_BOLD;
+    }
+    else if (colourId < BricliBackgroundBlack)
+    {
+        next.Foreground = colour;
+        next.Attributes |= BRICLI_ATTRIBUTE_UNDERLINE;
+    }
+    else
+    {
+        next.Background = colour;
+    }
+
+    if (next.Foreground == state->Foreground && next.Background == state->Background &&
+        next.Attributes == state->Attributes)
+    {
+        return 0;
+    }
+
+    segments[0] = _sgrTable[colourId];
+    *state = next;
+    return 1;
+}
+
+/**
+ * @brief Sets the various colour options of a VT100 terminal.
+ *
+ * The escape sequence is only sent if the terminal is not already using the colour option.
+ *
+ * @param colourId The enum ID of the colour option to be written.
+ */
+void Bricli_SetColour(BricliHandle_t *cli, BricliColours_t colourId)
+{
+    BricliIoVec_t segments[1];
+    uint32_t count = Bricli_SelectColour(cli, colourId, segments);
+
+    // An explicitly set colour stays until it is changed again.
+    cli->IsColourDeferred = false;
+    if (count > 0)
+    {
+        Bricli_WriteVRaw(cli, segments, count);
+    }
+}
+
+/**
+ * @brief Checks whether any colour option is active on the terminal.
+ *
+ * @param cli Pointer to a BriCLI instance.
+ *
+ * @return True if the foreground, background or an attribute has been set.
+ */
+static bool Bricli_HasColour(BricliHandle_t *cli)
+{
+    return cli->ColourState.Foreground != 0 || cli->ColourState.Background != 0 || cli->ColourState.Attributes != 0;
+}
+
+/**
+ * @brief Marks the current colour as finished without resetting it straight away.
+ *
+ * The reset is sent before the next uncoloured output, so back to back output in the same
+ * colour does not need a reset and colour code between each write.
+ *
+ * @param cli Pointer to a BriCLI instance.
+ */
+void Bricli_ReleaseColour(BricliHandle_t *cli)
+{
+    cli->IsColourDeferred = Bricli_HasColour(cli);
+}
+
+int Bricli_ParseEscapeCode(BricliHandle_t *cli)
+{
+    //  // Check if this is an up arrow or not.
+    //  if (cli->PendingBytes >= BRICLI_ARROW_LEN && (strncmp(cli->RxBuffer, BRICLI_UP_ARROW, cli->BRICLI_ARROW_LEN) ==0) )
+    //    {
+    //      // Up Arrow pressed.
+    //    }
+    (void)&cli;
+    return BricliOk;
+}
+
+/**
+ * @brief Removes a command from the receive buffer, moving any remaining commands to the front.
+ * 
+ * @param cli Pointer to a BriCLI instance.
+ */
+void Bricli_ClearCommand(BricliHandle_t *cli)
+{
+    size_t nextCommand = 0;
+    
+    // If there is another command it will always be EOL length past our old command.
+    // Arguments are tokenised in place, so prefer the length recorded before parsing started.
+    if (cli->CommandLength > 0)
+    {
+        nextCommand = cli->CommandLength + strlen(Bricli_GetEol(cli));
+        cli->CommandLength = 0;
+    }
+    else
+    {
+        nextCommand = strlen(cli->RxBuffer) + strlen(Bricli_GetEol(cli));
+    }
+
+    // If the next command is out of bounds or more than we have just clear the whole buffer.
+    if (nextCommand >= cli->RxBufferSize || nextCommand >= cli->PendingBytes)
+    {
+        Bricli_ClearBuffer(cli);
+    }
+    else
+    {
+        // Remove the number of bytes we have handled.
+        cli->PendingBytes -= nextCommand;
+        
+        // Shift next command to start of buffer
+        memmove(cli->RxBuffer, &cli->RxBuffer[nextCommand], cli->PendingBytes);
+        memset(&cli->RxBuffer[cli->PendingBytes], 0, nextCommand);
+    }
+}
+
+/**
+ * @brief Looks up the command at the start of a line without parsing it.
+ *
+ * @param cli   Pointer to the BriCLI instance to use.
+ * @param line  The command line, usually the start of the RX buffer.
+ *
+ * @return The matching command, NULL for built-in or unknown commands.
+ */
+static BricliCommand_t *Bricli_PeekCommand(BricliHandle_t *cli, const char *line)
+{
+    size_t nameLength = strcspn(line, " ");
+
+    for (uint32_t i = 0; i < Bricli_GetCommandListLength(cli); i++)
+    {
+        BricliCommand_t *command = &Bricli_GetCommandList(cli)[i];
+
+        if (strlen(command->Name) == nameLength && strncmp(command->Name, line, nameLength) == 0)
+        {
+            return command;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Checks whether a command will be handed to a worker job.
+ *
+ * @param cli       Pointer to the BriCLI instance to use.
+ * @param command   The command to check, may be NULL.
+ *
+ * @return True if a job pool is set and the command is flagged for offloading and fits in a job.
+ */
+static bool Bricli_IsOffloaded(BricliHandle_t *cli, BricliCommand_t *command)
+{
+    BricliJobPool_t *pool = cli->JobPool;
+
+    return pool != NULL && pool->Jobs != NULL && pool->JobCount > 0 && pool->SubmitJob != NULL && command != NULL &&
+           (command->Flags & BricliCommandOffload) && command->ContextHandler != NULL &&
+           strlen(cli->RxBuffer) < BRICLI_JOB_LINE_SIZE;
+}
+
+/**
+ * @brief Fills a job slot with a shadow instance and a copy of the command line.
+ *
+ * @param cli       Pointer to the BriCLI instance to use.
+ * @param job       The job slot to fill.
+ * @param line      The command line to copy.
+ * @param length    The number of characters of \c line to copy, less than BRICLI_JOB_LINE_SIZE.
+ */
+static void Bricli_PrepareJob(BricliHandle_t *cli, BricliJob_t *job, const char *line, size_t length)
+{
+    BricliHandle_t shadow = BRICLI_HANDLE_DEFAULT;
+
+    // The shadow only shares configuration, its output is captured into the job.
+    shadow.Config = cli->Config;
+    shadow.UserData = cli->UserData;
+    shadow.GetTick = cli->GetTick;
+    shadow.Parent = cli;
+
+    // Records are rendered in the parent's mode, but each job counts its own fields.
+    job->Emitter.Mode = Bricli_GetOutputMode(cli);
+    job->Emitter.Count = 0;
+    shadow.Emitter = (cli->Emitter != NULL) ? &job->Emitter : NULL;
+
+    job->Shadow = shadow;
+    memcpy(job->Line, line, length);
+    job->Line[length] = '\0';
+    job->OutputLength = 0;
+    job->IsTruncated = false;
+    job->Command = NULL;
+    job->Result = BricliOk;
+    job->IsDone = false;
+
+    // Publishing the slot last means a worker can only claim it once it is complete.
+    BRICLI_ATOMIC_STORE(&job->IsClaimed, false);
+}
+
+/**
+ * @brief Hands the command at the start of the RX buffer to a worker job.
+ *
+ * @param cli Pointer to the BriCLI instance to use.
+ *
+ * @return BricliPending, the command's result is reported when the job is released.
+ */
+static int Bricli_SubmitJob(BricliHandle_t *cli)
+{
+    BricliJobPool_t *pool = cli->JobPool;
+    BricliJob_t *job = &pool->Jobs[pool->JobTail % pool->JobCount];
+
+    cli->CommandLength = (uint32_t)strlen(cli->RxBuffer);
+    Bricli_PrepareJob(cli, job, cli->RxBuffer, cli->CommandLength);
+    pool->JobTail++;
+
+    // A pool that cannot take the job leaves it to run here, its output is still released in order.
+    if (pool->SubmitJob(job) < 0)
+    {
+        Bricli_RunJob(job);
+    }
+    return BricliPending;
+}
+
+/**
+ * @brief Finds the length of the command at the start of the RX buffer without a trailing "&".
+ *
+ * @param cli Pointer to the BriCLI instance to use.
+ *
+ * @return The length of the command without the "&", zero if it is not a background command.
+ */
+static size_t Bricli_BackgroundLength(BricliHandle_t *cli)
+{
+    size_t length = strlen(cli->RxBuffer);
+
+    while (length > 0 && cli->RxBuffer[length - 1] == ' ')
+    {
+        length--;
+    }
+
+    // An escaped "&" is an ordinary argument.
+    if (length < 2 || cli->RxBuffer[length - 1] != '&' || cli->RxBuffer[length - 2] == '\\')
+    {
+        return 0;
+    }
+
+    length--;
+    while (length > 0 && cli->RxBuffer[length - 1] == ' ')
+    {
+        length--;
+    }
+    return length;
+}
+
+/**
+ * @brief Starts the command at the start of the RX buffer as a background job.
+ *
+ * @param cli       Pointer to the BriCLI instance to use.
+ * @param length    The length of the command without the trailing "&".
+ *
+ * @return BricliOk once the job has been handed to the worker pool, an error otherwise.
+ */
+static int Bricli_StartBackground(BricliHandle_t *cli, size_t length)
+{
+    BricliCommand_t *command = Bricli_PeekCommand(cli, cli->RxBuffer);
+    BricliJobPool_t *pool = cli->JobPool;
+    BricliJob_t *job = NULL;
+
+    cli->CommandLength = (uint32_t)strlen(cli->RxBuffer);
+    Bricli_ChangeState(cli, BricliStateParsing);
+
+    if (!Bricli_HasBackgroundJobs(cli) || pool->SubmitJob == NULL || command == NULL ||
+        command->ContextHandler == NULL || length >= BRICLI_JOB_LINE_SIZE)
+    {
+        Bricli_PrintF(cli, "Command cannot run in the background%s", Bricli_GetSendEol(cli));
+        cli->LastError = BricliErrorInternal;
+        return BricliBadCommand;
+    }
+
+    for (uint32_t i = 0; i < pool->BackgroundJobCount && job == NULL; i++)
+    {
+        job = pool->BackgroundJobs[i].IsActive ? NULL : &pool->BackgroundJobs[i];
+    }
+    if (job == NULL)
+    {
+        Bricli_PrintF(cli, "No free job slots%s", Bricli_GetSendEol(cli));
+        cli->LastError = BricliErrorInternal;
+        return BricliBusy;
+    }
+
+    // Background jobs are only stopped by kill, not by a Ctrl-C meant for the foreground.
+    Bricli_PrepareJob(cli, job, cli->RxBuffer, length);
+    job->Shadow.Parent = NULL;
+    job->Command = command;
+    job->StartTick = (cli->GetTick != NULL) ? cli->GetTick() : 0;
+
+    // Zero is never issued so ids always start from one.
+    pool->NextJobId++;
+    if (pool->NextJobId == 0)
+    {
+        pool->NextJobId++;
+    }
+    job->Id = pool->NextJobId;
+
+    // Running inline would block the session, so a pool that cannot take the job is an error.
+    if (pool->SubmitJob(job) < 0)
+    {
+        Bricli_PrintF(cli, "No free job slots%s", Bricli_GetSendEol(cli));
+        cli->LastError = BricliErrorInternal;
+        return BricliBusy;
+    }
+    job->IsActive = true;
+    return Bricli_PrintF(cli, "[%u] %s%s", job->Id, command->Name, Bricli_GetSendEol(cli)) < 0 ? BricliBadFunction : BricliOk;
+}
+
+/**
+ * @brief Moves characters posted by Bricli_PostReceive into the RX buffer, on the owning thread.
+ *
+ * @param cli Pointer to the BriCLI instance to use.
+ */
+static void Bricli_DrainInput(BricliHandle_t *cli)
+{
+    BricliMailbox_t *mailbox = cli->Mailbox;
+    uint32_t head = mailbox->InputHead;
+    uint32_t tail = BRICLI_ATOMIC_LOAD(&mailbox->InputTail);
+
+    // Anything that will not fit is left in the ring for a later parse rather than dropped.
+    while (head != tail && (cli->StreamCommand != NULL || cli->PendingBytes < cli->RxBufferSize))
+    {
+        Bricli_ReceiveCharacter(cli, mailbox->InputRing[head & (mailbox->InputRingSize - 1)]);
+        head++;
+    }
+    BRICLI_ATOMIC_STORE(&mailbox->InputHead, head);
+
+    // A posted Ctrl-C only raises the flag, if nothing was running to see it the partly typed line is dropped here.
+    if (BRICLI_ATOMIC_LOAD(&cli->IsCancelled))
+    {
+        Bricli_Cancel(cli);
+    }
+}
+
+/**
+* @brief Default runner for performing common BriCLI functionality.
+*
+* @param cli Pointer to the CLI instance to use.
+* @return The error code from Bricli_ParseCommand.
+*/
+int Bricli_Parse(BricliHandle_t *cli)
+{
+    size_t numberOfCommands;
+    int result = BricliOk;
+
+    // Input posted by other threads is taken in first.
+    if (cli->Mailbox != NULL && cli->Mailbox->InputRing != NULL && cli->Mailbox->InputRingSize > 0)
+    {
+        Bricli_DrainInput(cli);
+    }
+
+    // Finished worker jobs are released first so their output keeps its place.
+    Bricli_ReleaseJobs(cli);
+
+    // A deferred command that overruns its time budget is completed on its behalf.
+    if (cli->IsPending && Bricli_IsCancelled(cli) && cli->IsTimedOut)
+    {
+        Bricli_Complete(cli, cli->PendingToken, BricliTimedOut);
+    }
+
+    // Paged output from an earlier command has to finish before anything else runs.
+    if (Bricli_ServicePaged(cli))
+    {
+        goto cleanup;
+    }
+
+    // Commands split off alongside one that started paged output are run before anything new.
+    numberOfCommands = cli->SplitCommands;
+    cli->SplitCommands = 0;
+    if (numberOfCommands == 0)
+    {
+        // First do a non-invasive check for an EOL delimeter.
+        if (!Bricli_CheckForEol(cli, false))
+        {
+            goto cleanup;
+        }
+
+        // Edge case: Eol has been sent on it's own
+        // giving us a zero-length command.
+        if (cli->PendingBytes == strlen(Bricli_GetEol(cli)))
+        {
+            if (!cli->IsPending)
+            {
+                Bricli_SendPrompt(cli);
+            }
+            Bricli_ClearBuffer(cli);
+            goto cleanup;
+        }
+
+        // Look for an EOL, repeating for as long as we have commands in the buffer.
+        numberOfCommands = Bricli_SplitOnEol(cli);
+
+        // Nothing but empty lines, treat them like a lone EOL.
+        if (numberOfCommands == 0)
+        {
+            if (!cli->IsPending)
+            {
+                Bricli_SendPrompt(cli);
+            }
+            Bricli_ClearBuffer(cli);
+            goto cleanup;
+        }
+    }
+
+    while(numberOfCommands > 0)
+    {
+        BricliCommand_t *next = Bricli_PeekCommand(cli, cli->RxBuffer);
+        size_t backgroundLength = Bricli_BackgroundLength(cli);
+        bool isOffloaded = (backgroundLength == 0) && Bricli_IsOffloaded(cli, next);
+        uint32_t jobsInFlight = Bricli_JobsInFlight(cli);
+
+        // While a deferred command is pending only concurrent commands may run, the rest keep their order.
+        // Job output is released in order too, so inline commands wait for every job and jobs for a free slot.
+        if ((cli->IsPending && (next == NULL || !(next->Flags & BricliCommandConcurrent))) ||
+            (isOffloaded ? jobsInFlight >= cli->JobPool->JobCount : jobsInFlight > 0))
+        {
+            cli->SplitCommands = (uint32_t)numberOfCommands;
+            goto cleanup;
+        }
+
+        // Handle the command, on a worker if it is offloaded or started in the background.
+        if (isOffloaded)
+        {
+            result = Bricli_SubmitJob(cli);
+        }
+        else if (backgroundLength > 0)
+        {
+            result = Bricli_StartBackground(cli, backgroundLength);
+        }
+        else
+        {
+            result = Bricli_ParseCommand(cli);
+        }
+
+        // Remove the command we just handled
+        Bricli_ClearCommand(cli);
+
+        // Reset our internal state.
+        Bricli_ChangeState(cli, cli->IsPending ? BricliStatePending : BricliStateIdle);
+
+        // Track that we have handled this command.
+        numberOfCommands--;
+
+        // Paged output sends the prompt itself once it finishes, keep any remaining commands until then.
+        if (Bricli_IsPaging(cli))
+        {
+            cli->SplitCommands = (uint32_t)numberOfCommands;
+            if (Bricli_ServicePaged(cli))
+            {
+                goto cleanup;
+            }
+            cli->SplitCommands = 0;
+            continue;
+        }
+
+        // If we just handled the last command send the CLI prompt, deferred commands send it on completion.
+        if (numberOfCommands == 0 && !cli->IsPending && Bricli_JobsInFlight(cli) == 0)
+        {
+            Bricli_SendPrompt(cli);
+        }
+    }
+
+cleanup:
+    // Messages posted by other threads are written between commands, never in the middle of one.
+    Bricli_PublishPosts(cli);
+    return result;
+}
+
+
+/**
+ * @brief Parses the given command against the provided CLI instance.
+ *
+ * @param cli Pointer to a BriCLI instance.
+ * @param data The full command string received including any arguments.
+ *
+ * @return Pass through return from the given command handler.
+ */
+int Bricli_ParseCommand(BricliHandle_t *cli)
+{
+    // Error check our arguments.
+    if (cli->RxBuffer == NULL)
+    {
+        cli->LastError = BricliErrorInternal;
+        return BricliBadParameter;
+    }
+    else if (cli == NULL || Bricli_GetCommandList(cli) == NULL)
+    {
+        cli->LastError = BricliErrorInternal;
+        return BricliBadHandle;
+    }
+
+    // Record the full line length before any arguments are tokenised in place.
+    cli->CommandLength = strlen(cli->RxBuffer);
+
+    return Bricli_ParseLine(cli, cli->RxBuffer);
+}
+
+/**
+ * @brief Reads a background job id from an argument, without relying on libc.
+ *
+ * @param arg   The argument to read.
+ * @param id    Output for the job id.
+ *
+ * @return True if the argument is a plain decimal number that fits in 32 bits.
+ */
+static bool Bricli_ParseJobId(const BricliSpan_t *arg, uint32_t *id)
+{
+    uint32_t value = 0;
+
+    if (arg->Data == NULL || arg->Length == 0)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < arg->Length; i++)
+    {
+        char digit = arg->Data[i];
+
+        if (digit < '0' || digit > '9' || value > (UINT32_MAX - (uint32_t)(digit - '0')) / 10)
+        {
+            return false;
+        }
+        value = (value * 10) + (uint32_t)(digit - '0');
+    }
+
+    *id = value;
+    return true;
+}
+
+/**
+ * @brief Parses and executes a single command line against the provided CLI instance.
+ *
+ * The line is tokenised in place so must be writable and remain valid while its handler runs.
+ *
+ * @param cli   Pointer to a BriCLI instance.
+ * @param line  NUL terminated command line, without an EOL.
+ *
+ * @return Pass through return from the given command handler.
+ */
+int Bricli_ParseLine(BricliHandle_t *cli, char *line)
+{
+    char command[BRICLI_MAX_COMMAND_LEN + 1] = {0};
+    char *arguments = NULL;
+    uint32_t commandLength = 0;
+
+    if (cli == NULL || Bricli_GetCommandList(cli) == NULL)
+    {
+        return BricliBadHandle;
+    }
+    else if (line == NULL)
+    {
+        cli->LastError = BricliErrorInternal;
+        return BricliBadParameter;
+    }
+
+    // Update our state.
+    Bricli_ChangeState(cli, BricliStateParsing);
+
+    // If this is actually an escape sequence handle it separately.
+    if (line[0] == '\e')
+    {
+        return Bricli_ParseEscapeCode(cli);
+    }
+
+    // Look for arguments.
+    char *argData = strchr(line, ' ');
+
+    // Split the command and arguments if needed.
+    if (argData != NULL)
+    {
+        // Calculate length of command and skip the first space in argData.
+        // The arguments are left in the RX buffer and tokenised in place.
+        commandLength = argData - line;
+        arguments = argData + 1;
+    }
+    else
+    {
+        commandLength = strlen(line);
+    }
+
+    // Limit the command length to prevent overflow.
+    if (commandLength > BRICLI_MAX_COMMAND_LEN)
+    {
+        commandLength = BRICLI_MAX_COMMAND_LEN;
+    }
+    memcpy(command, (void *)line, commandLength);
+
+    // Check if this is a system command first.
+    if (strcmp(command, "help") == 0)
+    {
+        BricliSpan_t topic[BRICLI_MAX_ARGUMENTS] = {0};
+        int result = BricliOk;
+
+        // "help <name>" narrows the output to a single command or subtree.
+        Bricli_ChangeState(cli, BricliStateHandlerRunning);
+        if (Bricli_ExtractArguments(arguments, topic) > 0)
+        {
+            result = Bricli_PrintCommandHelp(cli, topic[0].Data);
+            if (result != BricliOk && !Bricli_EmitError(cli, result, "Unknown Command", topic[0].Data))
+            {
+                Bricli_PrintF(cli, "Unknown Command %s%s", topic[0].Data, Bricli_GetSendEol(cli));
+            }
+        }
+        else
+        {
+            Bricli_PrintHelp(cli);
+        }
+        Bricli_ChangeState(cli, BricliStateFinished);
+        return result;
+    }
+    else if (strcmp(command, "clear") == 0)
+    {
+        Bricli_ChangeState(cli, BricliStateHandlerRunning);
+        Bricli_ClearScreen(cli);
+        Bricli_ChangeState(cli, BricliStateFinished);
+        return BricliOk;
+    }
+    else if (Bricli_HasBackgroundJobs(cli) && strcmp(command, "jobs") == 0)
+    {
+        Bricli_ChangeState(cli, BricliStateHandlerRunning);
+        int result = Bricli_ListJobs(cli);
+        Bricli_ChangeState(cli, BricliStateFinished);
+        return result;
+    }
+    else if (Bricli_HasBackgroundJobs(cli) && strcmp(command, "kill") == 0)
+    {
+        BricliSpan_t id[BRICLI_MAX_ARGUMENTS] = {0};
+        int result = BricliBadParameter;
+
+        Bricli_ChangeState(cli, BricliStateHandlerRunning);
+        if (Bricli_ExtractArguments(arguments, id) > 0)
+        {
+            uint32_t jobId = 0;
+            if (Bricli_ParseJobId(&id[0], &jobId))
+            {
+                result = Bricli_KillJob(cli, jobId);
+            }
+        }
+        if (result != BricliOk && !Bricli_EmitError(cli, result, "No such job", NULL))
+        {
+            Bricli_PrintF(cli, "No such job%s", Bricli_GetSendEol(cli));
+        }
+        Bricli_ChangeState(cli, BricliStateFinished);
+        return result;
+    }
+
+    // Not a system command so look to our command list for a match.
+    BricliCommand_t *cliCommand = NULL;
+    for (uint32_t i = 0; i < Bricli_GetCommandListLength(cli); i++)
+    {
+        // Get the next CLI Command reference.
+        cliCommand = &Bricli_GetCommandList(cli)[i];
+
+        // Check if we have found a match.
+        if (strcmp(command, cliCommand->Name) == 0)
+        {
+            return Bricli_RunHandler(cli, cliCommand, arguments);
+        }
+    }
+
+    // If we get here then we failed to find a valid command in the list.
+    if (!Bricli_EmitError(cli, BricliBadCommand, "Unknown Command", command))
+    {
+        Bricli_PrintF(cli, "Unknown Command %s%s", command, Bricli_GetSendEol(cli));
+
+        // If enabled, print help on an unknown command.
+#if BRICLI_SHOW_HELP_ON_ERROR
+        Bricli_PrintHelp(cli);
+#endif // BRICLI_SHOW_HELP_ON_ERROR
+    }
+
+    // Return that this is an unknown command.
+    cli->LastError = BricliErrorInternal;
+    return BricliBadCommand;
+}
+
+/**
+* @brief Checks a given buffer for an occurrence of the EoL string.
+*
+* @param cli        Pointer to the CLI instance to use.
+* @param data       Pointer to the buffer to search.
+* @param replaceEol True to replace the EOL with '\0', false to leave it alone.
+*
+* @return True when an EOL is found, false otherwise.
+*/
+bool Bricli_CheckForEol(BricliHandle_t *cli, bool replaceEol)
+{
+    char *eol = NULL;
+    bool result = false;
+
+    // Make sure our parameters are valid.
+    if (cli == NULL || Bricli_GetEol(cli) == NULL || cli->RxBuffer == NULL || cli->PendingBytes == 0)
+    {
+        goto cleanup;
+    }
+
+    // Look for the EOL substring in our data.
+    eol = strstr(cli->RxBuffer, Bricli_GetEol(cli));
+    if (eol == NULL)
+    {
+        // No EOL found.
+        result = false;
+    }
+    else
+    {
+        // EOL found.
+        result = true;
+
+        // Inject null characters if needed.
+        if (replaceEol)
+        {
+            memset(eol, '\0', strlen(Bricli_GetEol(cli)));
+        }
+    }
+
+cleanup:
+    return result;
+}
+
+/**
+* @brief For the given buffer, searches for all EOL strings and replaces them with null characters.
+*
+* Empty lines are removed from the buffer rather than counted, so they are skipped like a lone EOL.
+*
+* @param cli Pointer to the CLI instance to use.
+*
+* @return The number of commands found in the buffer.
+*/
+size_t Bricli_SplitOnEol(BricliHandle_t *cli)
+{
+    uint16_t numberOfCommands = 0;
+    const char *eol = NULL;
+    size_t eolLength = 0;
+    size_t lineStart = 0;
+    size_t end = 0;
+    size_t i = 0;
+    bool isEolFound = false;
+
+    // Make sure our parameters are valid.
+    if (cli == NULL || Bricli_GetEol(cli) == NULL || cli->RxBuffer == NULL || cli->PendingBytes == 0)
+    {
+        goto cleanup;
+    }
+
+    eol = Bricli_GetEol(cli);
+    eolLength = strlen(eol);
+    if (eolLength == 0)
+    {
+        goto cleanup;
+    }
+
+    // Scan the pending bytes in place, never past the end of the buffer.
+    end = (cli->PendingBytes < cli->RxBufferSize) ? cli->PendingBytes : cli->RxBufferSize;
+    while (i + eolLength <= end)
+    {
+        if (cli->RxBuffer[i] != eol[0] || memcmp(&cli->RxBuffer[i], eol, eolLength) != 0)
+        {
+            i++;
+            continue;
+        }
+
+        isEolFound = true;
+        if (i == lineStart)
+        {
+            // Drop the EOL ending an empty line, the next line then starts where it was.
+            end -= eolLength;
+            cli->PendingBytes -= eolLength;
+            memmove(&cli->RxBuffer[i], &cli->RxBuffer[i + eolLength], end - i);
+            memset(&cli->RxBuffer[end], '\0', eolLength);
+            continue;
+        }
+
+        memset(&cli->RxBuffer[i], '\0', eolLength);
+        numberOfCommands++;
+        lineStart = i + eolLength;
+        i = lineStart;
+    }
+
+    // Text after the last EOL is a command too, as long as at least one EOL was found.
+    if (isEolFound && lineStart < end && cli->RxBuffer[lineStart] != '\0')
+    {
+        numberOfCommands++;
+    }
+
+cleanup:
+    // Return how many commands we found.
+    return numberOfCommands;
+
+}
+
+/**
+ * @brief Places a character into the RX buffer and performs various character checks.
+ *
+ * @param cli Pointer to the CLI instance to use.
+ * @param rxChar The character received.
+ *
+ * @return BricliCopyWouldOverflow if the RX buffer is full, BricliOk otherwise.
+ */
+BricliErrors_t Bricli_ReceiveCharacter(BricliHandle_t *cli, char rxChar)
+{
+    BricliErrors_t result = BricliUnknown;
+
+    // Check for a null terminating character.
+    if (rxChar == '\0')
+    {
+        result = BricliReceivedNull;
+        goto cleanup;
+    }
+
+    // Ctrl-C cancels whatever is running rather than being buffered.
+    if (rxChar == BRICLI_CANCEL_CHAR)
+    {
+        Bricli_Cancel(cli);
+        result = BricliOk;
+        goto cleanup;
+    }
+
+    // At a --More-- prompt the key press only decides whether paged output continues.
+    if (Bricli_IsPaging(cli) && cli->Pager->State == BricliPagePaused)
+    {
+        cli->Pager->State = (rxChar == 'q' || rxChar == 'Q') ? BricliPageQuit : BricliPageContinue;
+        result = BricliOk;
+        goto cleanup;
+    }
+
+    // Streaming commands hand their arguments over in chunks rather than filling the buffer.
+    // Keep room for a terminator so the buffer can still be searched as a string.
+    if (cli->StreamCommand != NULL && (cli->PendingBytes + 1) >= cli->RxBufferSize)
+    {
+        Bricli_DeliverStreamChunk(cli);
+    }
+
+    // Check for an overflow.
+    if (cli->PendingBytes >= cli->RxBufferSize)
+    {
+        result = BricliCopyWouldOverflow;
+        goto cleanup;
+    }
+
+    // Store the received character.
+    cli->RxBuffer[cli->PendingBytes] = rxChar;
+    cli->PendingBytes++;
+
+    // The first space after a streaming command's name starts the stream.
+    if (rxChar == ' ' && cli->StreamCommand == NULL)
+    {
+        Bricli_CheckForStream(cli);
+    }
+
+    // If we are currently in the process of handling an escape code.
+    if (cli->IsHandlingEscape)
+    {
+        Bricli_ParseEscapeCode(cli);
+    }
+
+    // A backslash before the EOL continues the command on the next line.
+    Bricli_JoinContinuation(cli);
+
+    // The EOL ends a stream, the final chunk is delivered when the command is parsed.
+    if (cli->StreamCommand != NULL && Bricli_EndsWithEol(cli) > 0)
+    {
+        cli->StreamCommand = NULL;
+    }
+
+    // If we've received a backspace then we need to remove it and the previous character.
+    if (rxChar == '\b')
+    {
+        Bricli_Backspace(cli);
+        result = BricliOk;
+    }
+
+    // Echo the received character.
+    if (Bricli_IsEchoing(cli))
+    {
+        Bricli_Write(cli, 1, &rxChar);
+    }
+
+    // Make sure echoed and deleted characters reach the terminal straight away.
+    if ((Bricli_IsEchoing(cli) || rxChar == '\b') && cli->TxFlushPolicy != BricliFlushExplicit)
+    {
+        Bricli_Flush(cli);
+    }
+
+    // Success.
+    result = BricliOk;
+
+cleanup:
+    return result;
+}
+
+/**
+ * @brief Iterates through an array of received characters, parsing each in turn.
+ *
+ * @param cli       Pointer to the CLI instance to use.
+ * @param index     The starting character in array to receive from.
+ * @param length    The number of bytes to be received from the array.
+ * @param arrray    Pointer to the array to be received.
+ *
+ * @return BricliCopyWouldOverflow if the RX buffer is full, BricliOk otherwise.
+ */
+BricliErrors_t Bricli_ReceiveIndexedArray(BricliHandle_t *cli, uint32_t index, uint32_t length, char *array)
+{
+    BricliErrors_t error = BricliUnknown;
+
+    // Receive each character in turn.
+    for (uint32_t i = index; i < (index + length); i++)
+    {
+        error = Bricli_ReceiveCharacter(cli, array[i]);
+
+        // If something went wrong, exit immediately.
+        if (error != BricliOk)
+        {
+            return error;
+        }
+    }
+    return error;
+}
+
+/**
+ * @brief Queues received characters for the next Bricli_Parse, from a thread or ISR other than the owner's.
+ *
+ * The instance's InputRing is a single producer, single consumer ring, so only one thread may post
+ * input. Ctrl-C is not queued, it raises the flag seen by Bricli_IsCancelled straight away and, if
+ * nothing is running, the next Bricli_Parse drops the partly typed line.
+ *
+ * @param cli       Pointer to the CLI instance to use.
+ * @param length    The number of characters in data.
+ * @param data      The characters received.
+ *
+ * @return BricliCopyWouldOverflow if data does not fit in the ring, in which case none of it is taken, BricliOk otherwise.
+ */
+BricliErrors_t Bricli_PostReceive(BricliHandle_t *cli, uint32_t length, const char *data)
+{
+    BricliMailbox_t *mailbox = (cli != NULL) ? cli->Mailbox : NULL;
+    uint32_t queued = 0;
+    uint32_t head;
+    uint32_t tail;
+
+    if (mailbox == NULL || mailbox->InputRing == NULL || mailbox->InputRingSize == 0 ||
+        (mailbox->InputRingSize & (mailbox->InputRingSize - 1)) != 0)
+    {
+        return BricliBadHandle;
+    }
+    else if (data == NULL)
+    {
+        return BricliBadParameter;
+    }
+
+    // Check the whole post fits before taking any of it.
+    for (uint32_t i = 0; i < length; i++)
+    {
+        queued += (data[i] != BRICLI_CANCEL_CHAR);
+    }
+    head = BRICLI_ATOMIC_LOAD(&mailbox->InputHead);
+    tail = mailbox->InputTail;
+    if (queued > mailbox->InputRingSize - (tail - head))
+    {
+        return BricliCopyWouldOverflow;
+    }
+
+    for (uint32_t i = 0; i < length; i++)
+    {
+        if (data[i] == BRICLI_CANCEL_CHAR)
+        {
+            BRICLI_ATOMIC_STORE(&cli->IsCancelled, true);
+            continue;
+        }
+        mailbox->InputRing[tail & (mailbox->InputRingSize - 1)] = data[i];
+        tail++;
+    }
+
+    BRICLI_ATOMIC_STORE(&mailbox->InputTail, tail);
+    return BricliOk;
+}
+
+/**
+ * @brief Queues a message to be written as a whole line, safe to call from any number of threads.
+ *
+ * Messages are held in the instance's Posts queue, a bounded lock-free queue, until the owning
+ * thread writes them out between commands. A message is never split by other output, and is
+ * given a line of its own.
+ *
+ * @param cli       Pointer to the CLI instance to use.
+ * @param length    The number of characters in data, at most BRICLI_POST_SIZE.
+ * @param data      The message.
+ *
+ * @return BricliOk once queued, BricliBusy if the queue is full or BricliCopyWouldOverflow if the message is too long.
+ */
+int Bricli_PostWrite(BricliHandle_t *cli, uint32_t length, const char *data)
+{
+    BricliMailbox_t *mailbox = (cli != NULL) ? cli->Mailbox : NULL;
+    BricliPost_t *post = NULL;
+    uint32_t position;
+    uint32_t index;
+
+    if (mailbox == NULL || mailbox->Posts == NULL || mailbox->PostCount == 0 || (mailbox->PostCount & (mailbox->PostCount - 1)) != 0)
+    {
+        return BricliBadHandle;
+    }
+    else if (data == NULL)
+    {
+        return BricliBadParameter;
+    }
+    else if (length > BRICLI_POST_SIZE)
+    {
+        return BricliCopyWouldOverflow;
+    }
+
+    // Claim the next slot, a slot is free for a position once its sequence has caught up with it.
+    position = BRICLI_ATOMIC_LOAD(&mailbox->PostTail);
+    while (true)
+    {
+        index = position & (mailbox->PostCount - 1);
+        post = &mailbox->Posts[index];
+        int32_t distance = (int32_t)(BRICLI_ATOMIC_LOAD(&post->Sequence) + index - position);
+
+        if (distance == 0)
+        {
+            if (BRICLI_ATOMIC_CAS(&mailbox->PostTail, &position, position + 1))
+            {
+                break;
+            }
+        }
+        else if (distance < 0)
+        {
+            return BricliBusy;
+        }
+        else
+        {
+            position = BRICLI_ATOMIC_LOAD(&mailbox->PostTail);
+        }
+    }
+
+    memcpy(post->Data, data, length);
+    post->Length = length;
+    BRICLI_ATOMIC_STORE(&post->Sequence, position + 1 - index);
+    return BricliOk;
+}
+
+/**
+ * @brief Formats a message and queues it with Bricli_PostWrite, safe to call from any number of threads.
+ *
+ * @param cli       Pointer to the CLI instance to use.
+ * @param format    The printf style format string.
+ *
+ * @return As Bricli_PostWrite. Messages longer than BRICLI_POST_SIZE are truncated and BricliCopyWouldOverflow returned.
+ */
+int Bricli_PostF(BricliHandle_t *cli, const char *format, ...)
+{
+    char message[BRICLI_POST_SIZE + 1];
+    int length;
+    int result;
+
+    va_list args;
+    va_start(args, format);
+    length = vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    if (length < 0)
+    {
+        return BricliBadParameter;
+    }
+
+    result = Bricli_PostWrite(cli, (length > BRICLI_POST_SIZE) ? BRICLI_POST_SIZE : (uint32_t)length, message);
+    return (result == BricliOk && length > BRICLI_POST_SIZE) ? BricliCopyWouldOverflow : result;
+}
+
+/**
+ * @brief Writes out messages posted by other threads, must be called from the owning thread.
+ *
+ * Bricli_Parse calls this once it has run the commands it was given. If the prompt was showing
+ * it is sent again after the messages, along with any partly typed line when LocalEcho is on.
+ *
+ * @param cli Pointer to the CLI instance to use.
+ *
+ * @return The number of messages written.
+ */
+int Bricli_PublishPosts(BricliHandle_t *cli)
+{
+    BricliMailbox_t *mailbox = (cli != NULL) ? cli->Mailbox : NULL;
+    const char *sendEol;
+    bool wasMidLine;
+    int published = 0;
+
+    if (mailbox == NULL || mailbox->Posts == NULL || mailbox->PostCount == 0 || cli->Capture != NULL)
+    {
+        return 0;
+    }
+
+    sendEol = Bricli_GetSendEol(cli);
+    wasMidLine = cli->IsMidLine;
+    while (true)
+    {
+        uint32_t index = mailbox->PostHead & (mailbox->PostCount - 1);
+        BricliPost_t *post = &mailbox->Posts[index];
+
+        if ((BRICLI_ATOMIC_LOAD(&post->Sequence) + index) != (mailbox->PostHead + 1))
+        {
+            break;
+        }
+
+        // Each message gets a line of its own.
+        if (cli->IsMidLine)
+        {
+            Bricli_WriteString(cli, sendEol);
+        }
+        Bricli_Write(cli, post->Length, post->Data);
+        if (cli->IsMidLine)
+        {
+            Bricli_WriteString(cli, sendEol);
+        }
+
+        // Hand the slot back to the producers for its next lap of the queue.
+        BRICLI_ATOMIC_STORE(&post->Sequence, mailbox->PostHead + mailbox->PostCount - index);
+        mailbox->PostHead++;
+        published++;
+    }
+
+    if (published == 0)
+    {
+        return 0;
+    }
+
+    // Restore the prompt and whatever had been typed after it.
+    if (wasMidLine && cli->RxBuffer != NULL && cli->State == BricliStateIdle && !cli->IsPending && cli->SplitCommands == 0 &&
+        Bricli_JobsInFlight(cli) == 0 && !Bricli_IsPaging(cli) && !Bricli_CheckForEol(cli, false))
+    {
+        Bricli_SendPrompt(cli);
+        if (Bricli_IsEchoing(cli) && cli->PendingBytes > 0)
+        {
+            Bricli_Write(cli, cli->PendingBytes, cli->RxBuffer);
+        }
+    }
+
+    if (cli->TxFlushPolicy != BricliFlushExplicit)
+    {
+        Bricli_Flush(cli);
+    }
+    return published;
+}
+
+/**
+  * @brief Updates the pending bytes count and transmits a VT100 backspace response.
+  * @param cli Pointer to the CLI instance to use.
+  */
+void Bricli_Backspace(BricliHandle_t *cli)
+{   
+    
+    // If there is less than 2 bytes in the buffer there is nothing to be deleted.
+    if (cli->PendingBytes < 2)
+    {
+        cli->PendingBytes = 0;
+    }
+    // If there is more than 2 bytes we must tell the VT100 terminal to delete a character.
+    else
+    {
+        // Move the pending bytes value back by two characters and ensure the backsapce is nulled.
+        cli->PendingBytes -= 2;
+        cli->RxBuffer[cli->PendingBytes + 1] = '\0';
+
+        // Send the backspace and the VT100 delete.
+        if (!Bricli_IsMachineOutput(cli))
+        {
+            Bricli_Write(cli, 1, "\b");
+            Bricli_Write(cli, 3, BRICLI_DELETE_CHAR);
+        }
+    }
+
+    // Deleting back into the command name cancels a stream.
+    if (cli->StreamCommand != NULL && cli->PendingBytes < cli->StreamOffset)
+    {
+        cli->StreamCommand = NULL;
+    }
+}
+
+/**
+ * @brief The help line for one of the system commands.
+ */
+typedef struct _BricliBuiltin_t
+{
+    const char *HelpLine;           // Name and description, as shown by help.
+    bool NeedsBackgroundJobs;       // True if the command only exists with a background job pool.
+} BricliBuiltin_t;
+
+// System commands, listed by help ahead of the user commands.
+static const BricliBuiltin_t _builtins[] =
+{
+    { "help - Displays this help message", false },
+    { "clear - Clears the terminal", false },
+    { "jobs - Lists background jobs", true },
+    { "kill - Cancels a background job", true }
+};
+
+/**
+ * @brief Checks whether a system command is available on an instance.
+ *
+ * @param cli       Pointer to a BriCLI instance.
+ * @param builtin   Pointer to the system command to check.
+ *
+ * @return True if the command should be listed by help.
+ */
+static bool Bricli_HasBuiltin(BricliHandle_t *cli, const BricliBuiltin_t *builtin)
+{
+    return !builtin->NeedsBackgroundJobs || Bricli_HasBackgroundJobs(cli);
+}
+
+/**
+ * @brief Appends one line of help text to the help cache.
+ *
+ * @param cache         Pointer to the help cache being rendered.
+ * @param length        Pointer to the length rendered so far, updated on success.
+ * @param name          The command name, or its whole help line.
+ * @param helpMessage   The command's description, NULL for none.
+ * @param sendEol       The EOL to end the line with.
+ *
+ * @return True on success, false if the line does not fit.
+ */
+static bool Bricli_AppendHelpLine(BricliHelpCache_t *cache, uint32_t *length, const char *name, const char *helpMessage,
+                                  const char *sendEol)
+{
+    uint32_t nameLength = (uint32_t)strlen(name);
+    uint32_t helpLength = (helpMessage == NULL) ? 0 : (uint32_t)strlen(helpMessage);
+    uint32_t eolLength = (uint32_t)strlen(sendEol);
+    uint32_t lineLength = nameLength + ((helpMessage == NULL) ? 0 : helpLength + 3) + eolLength;
+    char *line = &cache->Buffer[*length];
+
+    if (lineLength > cache->Size - *length)
+    {
+        return false;
+    }
+
+    memcpy(line, name, nameLength);
+    line += nameLength;
+    if (helpMessage != NULL)
+    {
+        memcpy(line, " - ", 3);
+        memcpy(line + 3, helpMessage, helpLength);
+        line += helpLength + 3;
+    }
+    memcpy(line, sendEol, eolLength);
+    *length += lineLength;
+    return true;
+}
+
+/**
+ * @brief Renders the full help text into the instance's help cache.
+ *
+ * The rendered text is reused by Bricli_PrintHelp until the command list or its length changes,
+ * or Bricli_InvalidateHelp is called.
+ *
+ * @param cli Pointer to a BriCLI instance.
+ *
+ * @return BricliOk on success, BricliBadParameter without a help cache, BricliCopyWouldOverflow if its buffer is too small.
+ */
+int Bricli_BuildHelp(BricliHandle_t *cli)
+{
+    BricliHelpCache_t *cache = cli->HelpCache;
+    const char *sendEol = Bricli_GetSendEol(cli);
+    uint32_t length = 0;
+
+    Bricli_InvalidateHelp(cli);
+    if (cache == NULL || cache->Buffer == NULL || cache->Size == 0)
+    {
+        return BricliBadParameter;
+    }
+
+    // System commands first, followed by each user command in list order.
+    for (uint32_t i = 0; i < BRICLI_STATIC_ARRAY_SIZE(_builtins); i++)
+    {
+        if (Bricli_HasBuiltin(cli, &_builtins[i]) && !Bricli_AppendHelpLine(cache, &length, _builtins[i].HelpLine, NULL, sendEol))
+        {
+            return BricliCopyWouldOverflow;
+        }
+    }
+
+    for (uint32_t i = 0; i < Bricli_GetCommandListLength(cli); i++)
+    {
+        const BricliCommand_t *command = &Bricli_GetCommandList(cli)[i];
+
+        if (!Bricli_AppendHelpLine(cache, &length, command->Name, command->HelpMessage, sendEol))
+        {
+            return BricliCopyWouldOverflow;
+        }
+    }
+
+    cache->Length = length;
+    cache->CommandList = Bricli_GetCommandList(cli);
+    cache->CommandListLength = Bricli_GetCommandListLength(cli);
+    return BricliOk;
+}
+
+/**
+ * @brief Discards any rendered help text so it is rebuilt on next use.
+ *
+ * Only needed when commands are edited in place, swapping the command list or changing its
+ * length is detected automatically.
+ *
+ * @param cli Pointer to a BriCLI instance.
+ */
+void Bricli_InvalidateHelp(BricliHandle_t *cli)
+{
+    if (cli->HelpCache != NULL)
+    {
+        cli->HelpCache->Length = 0;
+        cli->HelpCache->CommandList = NULL;
+        cli->HelpCache->CommandListLength = 0;
+    }
+}
+
+/**
+ * @brief Sends the help line for a single user command.
+ *
+ * @param cli       Pointer to a BriCLI instance.
+ * @param command   Pointer to the command to describe.
+ *
+ * @return The error code from the instance's BSP write.
+ */
+static int Bricli_PrintCommandLine(BricliHandle_t *cli, const BricliCommand_t *command)
+{
+    if (command->HelpMessage == NULL)
+    {
+        return Bricli_PrintF(cli, "%s%s", command->Name, Bricli_GetSendEol(cli));
+    }
+    return Bricli_PrintF(cli, "%s - %s%s", command->Name, command->HelpMessage, Bricli_GetSendEol(cli));
+}
+
+/**
+  * @brief Sends the help message for all commands.
+  *
+  * When a help cache has been provided the text is rendered once and sent as a single write,
+  * otherwise, or if the buffer is too small, each command is sent separately.
+  *
+  * @param cli Pointer to a BriCLI instance.
+  *
+  * @return The error code from the instance's BSP write.
+  */
+int Bricli_PrintHelp(BricliHandle_t *cli)
+{
+    BricliHelpCache_t *cache = cli->HelpCache;
+
+    // Use the rendered help text when available, rebuilding it if the command list has changed.
+    if (cache != NULL && cache->Buffer != NULL)
+    {
+        if (cache->Length == 0 || cache->CommandList != Bricli_GetCommandList(cli) ||
+            cache->CommandListLength != Bricli_GetCommandListLength(cli))
+        {
+            Bricli_BuildHelp(cli);
+        }
+
+        if (cache->Length > 0)
+        {
+            return Bricli_Write(cli, cache->Length, cache->Buffer);
+        }
+    }
+
+    // Print the system commands first.
+    for (uint32_t i = 0; i < BRICLI_STATIC_ARRAY_SIZE(_builtins); i++)
+    {
+        if (Bricli_HasBuiltin(cli, &_builtins[i]))
+        {
+            Bricli_WriteStringLine(cli, _builtins[i].HelpLine);
+        }
+    }
+
+    // Print the user commands.
+    for (uint32_t i = 0; i < Bricli_GetCommandListLength(cli); i++)
+    {
+        Bricli_PrintCommandLine(cli, &Bricli_GetCommandList(cli)[i]);
+    }
+    return 0;
+}
+
+/**
+ * @brief Sends the help message for every user command matching the given name or subtree.
+ *
+ * An exact command name shows help for that command alone, a subtree shows every command whose
+ * name continues with BRICLI_SUBTREE_SEPARATOR, e.g. "led" for "led_on" and "led_off" but not "ledger".
+ *
+ * @param cli       Pointer to a BriCLI instance.
+ * @param prefix    Command name or subtree to match.
+ *
+ * @return BricliOk if at least one command matched, BricliBadCommand otherwise.
+ */
+int Bricli_PrintCommandHelp(BricliHandle_t *cli, const char *prefix)
+{
+    size_t prefixLength = strlen(prefix);
+    int result = BricliBadCommand;
+
+    for (uint32_t i = 0; i < Bricli_GetCommandListLength(cli); i++)
+    {
+        const char *name = Bricli_GetCommandList(cli)[i].Name;
+
+        // Only whole words match, the name must end or continue into the subtree after the prefix.
+        if (strncmp(name, prefix, prefixLength) == 0 &&
+            (name[prefixLength] == '\0' || name[prefixLength] == ' ' || name[prefixLength] == BRICLI_SUBTREE_SEPARATOR))
+        {
+            Bricli_PrintCommandLine(cli, &Bricli_GetCommandList(cli)[i]);
+            result = BricliOk;
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Sends a formatted message through a CLI instance using a variadic argument list.
+ *
+ * The message is formatted in chunks of BRICLI_PRINT_MESSAGE_SIZE bytes, each written out as it
+ * fills, so messages of any length can be sent using a fixed amount of stack. Messages which fit
+ * within a single chunk are sent with a single write. Strings and padding are never limited, but a
+ * single numeric conversion that could need a whole chunk, such as "%.100f", is left out.
+ *
+ * @param cli Pointer to a BriCLI instance.
+ * @param format Format string to be used for message generation.
+ * @param args Variadic argument list for the format string.
+ *
+ * @return The first error from the instance's BSP write, otherwise the result of the last write.
+ *         BricliCopyWouldOverflow if a numeric conversion was left out.
+ */
+int Bricli_VPrintF(BricliHandle_t *cli, const char *format, va_list args)
+{
+    BricliFormatter_t formatter;
+    va_list argsCopy;
+
+    formatter.Cli = cli;
+    formatter.Used = 0;
+    formatter.Total = 0;
+    formatter.Result = BricliOk;
+
+    // Copy the list so it can be safely passed around by pointer.
+    va_copy(argsCopy, args);
+    while (*format != '\0')
+    {
+        const char *conversion = strchr(format, '%');
+        if (conversion == NULL)
+        {
+            Bricli_FormatterPut(&formatter, format, (uint32_t)strlen(format));
+            break;
+        }
+
+        Bricli_FormatterPut(&formatter, format, (uint32_t)(conversion - format));
+        format = Bricli_FormatConversion(&formatter, conversion, &argsCopy);
+    }
+    va_end(argsCopy);
+
+    Bricli_FormatterFlush(&formatter);
+    return formatter.Result;
+}
+
+/**
+ * @brief Helper function for sending formatted messages through a CLI instance.
+ *
+ * @param cli Pointer to a BriCLI instance.
+ * @param format Format string to be used for message generation.
+ *
+ * @return The first error from the instance's BSP write, otherwise the result of the last write.
+ */
+int Bricli_PrintF(BricliHandle_t *cli, const char *format, ...)
+{
+    int result;
+
+    va_list args;
+    va_start(args, format);
+    result = Bricli_VPrintF(cli, format, args);
+    va_end(args);
+
+    return result;
+}
+
+/**
+ * @brief Tokenises the next argument of the running command on demand.
+ *
+ * Intended for commands flagged with BricliCommandLazyArguments, which are passed no arguments
+ * up front. Only the text up to the returned argument is tokenised, the rest is left untouched.
+ *
+ * @param cli Pointer to a BriCLI instance.
+ * @param arg Pointer to the span to store the next argument in.
+ *
+ * @return True if an argument was found, false once the arguments are exhausted or malformed.
+ */
+bool Bricli_NextArg(BricliHandle_t *cli, BricliSpan_t *arg)
+{
+    if (cli == NULL || arg == NULL || cli->ArgumentCursor == NULL)
+    {
+        return false;
+    }
+
+    return Bricli_NextToken(&cli->ArgumentCursor, arg);
+}
+
+/**
+ * @brief Decodes a hex argument in place, an optional "0x" prefix is skipped.
+ *
+ * The decoded bytes overwrite the start of the argument text so no second buffer is needed,
+ * the argument string is no longer valid text afterwards.
+ *
+ * @param argument  Pointer to the NUL terminated argument to decode.
+ * @param blob      Pointer to store the resulting view of the decoded data in.
+ *
+ * @return BricliBadParameter if the argument is not valid hex, BricliOk otherwise.
+ */
+BricliErrors_t Bricli_DecodeHex(char *argument, BricliBlob_t *blob)
+{
+    uint8_t *output = (uint8_t *)argument;
+    uint32_t decoded = 0;
+    uint32_t pairs = 0;
+    size_t length = 0;
+
+    if (argument == NULL || blob == NULL)
+    {
+        return BricliBadParameter;
+    }
+
+    // Skip the optional prefix.
+    if (argument[0] == '0' && (argument[1] == 'x' || argument[1] == 'X'))
+    {
+        argument += 2;
+    }
+
+    // Every byte needs exactly two characters.
+    length = strlen(argument);
+    if ((length % 2) != 0)
+    {
+        return BricliBadParameter;
+    }
+    pairs = length / 2;
+
+#if BRICLI_HEX_USE_SSE2
+    decoded = Bricli_DecodeHexSse2(argument, output, pairs);
+#endif // BRICLI_HEX_USE_SSE2
+
+    // Decode whatever is left a pair at a time.
+    for (; decoded < pairs; decoded++)
+    {
+        int high = Bricli_HexValue(argument[decoded * 2]);
+        int low = Bricli_HexValue(argument[(decoded * 2) + 1]);
+        if (high < 0 || low < 0)
+        {
+            return BricliBadParameter;
+        }
+        output[decoded] = (uint8_t)((high << 4) | low);
+    }
+
+    blob->Data = output;
+    blob->Length = decoded;
+    return BricliOk;
+}
+
+/**
+ * @brief Decodes a base64 argument in place, trailing padding is optional.
+ *
+ * The decoded bytes overwrite the start of the argument text so no second buffer is needed,
+ * the argument string is no longer valid text afterwards.
+ *
+ * @param argument  Pointer to the NUL terminated argument to decode.
+ * @param blob      Pointer to store the resulting view of the decoded data in.
+ *
+ * @return BricliBadParameter if the argument is not valid base64, BricliOk otherwise.
+ */
+BricliErrors_t Bricli_DecodeBase64(char *argument, BricliBlob_t *blob)
+{
+    uint8_t *output = (uint8_t *)argument;
+    uint32_t accumulator = 0;
+    uint32_t bitsHeld = 0;
+    uint32_t decoded = 0;
+    size_t length = 0;
+
+    if (argument == NULL || blob == NULL)
+    {
+        return BricliBadParameter;
+    }
+
+    // Strip up to two padding characters.
+    length = strlen(argument);
+    for (int i = 0; i < 2 && length > 0 && argument[length - 1] == '='; i++)
+    {
+        length--;
+    }
+
+    // A single trailing character can never hold a full byte.
+    if ((length % 4) == 1)
+    {
+        return BricliBadParameter;
+    }
+
+    // Write position always trails the read position so decoding in place is safe.
+    for (size_t i = 0; i < length; i++)
+    {
+        int value = Bricli_Base64Value(argument[i]);
+        if (value < 0)
+        {
+            return BricliBadParameter;
+        }
+
+        accumulator = (accumulator << 6) | (uint32_t)value;
+        bitsHeld += 6;
+        if (bitsHeld >= 8)
+        {
+            bitsHeld -= 8;
+            output[decoded++] = (uint8_t)(accumulator >> bitsHeld);
+        }
+    }
+
+    blob->Data = output;
+    blob->Length = decoded;
+    return BricliOk;
+}
+
+/**
+ * @brief Queues data in the TX buffer of a non-blocking instance, never waiting on the transport.
+ *
+ * @param cli       Pointer to a BriCLI instance.
+ * @param length    The number of characters in the buffer to be sent.
+ * @param data      Pointer to the buffer to be sent.
+ *
+ * @return BricliOk, BricliCopyWouldOverflow if none of the data could be queued, or a transport error.
+ *         Data larger than the TX buffer that the transport only partly takes returns the number of
+ *         characters sent or queued, the rest can be written again after Bricli_OnTxComplete.
+ */
+static int Bricli_QueueWrite(BricliHandle_t *cli, uint32_t length, const char *data)
+{
+    uint32_t queued = cli->TxPending - cli->TxHead;
+    uint32_t accepted = 0;
+
+    // Try to make room by handing queued data to the transport.
+    if ((queued + length) > cli->TxBufferSize)
+    {
+        int result = Bricli_Flush(cli);
+        if (result < 0)
+        {
+            return result;
+        }
+        queued = cli->TxPending - cli->TxHead;
+    }
+
+    // Too large to ever queue, so offer it straight to an idle transport.
+    if (length > cli->TxBufferSize && queued == 0 && !cli->IsTxBusy)
+    {
+        int sent = Bricli_TransportWrite(cli, length, data);
+        if (sent < 0)
+        {
+            return sent;
+        }
+        if ((uint32_t)sent >= length)
+        {
+            return BricliOk;
+        }
+
+        // Queue as much of the rest as fits, the caller is told where the accepted data ends.
+        cli->IsTxBusy = true;
+        accepted = (uint32_t)sent;
+        data += accepted;
+        length -= accepted;
+        if (length > cli->TxBufferSize)
+        {
+            memcpy(cli->TxBuffer, data, cli->TxBufferSize);
+            cli->TxHead = 0;
+            cli->TxPending = cli->TxBufferSize;
+            return (int)(accepted + cli->TxBufferSize);
+        }
+    }
+
+    if ((queued + length) > cli->TxBufferSize)
+    {
+        return BricliCopyWouldOverflow;
+    }
+
+    // Move the unsent data back to the start of the buffer when the end is full.
+    if ((cli->TxPending + length) > cli->TxBufferSize)
+    {
+        memmove(cli->TxBuffer, &cli->TxBuffer[cli->TxHead], queued);
+        cli->TxHead = 0;
+        cli->TxPending = queued;
+    }
+
+    memcpy(&cli->TxBuffer[cli->TxPending], data, length);
+    cli->TxPending += length;
+    return BricliOk;
+}
+
+/**
+ * @brief Appends data to the TX buffer, flushing it first if the data will not fit.
+ *
+ * Data larger than the whole TX buffer is written straight through once the buffer has been flushed.
+ * In non-blocking mode data that cannot be queued is refused and BricliCopyWouldOverflow returned,
+ * unless the transport took part of it, in which case the number of characters accepted is returned.
+ *
+ * @param cli       Pointer to a BriCLI instance.
+ * @param length    The number of characters in the buffer to be sent.
+ * @param data      Pointer to the buffer to be sent.
+ *
+ * @return An error code, negative indicates a problem occurred.
+ */
+int Bricli_BufferWrite(BricliHandle_t *cli, uint32_t length, const char *data)
+{
+    int result = BricliOk;
+
+    if (cli == NULL || cli->TxBuffer == NULL || !Bricli_HasTransport(cli))
+    {
+        return BricliBadHandle;
+    }
+
+    if (cli->NonBlockingTx)
+    {
+        return Bricli_QueueWrite(cli, length, data);
+    }
+
+    // Make room for the new data.
+    if ((cli->TxPending + length) > cli->TxBufferSize)
+    {
+        result = Bricli_Flush(cli);
+
+        // Too large to ever buffer, so send it as is.
+        if (length > cli->TxBufferSize)
+        {
+            return Bricli_TransportWrite(cli, length, data);
+        }
+    }
+
+    memcpy(&cli->TxBuffer[cli->TxPending], data, length);
+    cli->TxPending += length;
+    return result;
+}
+
+/**
+ * @brief Sends everything waiting in the TX buffer with a single BspWrite call.
+ *
+ * In non-blocking mode this only offers the queued data to the transport. Nothing is sent while
+ * the transport is busy, and whatever it does not accept stays queued for Bricli_OnTxComplete.
+ *
+ * @param cli Pointer to a BriCLI instance.
+ *
+ * @return The error code from the instance's BSP write, BricliOk if there was nothing to send.
+ */
+int Bricli_Flush(BricliHandle_t *cli)
+{
+    int result = BricliOk;
+
+    if (cli == NULL || !Bricli_HasTransport(cli))
+    {
+        return BricliBadHandle;
+    }
+
+    if (cli->NonBlockingTx)
+    {
+        uint32_t queued = cli->TxPending - cli->TxHead;
+
+        if (cli->TxBuffer == NULL || cli->IsTxBusy || queued == 0)
+        {
+            return BricliOk;
+        }
+
+        result = Bricli_TransportWrite(cli, queued, &cli->TxBuffer[cli->TxHead]);
+        if (result < 0)
+        {
+            return result;
+        }
+
+        // Anything not accepted waits for the transport to report it has room again.
+        if ((uint32_t)result >= queued)
+        {
+            cli->TxHead = 0;
+            cli->TxPending = 0;
+        }
+        else
+        {
+            cli->TxHead += (uint32_t)result;
+            cli->IsTxBusy = true;
+        }
+        return BricliOk;
+    }
+
+    if (cli->TxBuffer != NULL && cli->TxPending > 0)
+    {
+        result = Bricli_TransportWrite(cli, cli->TxPending, cli->TxBuffer);
+        cli->TxPending = 0;
+    }
+    return result;
+}
+
+/**
+ * @brief Notifies a non-blocking instance that its transport can accept data again.
+ *
+ * Should be called by the transport once a previously partial or refused write has completed,
+ * any data still queued is then offered to it. Must not be called at the same time as other
+ * BriCLI functions for the same instance, from an interrupt set a flag and call it from the
+ * main loop instead.
+ *
+ * @param cli Pointer to a BriCLI instance.
+ *
+ * @return The error code from the instance's BSP write, BricliOk if there was nothing to send.
+ */
+int Bricli_OnTxComplete(BricliHandle_t *cli)
+{
+    if (cli == NULL)
+    {
+        return BricliBadHandle;
+    }
+
+    cli->IsTxBusy = false;
+    int result = Bricli_Flush(cli);
+
+    // Paged output is pulled as the transport drains.
+    Bricli_ServicePaged(cli);
+    return result;
+}
+
+/**
+ * @brief Defers completion of the running command, for handlers waiting on slow operations.
+ *
+ * The prompt, error reporting and any further commands are held until Bricli_Complete is called
+ * with the returned token, characters keep being buffered in the meantime. Arguments are only
+ * valid during the handler call so anything needed later must be copied.
+ *
+ * @param cli   Pointer to a BriCLI instance.
+ * @param token Returns the token to pass to Bricli_Complete.
+ *
+ * @return BricliPending to be returned by the handler, or an error if the command cannot be deferred.
+ */
+int Bricli_Defer(BricliHandle_t *cli, uint32_t *token)
+{
+    if (cli == NULL || token == NULL)
+    {
+        return BricliBadHandle;
+    }
+    // Only one command can be pending, and captured output has nowhere to go once the handler returns.
+    else if (cli->IsPending || cli->Capture != NULL || cli->State != BricliStateHandlerRunning)
+    {
+        return BricliBadCommand;
+    }
+
+    // Zero is never issued so it can be used as an invalid token.
+    cli->PendingToken++;
+    if (cli->PendingToken == 0)
+    {
+        cli->PendingToken++;
+    }
+    cli->IsPending = true;
+    *token = cli->PendingToken;
+    return BricliPending;
+}
+
+/**
+ * @brief Completes a deferred command, reporting its result and sending the prompt.
+ *
+ * Commands received while the command was pending are run by the next call to Bricli_Parse.
+ *
+ * @param cli       Pointer to a BriCLI instance.
+ * @param token     The token returned by Bricli_Defer.
+ * @param result    The command's result, reported as though the handler had returned it.
+ *
+ * @return BricliOk, or BricliBadParameter if the token does not match the pending command.
+ */
+int Bricli_Complete(BricliHandle_t *cli, uint32_t token, int result)
+{
+    if (cli == NULL)
+    {
+        return BricliBadHandle;
+    }
+    else if (!cli->IsPending || token != cli->PendingToken)
+    {
+        return BricliBadParameter;
+    }
+
+    cli->IsPending = false;
+    cli->HasDeadline = false;
+    BRICLI_ATOMIC_STORE(&cli->IsCancelled, false);
+    Bricli_ChangeState(cli, BricliStateFinished);
+    Bricli_ReportResult(cli, result);
+    Bricli_ChangeState(cli, BricliStateIdle);
+
+    // The prompt follows whichever command is last, so leave it to Bricli_Parse if more are waiting.
+    if (cli->SplitCommands == 0 && !Bricli_CheckForEol(cli, false))
+    {
+        Bricli_SendPrompt(cli);
+    }
+    return BricliOk;
+}
+
+/**
+ * @brief Runs a command line against an instance with its output going into a capture.
+ *
+ * @param cli       Pointer to a BriCLI instance.
+ * @param line      NUL terminated command line, without an EOL. It is tokenised in place.
+ * @param capture   Pointer to the capture to fill, IsTruncated is set if output was dropped.
+ *
+ * @return Pass through return from the command handler.
+ */
+static int Bricli_CaptureLine(BricliHandle_t *cli, char *line, BricliCapture_t *capture)
+{
+    int result;
+
+    // Save everything a nested command could disturb.
+    BricliCapture_t *savedCapture = cli->Capture;
+    BricliColourState_t savedColour = cli->ColourState;
+    bool savedDeferred = cli->IsColourDeferred;
+    char *savedCursor = cli->ArgumentCursor;
+    BricliStates_t savedState = cli->State;
+
+    capture->IsNested = (savedState == BricliStateHandlerRunning);
+    cli->Capture = capture;
+    memset(&cli->ColourState, 0, sizeof(cli->ColourState));
+    cli->IsColourDeferred = false;
+
+    result = Bricli_ParseLine(cli, line);
+    Bricli_SetColour(cli, BricliColourReset);
+
+    cli->Capture = savedCapture;
+    cli->ColourState = savedColour;
+    cli->IsColourDeferred = savedDeferred;
+    cli->ArgumentCursor = savedCursor;
+    Bricli_ChangeState(cli, savedState);
+
+    return result;
+}
+
+/**
+ * @brief Runs a worker job, intended to be called from the application's worker threads.
+ *
+ * The handler runs against the job's shadow instance so it never touches the parent instance,
+ * the job is published to Bricli_ReleaseJobs once its output and result are final. Each job is
+ * run once, by whichever thread claims it first.
+ *
+ * @param job The job handed to the instance's SubmitJob function.
+ *
+ * @return The command's result, or BricliBusy if the job was already claimed by another thread.
+ */
+int Bricli_RunJob(BricliJob_t *job)
+{
+    BricliCapture_t capture = { NULL, BRICLI_JOB_OUTPUT_SIZE, 0, false, false };
+    int result;
+
+    if (job == NULL)
+    {
+        return BricliBadParameter;
+    }
+    else if (BRICLI_ATOMIC_EXCHANGE(&job->IsClaimed, true))
+    {
+        return BricliBusy;
+    }
+
+    capture.Buffer = job->Output;
+    result = Bricli_CaptureLine(&job->Shadow, job->Line, &capture);
+    if (capture.IsTruncated && result >= 0)
+    {
+        result = BricliCopyWouldOverflow;
+    }
+    job->Result = result;
+    job->OutputLength = capture.Length;
+    job->IsTruncated = capture.IsTruncated;
+
+    // The slot may be reused as soon as it is published, so it is not touched again.
+    BRICLI_ATOMIC_STORE(&job->IsDone, true);
+    return result;
+}
+
+/**
+ * @brief Writes out a finished job's output, marking where any output that did not fit was dropped.
+ *
+ * @param cli Pointer to a BriCLI instance.
+ * @param job The finished job.
+ */
+static void Bricli_WriteJobOutput(BricliHandle_t *cli, BricliJob_t *job)
+{
+    // Errors were already displayed into the job's output by the worker.
+    Bricli_Write(cli, job->OutputLength, job->Output);
+    if (job->IsTruncated && !Bricli_EmitError(cli, BricliCopyWouldOverflow, "Output truncated", (job->Command != NULL) ? job->Command->Name : NULL))
+    {
+        if (cli->IsMidLine)
+        {
+            Bricli_WriteString(cli, Bricli_GetSendEol(cli));
+        }
+        BRICLI_PRINTF_COLOURED(cli, BricliTextRed, "Output truncated%s", Bricli_GetSendEol(cli));
+    }
+    if (job->Result < 0)
+    {
+        cli->LastError = BricliErrorCommand;
+    }
+}
+
+/**
+ * @brief Writes out the output of the finished job at the head of the instance's job ring.
+ *
+ * @param cli Pointer to a BriCLI instance.
+ * @param job The job at the head of the ring, it must be done.
+ */
+static void Bricli_ReleaseJob(BricliHandle_t *cli, BricliJob_t *job)
+{
+    Bricli_WriteJobOutput(cli, job);
+    if (cli->TxFlushPolicy == BricliFlushAfterHandler)
+    {
+        Bricli_Flush(cli);
+    }
+    cli->JobPool->JobHead++;
+}
+
+/**
+ * @brief Writes out the output of finished worker jobs, in the order the commands were received.
+ *
+ * Must be called from the thread that owns the instance, Bricli_Parse calls this itself.
+ *
+ * @param cli Pointer to a BriCLI instance.
+ *
+ * @return The number of jobs released.
+ */
+int Bricli_ReleaseJobs(BricliHandle_t *cli)
+{
+    int released = 0;
+
+    if (cli == NULL)
+    {
+        return 0;
+    }
+
+    // A job still running holds back everything submitted after it.
+    while (Bricli_JobsInFlight(cli) != 0)
+    {
+        BricliJob_t *job = &cli->JobPool->Jobs[cli->JobPool->JobHead % cli->JobPool->JobCount];
+
+        if (!BRICLI_ATOMIC_LOAD(&job->IsDone))
+        {
+            break;
+        }
+
+        Bricli_ReleaseJob(cli, job);
+        released++;
+    }
+
+    // Background jobs finish in any order and are announced as they do.
+    for (uint32_t i = 0; Bricli_HasBackgroundJobs(cli) && i < cli->JobPool->BackgroundJobCount; i++)
+    {
+        BricliJob_t *job = &cli->JobPool->BackgroundJobs[i];
+
+        if (job->IsActive && BRICLI_ATOMIC_LOAD(&job->IsDone))
+        {
+            Bricli_PrintF(cli, "[%u] Done %s%s", job->Id, job->Command->Name, Bricli_GetSendEol(cli));
+            Bricli_WriteJobOutput(cli, job);
+            job->IsActive = false;
+            released++;
+        }
+    }
+
+    // A cancellation applies to every job that was in flight, so it ends with the last of them.
+    if (released > 0 && Bricli_JobsInFlight(cli) == 0 && !cli->IsPending)
+    {
+        BRICLI_ATOMIC_STORE(&cli->IsCancelled, false);
+    }
+
+    // The prompt follows whichever command is last, so leave it to Bricli_Parse if more are waiting.
+    if (released > 0 && Bricli_JobsInFlight(cli) == 0 && !cli->IsPending && cli->SplitCommands == 0 &&
+        !Bricli_CheckForEol(cli, false))
+    {
+        Bricli_SendPrompt(cli);
+    }
+    return released;
+}
+
+/**
+ * @brief Drops the characters received after the last complete line, keeping any complete lines.
+ *
+ * @param cli Pointer to the BriCLI instance to use.
+ */
+static void Bricli_DiscardPartialLine(BricliHandle_t *cli)
+{
+    size_t eolLength = strlen(Bricli_GetEol(cli));
+    size_t keep = cli->PendingBytes;
+
+    // Walk back to the end of the last EOL, if there is one.
+    while (keep >= eolLength && eolLength > 0 &&
+           memcmp(&cli->RxBuffer[keep - eolLength], Bricli_GetEol(cli), eolLength) != 0)
+    {
+        keep--;
+    }
+
+    if (keep < eolLength || eolLength == 0)
+    {
+        Bricli_ClearBuffer(cli);
+    }
+    else
+    {
+        memset(&cli->RxBuffer[keep], 0, cli->PendingBytes - keep);
+        cli->PendingBytes = keep;
+    }
+}
+
+/**
+ * @brief Requests cancellation of whatever the instance is running, as Ctrl-C does.
+ *
+ * Running, pending and worker handlers see the request through Bricli_IsCancelled, paged output
+ * stops at its next page and a partly typed line is discarded when nothing is running. Complete
+ * lines received before the request are kept and run as normal.
+ *
+ * @param cli Pointer to a BriCLI instance.
+ */
+void Bricli_Cancel(BricliHandle_t *cli)
+{
+    if (cli == NULL)
+    {
+        return;
+    }
+
+    BRICLI_ATOMIC_STORE(&cli->IsCancelled, true);
+
+    if (Bricli_IsPaging(cli))
+    {
+        cli->Pager->State = BricliPageQuit;
+    }
+    // Only touch the buffer and transport when no handler can be using them.
+    else if (cli->State == BricliStateIdle && !cli->IsPending && Bricli_JobsInFlight(cli) == 0 &&
+             cli->SplitCommands == 0)
+    {
+        Bricli_DiscardPartialLine(cli);
+        BRICLI_ATOMIC_STORE(&cli->IsCancelled, false);
+        if (!Bricli_IsMachineOutput(cli))
+        {
+            Bricli_WriteString(cli, "^C");
+            Bricli_WriteString(cli, Bricli_GetSendEol(cli));
+        }
+
+        // Commands still waiting to be parsed send the prompt once they have run.
+        if (cli->PendingBytes == 0)
+        {
+            Bricli_SendPrompt(cli);
+        }
+    }
+}
+
+/**
+ * @brief Checks whether the running command should stop, polled by long running handlers.
+ *
+ * @param cli Pointer to the instance passed to the handler.
+ *
+ * @return True once the command has been cancelled or has overrun its time budget.
+ */
+bool Bricli_IsCancelled(BricliHandle_t *cli)
+{
+    if (cli == NULL)
+    {
+        return false;
+    }
+
+    // Wrapping ticks are handled by comparing the signed difference.
+    if (cli->HasDeadline && !cli->IsTimedOut && (int32_t)(cli->GetTick() - cli->Deadline) >= 0)
+    {
+        cli->IsTimedOut = true;
+    }
+
+    // Worker job shadows also follow the instance they were created from.
+    return cli->IsTimedOut || BRICLI_ATOMIC_LOAD(&cli->IsCancelled) ||
+           (cli->Parent != NULL && BRICLI_ATOMIC_LOAD(&cli->Parent->IsCancelled));
+}
+
+/**
+ * @brief Lists the background jobs that have not been released yet, used by the built-in jobs command.
+ *
+ * @param cli Pointer to a BriCLI instance.
+ *
+ * @return BricliOk, or BricliBadParameter if the instance has no background job pool.
+ */
+int Bricli_ListJobs(BricliHandle_t *cli)
+{
+    if (cli == NULL || !Bricli_HasBackgroundJobs(cli))
     {
-        commandLength = strlen(cli->RxBuffer);
+        return BricliBadParameter;
     }
 
-    // Limit the command length to prevent overflow.
-    if (commandLength > BRICLI_MAX_COMMAND_LEN)
+    for (uint32_t i = 0; i < cli->JobPool->BackgroundJobCount; i++)
     {
-        commandLength = BRICLI_MAX_COMMAND_LEN;
+        BricliJob_t *job = &cli->JobPool->BackgroundJobs[i];
+        const char *status;
+
+        if (!job->IsActive)
+        {
+            continue;
+        }
+
+        status = BRICLI_ATOMIC_LOAD(&job->IsDone) ? "Done" : "Running";
+        if (cli->GetTick != NULL)
+        {
+            Bricli_PrintF(cli, "[%u] %-7s %8ums %s%s", job->Id, status, cli->GetTick() - job->StartTick,
+                          job->Command->Name, Bricli_GetSendEol(cli));
+        }
+        else
+        {
+            Bricli_PrintF(cli, "[%u] %-7s %s%s", job->Id, status, job->Command->Name, Bricli_GetSendEol(cli));
+        }
     }
-    memcpy(command, (void *)cli->RxBuffer, commandLength);
+    return BricliOk;
+}
 
-    // Check if this is a system command first.
-    if (strcmp(command, "help") == 0)
+/**
+ * @brief Requests cancellation of a background job, used by the built-in kill command.
+ *
+ * The job's handler sees the request through Bricli_IsCancelled and is released as normal once it returns.
+ *
+ * @param cli   Pointer to a BriCLI instance.
+ * @param id    The job's id, as listed by the jobs command.
+ *
+ * @return BricliOk, or BricliBadParameter if no running job has the id.
+ */
+int Bricli_KillJob(BricliHandle_t *cli, uint32_t id)
+{
+    if (cli == NULL || !Bricli_HasBackgroundJobs(cli))
     {
-        Bricli_ChangeState(cli, BricliStateHandlerRunning);
-        Bricli_PrintHelp(cli);
-        Bricli_ChangeState(cli, BricliStateFinished);
-        return BricliOk;
+        return BricliBadParameter;
     }
-    else if (strcmp(command, "clear") == 0)
+
+    for (uint32_t i = 0; i < cli->JobPool->BackgroundJobCount; i++)
     {
-        Bricli_ChangeState(cli, BricliStateHandlerRunning);
-        Bricli_ClearScreen(cli);
-        Bricli_ChangeState(cli, BricliStateFinished);
-        return BricliOk;
+        BricliJob_t *job = &cli->JobPool->BackgroundJobs[i];
+
+        if (job->IsActive && job->Id == id)
+        {
+            BRICLI_ATOMIC_STORE(&job->Shadow.IsCancelled, true);
+            return BricliOk;
+        }
     }
+    return BricliBadParameter;
+}
 
-    // Not a system command so look to our command list for a match.
-    BricliCommand_t *cliCommand = NULL;
-    for (uint8_t i = 0; i < cli->CommandListLength; i++)
+/**
+ * @brief Finishes paged output, sending the prompt unless further commands are waiting to run.
+ *
+ * @param cli Pointer to a BriCLI instance.
+ */
+static void Bricli_EndPaged(BricliHandle_t *cli)
+{
+    cli->Pager->Producer = NULL;
+    cli->Pager->Context = NULL;
+    cli->Pager->Held = 0;
+    cli->Pager->State = BricliPageRunning;
+    Bricli_ChangeState(cli, BricliStateIdle);
+
+    if (cli->SplitCommands == 0)
     {
-        // Get the next CLI Command reference.
-        cliCommand = &cli->CommandList[i];
+        Bricli_SendPrompt(cli);
+    }
+}
 
-        // Check if we have found a match.
-        if (strcmp(command, cliCommand->Name) == 0)
+/**
+ * @brief Starts paged output from within a command handler.
+ *
+ * Rather than writing everything at once, the producer is called to fill the free space in
+ * the TX buffer each time the transport has taken what was already produced. Peak memory use is
+ * therefore the TX buffer regardless of the output size. When the pager's Lines is set output pauses
+ * at a --More-- prompt every Lines lines, any key continues and 'q' stops the output.
+ *
+ * The prompt, and any further commands, wait until the producer returns 0 or paging is stopped.
+ * With a page length set the producer is offered the TX buffer less room for the --More-- prompt,
+ * so output past the end of a page can be held back in the buffer until a key is pressed.
+ *
+ * @param cli       Pointer to a BriCLI instance, a pager and a TX buffer are required.
+ * @param producer  Callback that generates the output.
+ * @param context   Pointer passed to every call of the producer.
+ *
+ * @return BricliOk on success, BricliBadParameter if there is no producer, pager or TX buffer.
+ */
+int Bricli_StartPaged(BricliHandle_t *cli, Bricli_PageProducer producer, void *context)
+{
+    if (cli == NULL)
+    {
+        return BricliBadHandle;
+    }
+    else if (producer == NULL || cli->Pager == NULL || cli->TxBuffer == NULL || cli->Capture != NULL)
+    {
+        return BricliBadParameter;
+    }
+
+    // Paged output is written straight into the TX buffer, so finish with any deferred colour first.
+    if (cli->IsColourDeferred)
+    {
+        Bricli_SetColour(cli, BricliColourReset);
+    }
+
+    cli->Pager->Producer = producer;
+    cli->Pager->Context = context;
+    cli->Pager->LineCount = 0;
+    cli->Pager->Held = 0;
+    cli->Pager->State = BricliPageRunning;
+    return BricliOk;
+}
+
+/**
+ * @brief Pauses paged output at the end of a page, if the output waiting in the TX buffer reaches one.
+ *
+ * Only the output up to and including the Lines-th EOL is sent. Anything after it is moved to the
+ * end of the TX buffer and held there until a key is pressed, and the --More-- prompt is queued in
+ * the room Bricli_ServicePaged kept free.
+ *
+ * @param cli Pointer to a BriCLI instance.
+ *
+ * @return True if the output was paused.
+ */
+static bool Bricli_PageBreak(BricliHandle_t *cli)
+{
+    BricliPager_t *pager = cli->Pager;
+    const char *sendEol = Bricli_GetSendEol(cli);
+    char lineEnd = sendEol[strlen(sendEol) - 1];
+
+    if (pager->Lines == 0 || cli->TxBufferSize <= strlen(BRICLI_MORE_PROMPT))
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < cli->TxPending; i++)
+    {
+        if (cli->TxBuffer[i] != lineEnd || ++pager->LineCount < pager->Lines)
         {
-            char *ArgumentsFound[BRICLI_MAX_ARGUMENTS] = {0};
+            continue;
+        }
+
+        uint32_t pageEnd = i + 1;
+        pager->Held = cli->TxPending - pageEnd;
+        memmove(&cli->TxBuffer[cli->TxBufferSize - pager->Held], &cli->TxBuffer[pageEnd], pager->Held);
+        cli->TxPending = pageEnd;
+        pager->LineCount = 0;
+        pager->State = BricliPagePaused;
+        Bricli_WriteRaw(cli, strlen(BRICLI_MORE_PROMPT), BRICLI_MORE_PROMPT);
+        Bricli_Flush(cli);
+        return true;
+    }
+    return false;
+}
 
-            // Extract additional arguments.
-            uint8_t numberOfArguments = Bricli_ExtractArguments(arguments, ArgumentsFound);
+/**
+ * @brief Pulls more paged output for as long as the transport keeps up.
+ *
+ * Called automatically by Bricli_Parse and Bricli_OnTxComplete.
+ *
+ * @param cli Pointer to a BriCLI instance.
+ *
+ * @return True while paged output is still in progress.
+ */
+bool Bricli_ServicePaged(BricliHandle_t *cli)
+{
+    uint32_t capacity;
 
-            // Call the command's handler function.
-            Bricli_ChangeState(cli, BricliStateHandlerRunning);
-            int result = cliCommand->Handler(numberOfArguments, ArgumentsFound);
-            Bricli_ChangeState(cli, BricliStateFinished);
+    if (cli == NULL || !Bricli_IsPaging(cli))
+    {
+        return false;
+    }
+    else if (cli->Pager->State == BricliPagePaused)
+    {
+        return true;
+    }
+    else if (cli->State != BricliStatePaging)
+    {
+        Bricli_ChangeState(cli, BricliStatePaging);
+    }
 
-            // Check the result code.
-            if (result < 0)
+    // Remove the --More-- prompt once a key has been pressed and the prompt has been sent.
+    if (cli->Pager->State != BricliPageRunning)
+    {
+        if (cli->TxPending > 0)
+        {
+            Bricli_Flush(cli);
+            if (cli->TxPending > 0)
             {
-                // If enabled, display the error code to the user.
-#if BRICLI_SHOW_COMMAND_ERRORS
-                if (cli->SendEol == NULL)
-                {
-                    BRICLI_PRINTF_COLOURED(cli, BricliTextRed, "Command returned error: %d%s", result, cli->Eol);
-                }
-                else
-                {
-                    BRICLI_PRINTF_COLOURED(cli, BricliTextRed, "Command returned error: %d%s", result, cli->SendEol);
-                }
-#endif // BRICLI_SHOW_COMMAND_ERRORS
+                return true;
+            }
+        }
+        Bricli_WriteRaw(cli, 1, "\r");
+        Bricli_WriteRaw(cli, strlen(BRICLI_DELETE_CHAR), BRICLI_DELETE_CHAR);
+        if (cli->Pager->State == BricliPageQuit)
+        {
+            Bricli_EndPaged(cli);
+            return false;
+        }
+        cli->Pager->State = BricliPageRunning;
+    }
+
+    // Keep room for the --More-- prompt, which is also longer than the sequence clearing it, behind held output.
+    capacity = cli->TxBufferSize;
+    if (cli->Pager->Lines > 0 && capacity > strlen(BRICLI_MORE_PROMPT))
+    {
+        capacity -= (uint32_t)strlen(BRICLI_MORE_PROMPT);
+    }
+
+    while (true)
+    {
+        // Only produce more once the transport has taken everything already produced.
+        if (cli->TxPending > 0)
+        {
+            Bricli_Flush(cli);
+            if (cli->TxPending > 0)
+            {
+                return true;
+            }
+        }
 
-                cli->LastError = BricliErrorCommand;
+        // Output held back at the last pause starts the next page, before anything new is produced.
+        if (cli->Pager->Held > 0)
+        {
+            memmove(cli->TxBuffer, &cli->TxBuffer[cli->TxBufferSize - cli->Pager->Held], cli->Pager->Held);
+            cli->TxPending = cli->Pager->Held;
+            cli->Pager->Held = 0;
+        }
+        else
+        {
+            int32_t produced = cli->Pager->Producer(cli->Pager->Context, cli->TxBuffer, capacity);
+            if (produced <= 0)
+            {
+                Bricli_EndPaged(cli);
+                return false;
             }
-            return result;
+            cli->TxPending = ((uint32_t)produced < capacity) ? (uint32_t)produced : capacity;
+        }
+
+        if (Bricli_PageBreak(cli))
+        {
+            return true;
         }
     }
+}
 
-    // If we get here then we failed to find a valid command in the list.
-    if (cli->SendEol == NULL)
+/**
+ * @brief Appends output to the capture buffer of an instance running Bricli_ExecuteCaptured.
+ *
+ * Output that does not fit is truncated, the remainder of the buffer is still filled.
+ *
+ * @param cli       Pointer to a BriCLI instance.
+ * @param length    The number of characters in the buffer to be captured.
+ * @param data      Pointer to the buffer to be captured.
+ *
+ * @return BricliOk, or BricliCopyWouldOverflow if the output was truncated.
+ */
+int Bricli_CaptureWrite(BricliHandle_t *cli, uint32_t length, const char *data)
+{
+    BricliCapture_t *capture = cli->Capture;
+    uint32_t space = capture->Size - capture->Length;
+    uint32_t copyLength = (length < space) ? length : space;
+
+    memcpy(&capture->Buffer[capture->Length], data, copyLength);
+    capture->Length += copyLength;
+    if (copyLength < length)
+    {
+        capture->IsTruncated = true;
+        return BricliCopyWouldOverflow;
+    }
+    return BricliOk;
+}
+
+/**
+ * @brief Runs a command line with its output captured into a caller supplied buffer.
+ *
+ * Output is copied straight into the buffer rather than going through the TX buffer or BspWrite,
+ * and no prompt is sent. Any colour left active by the command is reset within the captured
+ * output. Calls may be nested, e.g. from within a command handler, in which case the nested
+ * command shares the calling command's cancellation and time budget.
+ *
+ * @param cli       Pointer to a BriCLI instance.
+ * @param line      NUL terminated command line, without an EOL. It is tokenised in place.
+ * @param buffer    Buffer to capture the output into. NUL terminated when there is room.
+ * @param capacity  Size of the buffer.
+ * @param captured  Optional output for the number of characters captured.
+ *
+ * @return Pass through return from the command handler, or BricliCopyWouldOverflow if the
+ *         command succeeded but its output was truncated.
+ */
+int Bricli_ExecuteCaptured(BricliHandle_t *cli, char *line, char *buffer, uint32_t capacity, uint32_t *captured)
+{
+    BricliCapture_t capture = { buffer, capacity, 0, false, false };
+    int result;
+
+    if (cli == NULL)
+    {
+        return BricliBadHandle;
+    }
+    else if (line == NULL || buffer == NULL)
+    {
+        return BricliBadParameter;
+    }
+
+    result = Bricli_CaptureLine(cli, line, &capture);
+
+    if (capture.IsTruncated && result >= 0)
+    {
+        result = BricliCopyWouldOverflow;
+    }
+    if (capture.Length < capacity)
+    {
+        buffer[capture.Length] = '\0';
+    }
+    if (captured != NULL)
+    {
+        *captured = capture.Length;
+    }
+    return result;
+}
+
+/**
+ * @brief Waits for the batch job at the head of the job ring and writes out its output.
+ *
+ * A job no worker has started yet is run by the calling thread rather than waiting idle. While a
+ * worker finishes the head job, the calling thread takes on the jobs queued behind it that no
+ * worker has claimed, so it only ever waits once every job in flight is running somewhere. That
+ * wait goes through the pool's WaitJob hook when one is set.
+ *
+ * @param cli Pointer to a BriCLI instance.
+ *
+ * @return The job's result.
+ */
+static int Bricli_ReleaseBatchJob(BricliHandle_t *cli)
+{
+    BricliJobPool_t *pool = cli->JobPool;
+    BricliJob_t *job = &pool->Jobs[pool->JobHead % pool->JobCount];
+    uint32_t next = pool->JobHead + 1;
+
+    Bricli_RunJob(job);
+    while (!BRICLI_ATOMIC_LOAD(&job->IsDone))
+    {
+        // Another thread claimed the job first, run the next unclaimed job while it finishes.
+        // Jobs already claimed by a worker return straight away.
+        if (next != pool->JobTail)
+        {
+            Bricli_RunJob(&pool->Jobs[next % pool->JobCount]);
+            next++;
+        }
+        else if (pool->WaitJob != NULL)
+        {
+            pool->WaitJob();
+        }
+    }
+
+    Bricli_ReleaseJob(cli, job);
+    return job->Result;
+}
+
+/**
+ * @brief Runs a script of command lines, running independent commands in parallel on the job pool.
+ *
+ * Commands flagged BricliCommandIndependent are handed to worker jobs, one per free slot. Any other
+ * command waits for every job ahead of it and then runs inline. Output is written in script order
+ * whatever order the jobs finish in. Must be called from the thread that owns the instance while
+ * no other worker jobs are in flight.
+ *
+ * @param cli       Pointer to a BriCLI instance.
+ * @param script    NUL terminated command lines separated by the instance's EOL, modified in place.
+ *
+ * @return BricliOk if every command succeeded, otherwise the first error in script order.
+ *         A command that defers stops the batch, leaving the rest of the script unrun.
+ */
+int Bricli_ExecuteBatch(BricliHandle_t *cli, char *script)
+{
+    BricliJobPool_t *pool = NULL;
+    char *line = script;
+    const char *eol;
+    size_t eolLength;
+    int result = BricliOk;
+
+    if (cli == NULL || Bricli_GetCommandList(cli) == NULL)
+    {
+        return BricliBadHandle;
+    }
+    else if (script == NULL)
+    {
+        return BricliBadParameter;
+    }
+    else if (cli->IsPending || Bricli_JobsInFlight(cli) != 0)
+    {
+        return BricliBusy;
+    }
+
+    eol = Bricli_GetEol(cli);
+    eolLength = strlen(eol);
+    pool = cli->JobPool;
+
+    // Save what a batch run from within a command handler could disturb.
+    char *savedCursor = cli->ArgumentCursor;
+    BricliStates_t savedState = cli->State;
+
+    while (line != NULL && *line != '\0' && !cli->IsPending)
+    {
+        char *end = (eolLength > 0) ? strstr(line, eol) : NULL;
+        char *next = NULL;
+        BricliCommand_t *command = NULL;
+        size_t length = 0;
+        int lineResult = BricliOk;
+
+        if (Bricli_IsCancelled(cli))
+        {
+            result = (result < 0) ? result : BricliCancelled;
+            break;
+        }
+
+        if (end != NULL)
+        {
+            *end = '\0';
+            next = end + eolLength;
+        }
+        length = strlen(line);
+        command = Bricli_PeekCommand(cli, line);
+
+        if (length == 0)
+        {
+            // Blank lines are skipped.
+        }
+        else if (pool != NULL && pool->Jobs != NULL && pool->JobCount > 0 && command != NULL &&
+                 (command->Flags & BricliCommandIndependent) && command->ContextHandler != NULL &&
+                 length < BRICLI_JOB_LINE_SIZE)
+        {
+            BricliJob_t *job = NULL;
+
+            // A full ring makes room by releasing its oldest job.
+            if (pool->JobTail - pool->JobHead >= pool->JobCount)
+            {
+                lineResult = Bricli_ReleaseBatchJob(cli);
+            }
+
+            job = &pool->Jobs[pool->JobTail % pool->JobCount];
+            Bricli_PrepareJob(cli, job, line, length);
+            pool->JobTail++;
+
+            // Jobs the pool does not take are run here once they reach the head of the ring.
+            if (pool->SubmitJob != NULL)
+            {
+                pool->SubmitJob(job);
+            }
+        }
+        else
+        {
+            // Anything else may depend on the commands before it, so they all finish first.
+            while (Bricli_JobsInFlight(cli) != 0)
+            {
+                int jobResult = Bricli_ReleaseBatchJob(cli);
+                lineResult = (lineResult < 0) ? lineResult : jobResult;
+            }
+
+            int commandResult = Bricli_ParseLine(cli, line);
+            lineResult = (lineResult < 0) ? lineResult : commandResult;
+        }
+
+        result = (result < 0) ? result : lineResult;
+        line = next;
+    }
+
+    while (Bricli_JobsInFlight(cli) != 0)
+    {
+        int jobResult = Bricli_ReleaseBatchJob(cli);
+        result = (result < 0) ? result : jobResult;
+    }
+
+    // A cancellation applies to the whole batch, so it ends with it.
+    if (!cli->IsPending)
+    {
+        BRICLI_ATOMIC_STORE(&cli->IsCancelled, false);
+    }
+
+    cli->ArgumentCursor = savedCursor;
+    Bricli_ChangeState(cli, cli->IsPending ? BricliStatePending : savedState);
+
+    return result;
+}
+
+/**
+ * @brief Writes several pieces of data in order, as a single transaction where possible.
+ *
+ * Any colour left active by an earlier coloured write is reset first.
+ *
+ * @param cli       Pointer to a BriCLI instance.
+ * @param vectors   Array of data pieces to be written.
+ * @param count     The number of entries in vectors.
+ *
+ * @return An error code, negative indicates a problem occurred.
+ */
+int Bricli_WriteV(BricliHandle_t *cli, const BricliIoVec_t *vectors, uint32_t count)
+{
+    if (cli != NULL && cli->IsColourDeferred)
     {
-        Bricli_PrintF(cli, "Unknown Command %s%s", command, cli->Eol);
+        Bricli_SetColour(cli, BricliColourReset);
     }
-    else
+    return Bricli_WriteVRaw(cli, vectors, count);
+}
+
+/**
+ * @brief Writes data in a colour, optionally followed by the send EOL.
+ *
+ * The colour code is only sent when the terminal is not already in that colour, and the reset
+ * is deferred until uncoloured output follows, so runs of same coloured output share one code.
+ *
+ * @param cli       Pointer to a BriCLI instance.
+ * @param length    The number of characters in the buffer to be sent.
+ * @param data      Pointer to the buffer to be sent.
+ * @param colour    The colour to be used.
+ * @param appendEol True to send the EOL after the data.
+ *
+ * @return An error code, negative indicates a problem occurred.
+ */
+int Bricli_WriteColouredSegments(BricliHandle_t *cli, uint32_t length, const char *data, BricliColours_t colour, bool appendEol)
+{
+    BricliIoVec_t segments[3];
+    uint32_t count = Bricli_SelectColour(cli, colour, segments);
+
+    segments[count].Data = data;
+    segments[count++].Length = length;
+
+    if (appendEol)
     {
-        Bricli_PrintF(cli, "Unknown Command %s%s", command, cli->SendEol);
+        const char *sendEol = Bricli_GetSendEol(cli);
+        segments[count].Data = sendEol;
+        segments[count++].Length = (uint32_t)strlen(sendEol);
     }
 
-    // If enabled, print help on an unknown command.
-#if BRICLI_SHOW_HELP_ON_ERROR
-    Bricli_PrintHelp(cli);
-#endif // BRICLI_SHOW_HELP_ON_ERROR
-
-    // Return that this is an unknown command.
-    cli->LastError = BricliErrorInternal;
-    return BricliBadCommand;
+    Bricli_ReleaseColour(cli);
+    return Bricli_WriteVRaw(cli, segments, count);
 }
 
 /**
-* @brief Checks a given buffer for an occurrence of the EoL string.
-*
-* @param cli        Pointer to the CLI instance to use.
-* @param data       Pointer to the buffer to search.
-* @param replaceEol True to replace the EOL with '\0', false to leave it alone.
-*
-* @return True when an EOL is found, false otherwise.
-*/
-bool Bricli_CheckForEol(BricliHandle_t *cli, bool replaceEol)
+ * @brief Keeps the first error from a sequence of writes.
+ *
+ * @param result    The result so far.
+ * @param next      The result of the latest write.
+ *
+ * @return The first negative result, otherwise next.
+ */
+static int Bricli_FirstError(int result, int next)
 {
-    char *eol = NULL;
-    bool result = false;
+    return (result < 0) ? result : next;
+}
 
-    // Make sure our parameters are valid.
-    if (cli == NULL || cli->Eol == NULL || cli->RxBuffer == NULL || cli->PendingBytes == 0)
-    {
-        goto cleanup;
-    }
+/**
+ * @brief Writes a CBOR initial byte and argument, using the shortest encoding.
+ *
+ * @param cli       Pointer to a BriCLI instance.
+ * @param major     The CBOR major type, 0 to 7.
+ * @param argument  The argument, e.g. the value of an integer or the length of a string.
+ *
+ * @return An error code, negative indicates a problem occurred.
+ */
+static int Bricli_CborHead(BricliHandle_t *cli, uint8_t major, uint64_t argument)
+{
+    char head[9];
+    uint32_t length = 1;
+    uint32_t argumentBytes = 0;
 
-    // Look for the EOL substring in our data.
-    eol = strstr(cli->RxBuffer, cli->Eol);
-    if (eol == NULL)
+    if (argument < 24)
     {
-        // No EOL found.
-        result = false;
+        head[0] = (char)((major << 5) | (uint8_t)argument);
     }
     else
     {
-        // EOL found.
-        result = true;
+        argumentBytes = (argument <= 0xFF) ? 1 : (argument <= 0xFFFF) ? 2 : (argument <= 0xFFFFFFFF) ? 4 : 8;
+        head[0] = (char)((major << 5) | ((argumentBytes == 1) ? 24 : (argumentBytes == 2) ? 25 : (argumentBytes == 4) ? 26 : 27));
 
-        // Inject null characters if needed.
-        if (replaceEol)
+        // Arguments are big endian.
+        for (uint32_t i = argumentBytes; i > 0; i--)
         {
-            memset(eol, '\0', strlen(cli->Eol));
+            head[length++] = (char)(argument >> ((i - 1) * 8));
         }
     }
-
-cleanup:
-    return result;
+    return Bricli_Write(cli, length, head);
 }
 
 /**
-* @brief For the given buffer, searches for all EOL strings and replaces them with null characters.
-*
-* @param cli Pointer to the CLI instance to use.
-*
-* @return The number of commands found in the buffer.
-*/
-size_t Bricli_SplitOnEol(BricliHandle_t *cli)
+ * @brief Writes a string as a quoted JSON string, escaping it as needed.
+ *
+ * Runs of characters that need no escaping are written straight from the string.
+ *
+ * @param cli   Pointer to a BriCLI instance.
+ * @param text  The string to write.
+ *
+ * @return An error code, negative indicates a problem occurred.
+ */
+static int Bricli_JsonString(BricliHandle_t *cli, const char *text)
 {
-    uint16_t numberOfCommands = 0;
-    char *token = NULL;
-    #if BRICLI_USE_REENTRANT
-        char *lastToken = NULL;
-    #endif // BRICLI_USE_REENTRANT
+    static const char hexDigits[] = "0123456789abcdef";
+    const char *run = text;
+    int result = Bricli_Write(cli, 1, "\"");
 
-    // Make sure our parameters are valid.
-    if (cli == NULL || cli->Eol == NULL || cli->RxBuffer == NULL || cli->PendingBytes == 0)
+    for (; *text != '\0'; text++)
     {
-        goto cleanup;
+        unsigned char character = (unsigned char)*text;
+        char escape[6] = {'\\', 0};
+        uint32_t escapeLength = 2;
+
+        if (character == '"' || character == '\\')
+        {
+            escape[1] = (char)character;
+        }
+        else if (character == '\n')
+        {
+            escape[1] = 'n';
+        }
+        else if (character == '\r')
+        {
+            escape[1] = 'r';
+        }
+        else if (character == '\t')
+        {
+            escape[1] = 't';
+        }
+        else if (character < 0x20)
+        {
+            memcpy(escape, "\\u00", 4);
+            escape[4] = hexDigits[character >> 4];
+            escape[5] = hexDigits[character & 0x0F];
+            escapeLength = 6;
+        }
+        else
+        {
+            continue;
+        }
+
+        if (text > run)
+        {
+            result = Bricli_FirstError(result, Bricli_Write(cli, (uint32_t)(text - run), run));
+        }
+        result = Bricli_FirstError(result, Bricli_Write(cli, escapeLength, escape));
+        run = text + 1;
     }
 
-    // Iterate over the buffer looking for EOLs.
-    #if BRICLI_USE_REENTRANT
-        token = (char *)strtok_r(cli->RxBuffer, cli->Eol, &lastToken);
-    #else
-        token = (char *)strtok(cli->RxBuffer, cli->Eol);
-    #endif // BRICLI_USE_REENTRANT
-    
-    while (token != NULL)
+    if (text > run)
     {
-        // Increment the number of commands and get the next token.
-        numberOfCommands++;
-        #if BRICLI_USE_REENTRANT
-            token = (char *)strtok_r(NULL, cli->Eol, &lastToken);
-        #else
-            token = (char *)strtok(NULL, cli->Eol);
-        #endif // BRICLI_USE_REENTRANT
+        result = Bricli_FirstError(result, Bricli_Write(cli, (uint32_t)(text - run), run));
     }
+    return Bricli_FirstError(result, Bricli_Write(cli, 1, "\""));
+}
+
+/**
+ * @brief Writes the key of an emitted field, along with any separator the output mode needs.
+ *
+ * @param cli   Pointer to a BriCLI instance.
+ * @param key   The field's key, must not be NULL.
+ *
+ * @return An error code, negative indicates a problem occurred.
+ */
+static int Bricli_EmitKey(BricliHandle_t *cli, const char *key)
+{
+    int result = BricliOk;
+    uint32_t keyLength = (uint32_t)strlen(key);
 
-    // Edge case: If no delimiters were present the length of the buffer will match pending bytes exactly.
-    // In this case an EOL was not found and the numberOfCommands is actually off by one.
-    if (numberOfCommands == 1 && strlen(cli->RxBuffer) == cli->PendingBytes)
+    switch (Bricli_GetOutputMode(cli))
     {
-        numberOfCommands--;
-    }
+        case BricliOutputJsonLines:
+            if (cli->Emitter->Count > 0)
+            {
+                result = Bricli_Write(cli, 1, ",");
+            }
+            result = Bricli_FirstError(result, Bricli_JsonString(cli, key));
+            result = Bricli_FirstError(result, Bricli_Write(cli, 1, ":"));
+            break;
 
+        case BricliOutputCbor:
+            result = Bricli_CborHead(cli, 3, keyLength);
+            result = Bricli_FirstError(result, Bricli_Write(cli, keyLength, key));
+            break;
 
-cleanup:
-    // Return how many commands we found.
-    return numberOfCommands;
+        default:
+            result = Bricli_PrintF(cli, "%-*s: ", BRICLI_EMIT_KEY_WIDTH, key);
+            break;
+    }
 
+    if (cli->Emitter != NULL)
+    {
+        cli->Emitter->Count++;
+    }
+    return result;
 }
 
 /**
- * @brief Places a character into the RX buffer and performs various character checks.
+ * @brief Starts a record of key/value fields, rendered according to the handle's output mode.
  *
- * @param cli Pointer to the CLI instance to use.
- * @param rxChar The character received.
+ * @param cli Pointer to a BriCLI instance.
  *
- * @return BricliCopyWouldOverflow if the RX buffer is full, BricliOk otherwise.
+ * @return An error code, negative indicates a problem occurred.
  */
-BricliErrors_t Bricli_ReceiveCharacter(BricliHandle_t *cli, char rxChar)
+int Bricli_EmitBegin(BricliHandle_t *cli)
 {
-    BricliErrors_t result = BricliUnknown;
-
-    // Check for a null terminating character.
-    if (rxChar == '\0')
+    if (cli == NULL)
     {
-        result = BricliReceivedNull;
-        goto cleanup;
+        return BricliBadHandle;
     }
 
-    // Check for an overflow.
-    if (cli->PendingBytes >= cli->RxBufferSize)
+    if (cli->Emitter != NULL)
     {
-        result = BricliCopyWouldOverflow;
-        goto cleanup;
+        cli->Emitter->Count = 0;
     }
+    switch (Bricli_GetOutputMode(cli))
+    {
+        case BricliOutputJsonLines:
+            return Bricli_Write(cli, 1, "{");
 
-    // Store the received character.
-    cli->RxBuffer[cli->PendingBytes] = rxChar;
-    cli->PendingBytes++;
+        case BricliOutputCbor:
+            // An indefinite length map, so fields do not need counting up front.
+            return Bricli_Write(cli, 1, "\xBF");
 
-    // If we are currently in the process of handling an escape code.
-    if (cli->IsHandlingEscape)
-    {
-        Bricli_ParseEscapeCode(cli);
+        default:
+            return BricliOk;
     }
+}
 
-    // If we've received a backspace then we need to remove it and the previous character.
-    if (rxChar == '\b')
+/**
+ * @brief Adds a string field to the current record.
+ *
+ * @param cli   Pointer to a BriCLI instance.
+ * @param key   The field's key.
+ * @param value The field's value.
+ *
+ * @return An error code, negative indicates a problem occurred.
+ */
+int Bricli_EmitString(BricliHandle_t *cli, const char *key, const char *value)
+{
+    int result;
+    uint32_t valueLength = 0;
+
+    if (cli == NULL)
     {
-        Bricli_Backspace(cli);
-        result = BricliOk;
+        return BricliBadHandle;
     }
-
-    // Echo the received character.
-    if (cli->LocalEcho)
+    else if (key == NULL || value == NULL)
     {
-        Bricli_Write(cli, 1, &rxChar);
+        return BricliBadParameter;
     }
+    valueLength = (uint32_t)strlen(value);
 
-    // Success.
-    result = BricliOk;
+    result = Bricli_EmitKey(cli, key);
+    switch (Bricli_GetOutputMode(cli))
+    {
+        case BricliOutputJsonLines:
+            return Bricli_FirstError(result, Bricli_JsonString(cli, value));
 
-cleanup:
-    return result;
+        case BricliOutputCbor:
+            result = Bricli_FirstError(result, Bricli_CborHead(cli, 3, valueLength));
+            return Bricli_FirstError(result, Bricli_Write(cli, valueLength, value));
+
+        default:
+            return Bricli_FirstError(result, Bricli_WriteLine(cli, valueLength, value));
+    }
 }
 
 /**
- * @brief Iterates through an array of received characters, parsing each in turn.
+ * @brief Adds a signed integer field to the current record.
  *
- * @param cli       Pointer to the CLI instance to use.
- * @param index     The starting character in array to receive from.
- * @param length    The number of bytes to be received from the array.
- * @param arrray    Pointer to the array to be received.
+ * @param cli   Pointer to a BriCLI instance.
+ * @param key   The field's key.
+ * @param value The field's value.
  *
- * @return BricliCopyWouldOverflow if the RX buffer is full, BricliOk otherwise.
+ * @return An error code, negative indicates a problem occurred.
  */
-BricliErrors_t Bricli_ReceiveIndexedArray(BricliHandle_t *cli, uint32_t index, uint32_t length, char *array)
+int Bricli_EmitInt(BricliHandle_t *cli, const char *key, int64_t value)
 {
-    BricliErrors_t error = BricliUnknown;
+    int result;
 
-    // Receive each character in turn.
-    for (uint32_t i = index; i < (index + length); i++)
+    if (cli == NULL)
     {
-        error = Bricli_ReceiveCharacter(cli, array[i]);
+        return BricliBadHandle;
+    }
+    else if (key == NULL)
+    {
+        return BricliBadParameter;
+    }
 
-        // If something went wrong, exit immediately.
-        if (error != BricliOk)
-        {
-            return error;
-        }
+    result = Bricli_EmitKey(cli, key);
+    switch (Bricli_GetOutputMode(cli))
+    {
+        case BricliOutputJsonLines:
+            return Bricli_FirstError(result, Bricli_PrintF(cli, "%lld", (long long)value));
+
+        case BricliOutputCbor:
+            // Negative integers are encoded as -1 - n.
+            return Bricli_FirstError(result, (value < 0) ? Bricli_CborHead(cli, 1, (uint64_t)(-1 - value))
+                                                         : Bricli_CborHead(cli, 0, (uint64_t)value));
+
+        default:
+            return Bricli_FirstError(result, Bricli_PrintF(cli, "%lld%s", (long long)value, Bricli_GetSendEol(cli)));
     }
-    return error;
 }
 
 /**
-  * @brief Updates the pending bytes count and transmits a VT100 backspace response.
-  * @param cli Pointer to the CLI instance to use.
-  */
-void Bricli_Backspace(BricliHandle_t *cli)
-{   
-    
-    // If there is less than 2 bytes in the buffer there is nothing to be deleted.
-    if (cli->PendingBytes < 2)
+ * @brief Adds an unsigned integer field to the current record.
+ *
+ * @param cli   Pointer to a BriCLI instance.
+ * @param key   The field's key.
+ * @param value The field's value.
+ *
+ * @return An error code, negative indicates a problem occurred.
+ */
+int Bricli_EmitUInt(BricliHandle_t *cli, const char *key, uint64_t value)
+{
+    int result;
+
+    if (cli == NULL)
     {
-        cli->PendingBytes = 0;
+        return BricliBadHandle;
     }
-    // If there is more than 2 bytes we must tell the VT100 terminal to delete a character.
-    else
+    else if (key == NULL)
     {
-        // Move the pending bytes value back by two characters and ensure the backsapce is nulled.
-        cli->PendingBytes -= 2;
-        cli->RxBuffer[cli->PendingBytes + 1] = '\0';
+        return BricliBadParameter;
+    }
 
-        // Send the backspace and the VT100 delete.
-        Bricli_Write(cli, 1, "\b");
-        Bricli_Write(cli, 3, BRICLI_DELETE_CHAR);
+    result = Bricli_EmitKey(cli, key);
+    switch (Bricli_GetOutputMode(cli))
+    {
+        case BricliOutputJsonLines:
+            return Bricli_FirstError(result, Bricli_PrintF(cli, "%llu", (unsigned long long)value));
+
+        case BricliOutputCbor:
+            return Bricli_FirstError(result, Bricli_CborHead(cli, 0, value));
+
+        default:
+            return Bricli_FirstError(result, Bricli_PrintF(cli, "%llu%s", (unsigned long long)value, Bricli_GetSendEol(cli)));
     }
 }
 
 /**
-  * @brief Helper function for sending formatted messages through a CLI instance.
-  *
-  * @param cli Pointer to a BriCLI instance.
-  * @param format Format string to be used for message generation.
-  *
-  * @return The error code from the instance's BSP write.
-  */
-int Bricli_PrintHelp(BricliHandle_t *cli)
+ * @brief Adds a boolean field to the current record.
+ *
+ * @param cli   Pointer to a BriCLI instance.
+ * @param key   The field's key.
+ * @param value The field's value.
+ *
+ * @return An error code, negative indicates a problem occurred.
+ */
+int Bricli_EmitBool(BricliHandle_t *cli, const char *key, bool value)
 {
-    BricliCommand_t *command = NULL;
+    int result;
 
-    // Print the system commands first.
-    Bricli_WriteStringLine(cli, "help - Displays this help message");
-    Bricli_WriteStringLine(cli, "clear - Clears the terminal");
+    if (cli == NULL)
+    {
+        return BricliBadHandle;
+    }
+    else if (key == NULL)
+    {
+        return BricliBadParameter;
+    }
 
-    // Print the user commands.
-    for (uint8_t i = 0; i < cli->CommandListLength; i++)
+    result = Bricli_EmitKey(cli, key);
+    switch (Bricli_GetOutputMode(cli))
     {
-        command = &cli->CommandList[i];
+        case BricliOutputJsonLines:
+            return Bricli_FirstError(result, Bricli_WriteString(cli, value ? "true" : "false"));
 
-        // Send the help message for each command.
-        if (command->HelpMessage == NULL)
-        {
-            if (cli->SendEol == NULL)
-            {
-                Bricli_PrintF(cli, "%s%s", command->Name, cli->Eol);
-            }
-            else
-            {
-                Bricli_PrintF(cli, "%s%s", command->Name, cli->SendEol);
-            }
-        }
-        else
-        {
-            if (cli->SendEol == NULL)
-            {
-                Bricli_PrintF(cli, "%s - %s%s", command->Name, command->HelpMessage, cli->Eol);
-            }
-            else
-            {
-                Bricli_PrintF(cli, "%s - %s%s", command->Name, command->HelpMessage, cli->SendEol);
-            }
-        }
+        case BricliOutputCbor:
+            return Bricli_FirstError(result, Bricli_Write(cli, 1, value ? "\xF5" : "\xF4"));
+
+        default:
+            return Bricli_FirstError(result, Bricli_WriteStringLine(cli, value ? "true" : "false"));
     }
-    return 0;
 }
 
 /**
- * @brief Helper function for sending formatted messages through a CLI instance.
+ * @brief Ends the current record.
  *
  * @param cli Pointer to a BriCLI instance.
- * @param format Format string to be used for message generation.
  *
- * @return The error code from the instance's BSP write.
+ * @return An error code, negative indicates a problem occurred.
  */
-int Bricli_PrintF(BricliHandle_t *cli, const char *format, ...)
+int Bricli_EmitEnd(BricliHandle_t *cli)
 {
-    char message[BRICLI_PRINT_MESSAGE_SIZE] = {0};
-    int bytesWritten = 0;
-    int result = -1;
-
-    // Format the message.
-    va_list args;
-    va_start(args, format);
-    bytesWritten = vsnprintf(message, BRICLI_PRINT_MESSAGE_SIZE, format, args);
-    va_end(args);
-
-    // Send the formatted message if it was fully written.
-    if (bytesWritten > 0 && bytesWritten < BRICLI_PRINT_MESSAGE_SIZE)
+    if (cli == NULL)
     {
-        result = Bricli_Write(cli, bytesWritten, message);
+        return BricliBadHandle;
     }
 
-    return result;
+    switch (Bricli_GetOutputMode(cli))
+    {
+        case BricliOutputJsonLines:
+            return Bricli_WriteStringLine(cli, "}");
+
+        case BricliOutputCbor:
+            return Bricli_Write(cli, 1, "\xFF");
+
+        default:
+            return BricliOk;
+    }
 }
 
 /** @brief Helper function that clears the internal buffer and resets the CLI state.
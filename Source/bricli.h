@@ -39,10 +39,6 @@ extern "C" {
 #define BRICLI_SHOW_COMMAND_ERRORS 1 // Set to 1 to have BriCLI automatically report command handler error codes.
 #endif // BRICLI_SHOW_COMMAND_ERRORS
 
-#ifndef BRICLI_USE_REENTRANT
-#define BRICLI_USE_REENTRANT 1 // Set to 1 to have BriCLI use re-entrant safe strtok_r instead of strtok.
-#endif // BRICLI_USE_REENTRANT
-
 #ifndef BRICLI_USE_COLOUR
 #define BRICLI_USE_COLOUR 1 // Set to 1 to allow the use of VT100 colour options.
 #endif // BRICLI_USE_COLOUR
@@ -51,9 +47,9 @@ extern "C" {
 #define BRICLI_MAX_COMMAND_LEN 10 // Sets the maximum command name length.
 #endif // BRICLI_MAX_COMMAND_LEN
 
-#ifndef BRICLI_ARGUMENT_BUFFER_LEN
-#define BRICLI_ARGUMENT_BUFFER_LEN 70 // The maximum number of bytes available for argument storage.
-#endif // BRICLI_ARGUMENT_BUFFER_LEN
+#ifndef BRICLI_SUBTREE_SEPARATOR
+#define BRICLI_SUBTREE_SEPARATOR '_' // Sets the character that splits a command name into a subtree, e.g. "led" in "led_on".
+#endif // BRICLI_SUBTREE_SEPARATOR
 
 #ifndef BRICLI_MAX_ARGUMENTS
 #define BRICLI_MAX_ARGUMENTS 3 // Sets the maximum number of arguments that BriCLI can find.
@@ -63,10 +59,67 @@ extern "C" {
 //#define BRICLI_RX_BUFFER_LEN 80 // Sets the character
 //#endif // BRICLI_RX_BUFFER_LEN
 
+#ifndef BRICLI_USE_FAST_FORMAT
+#define BRICLI_USE_FAST_FORMAT 1 // Formats %d, %i, %u, %x and %X in PrintF without snprintf.
+#endif // BRICLI_USE_FAST_FORMAT
+
+#ifndef BRICLI_USE_SIMD
+#define BRICLI_USE_SIMD 1 // Set to 1 to allow vectorised blob decoding on hosts that support it (currently SSE2).
+#endif // BRICLI_USE_SIMD
+
 #ifndef BRICLI_PRINT_MESSAGE_SIZE
-#define BRICLI_PRINT_MESSAGE_SIZE 80 // Sets the maximum length of a custom PrintF message.
+#define BRICLI_PRINT_MESSAGE_SIZE 80 // Sets the size of the chunk PrintF formats into, longer messages are sent in pieces.
 #endif // BRICLI_PRINT_MESSAGE_SIZE
 
+#ifndef BRICLI_PRINT_LONG_SIZE
+#define BRICLI_PRINT_LONG_SIZE 320 // Sets the size of the stack scratch a single conversion too long for the PrintF chunk is formatted into.
+#endif // BRICLI_PRINT_LONG_SIZE
+
+#ifndef BRICLI_EMIT_KEY_WIDTH
+#define BRICLI_EMIT_KEY_WIDTH 16 // Sets the width keys are padded to when emitted records are rendered as text.
+#endif // BRICLI_EMIT_KEY_WIDTH
+
+#ifndef BRICLI_JOB_LINE_SIZE
+#define BRICLI_JOB_LINE_SIZE 80 // Sets the longest command line that can be handed to a worker job.
+#endif // BRICLI_JOB_LINE_SIZE
+
+#ifndef BRICLI_JOB_OUTPUT_SIZE
+#define BRICLI_JOB_OUTPUT_SIZE 256 // Sets the size of the buffer a worker job's output is held in until it is released.
+#endif // BRICLI_JOB_OUTPUT_SIZE
+
+#ifndef BRICLI_POST_SIZE
+#define BRICLI_POST_SIZE 80 // Sets the longest message other threads can post with Bricli_PostWrite.
+#endif // BRICLI_POST_SIZE
+
+#ifndef BRICLI_USE_THREADS
+#define BRICLI_USE_THREADS 1 // Set to 0 if workers and posting threads are never used, shared state then needs no atomics.
+#endif // BRICLI_USE_THREADS
+
+// State shared with workers and posting threads is only touched through these. Loads acquire, stores release,
+// exchanges do both and compare-exchange is relaxed, and may fail spuriously so it belongs in a loop.
+#if !BRICLI_USE_THREADS
+#define BRICLI_ATOMIC(type)                             volatile type
+#define BRICLI_ATOMIC_LOAD(pointer)                     (*(pointer))
+#define BRICLI_ATOMIC_STORE(pointer, value)             ((void)(*(pointer) = (value)))
+#define BRICLI_ATOMIC_EXCHANGE(pointer, value)          Bricli_ExchangeFlag((pointer), (value))
+#define BRICLI_ATOMIC_CAS(pointer, expected, desired)   Bricli_CompareExchange((pointer), (expected), (desired))
+#elif defined(__GNUC__) || defined(__clang__)
+#define BRICLI_ATOMIC(type)                             type
+#define BRICLI_ATOMIC_LOAD(pointer)                     __atomic_load_n((pointer), __ATOMIC_ACQUIRE)
+#define BRICLI_ATOMIC_STORE(pointer, value)             __atomic_store_n((pointer), (value), __ATOMIC_RELEASE)
+#define BRICLI_ATOMIC_EXCHANGE(pointer, value)          __atomic_exchange_n((pointer), (value), __ATOMIC_ACQ_REL)
+#define BRICLI_ATOMIC_CAS(pointer, expected, desired)   __atomic_compare_exchange_n((pointer), (expected), (desired), true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#elif defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define BRICLI_ATOMIC(type)                             _Atomic type
+#define BRICLI_ATOMIC_LOAD(pointer)                     atomic_load_explicit((pointer), memory_order_acquire)
+#define BRICLI_ATOMIC_STORE(pointer, value)             atomic_store_explicit((pointer), (value), memory_order_release)
+#define BRICLI_ATOMIC_EXCHANGE(pointer, value)          atomic_exchange_explicit((pointer), (value), memory_order_acq_rel)
+#define BRICLI_ATOMIC_CAS(pointer, expected, desired)   atomic_compare_exchange_weak_explicit((pointer), (expected), (desired), memory_order_relaxed, memory_order_relaxed)
+#else
+#error "BriCLI needs C11 atomics or the GCC/Clang __atomic builtins, or BRICLI_USE_THREADS set to 0."
+#endif // BRICLI_USE_THREADS
+
 // VT100 colour options.
 #if BRICLI_USE_COLOUR
 #ifndef BRICLI_USE_TEXT_COLOURS
@@ -101,6 +154,8 @@ extern "C" {
 
 #define BRICLI_DELETE_CHAR     "\e[K"
 #define BRICLI_CLEAR           "\e[H\e[J"
+#define BRICLI_MORE_PROMPT     "--More--"
+#define BRICLI_CANCEL_CHAR     '\x03'
 
 #define BRICLI_ARROW_LEN       2
 #define BRICLI_UP_ARROW        "[A"
@@ -191,6 +246,10 @@ typedef enum _BricliLastError_t
 
 typedef enum _BricliErrors_t
 {
+    BricliBusy               = -11,
+    BricliTimedOut           = -10,
+    BricliCancelled          = -9,
+    BricliPending            = -8,
     BricliUnknown            = -7,
     BricliReceivedNull       = -6,
     BricliCopyWouldOverflow  = -5,
@@ -201,6 +260,38 @@ typedef enum _BricliErrors_t
     BricliOk                 = 0
 } BricliErrors_t;
 
+/**
+ * @brief A view of binary data decoded in place from an argument string.
+ *
+ * @param Data      Pointer to the decoded bytes, this aliases the original argument storage.
+ * @param Length    The number of decoded bytes.
+ */
+typedef struct _BricliBlob_t
+{
+    uint8_t*                Data;           /*<< Decoded bytes, aliasing the argument text. */
+    uint32_t                Length;         /*<< Number of bytes in Data. */
+} BricliBlob_t;
+
+/**
+ * @brief A pointer and length view of an argument.
+ *
+ * Spans produced by the tokeniser point directly into the RX buffer. Handlers should rely
+ * on Length rather than a NUL terminator so views can also be built over raw data.
+ *
+ * @param Data      Pointer to the first character of the argument.
+ * @param Length    The number of characters in the argument.
+ */
+typedef struct _BricliSpan_t
+{
+    const char*             Data;           /*<< First character of the argument. */
+    uint32_t                Length;         /*<< Number of characters in Data. */
+} BricliSpan_t;
+
+/**
+ * @brief A single piece of a scatter-gather write, pointing at data owned by the caller.
+ */
+typedef BricliSpan_t BricliIoVec_t;
+
 /**
  * @brief Enumerated VT100 colour options
  */
@@ -245,6 +336,62 @@ typedef enum _BricliColours_t
     BricliColourReset
 } BricliColours_t;
 
+/**
+ * @brief What a terminal is showing as far as BriCLI has set it, so redundant colour codes can be skipped.
+ *
+ * @param Foreground    The text colour plus one, zero for the terminal's default.
+ * @param Background    The background colour plus one, zero for the terminal's default.
+ * @param Attributes    Bold and underline flags.
+ */
+typedef struct _BricliColourState_t
+{
+    uint8_t                 Foreground;
+    uint8_t                 Background;
+    uint8_t                 Attributes;
+} BricliColourState_t;
+
+/**
+ * @brief Option flags that can be set on a command.
+ */
+typedef enum _BricliCommandFlags_t
+{
+    BricliCommandLazyArguments = 0x01, // Arguments are not tokenised up front, the handler pulls them with Bricli_NextArg.
+    BricliCommandConcurrent    = 0x02, // The command may run while an earlier deferred command is still pending.
+    BricliCommandOffload       = 0x04, // The command's ContextHandler is run as a worker job when a job pool is set.
+    BricliCommandIndependent   = 0x08  // The command does not depend on its neighbours, Bricli_ExecuteBatch may run it in parallel with them.
+} BricliCommandFlags_t;
+
+/**
+ * @brief When BriCLI automatically flushes its TX buffer, a full buffer is always flushed.
+ */
+typedef enum _BricliFlushPolicy_t
+{
+    BricliFlushOnPrompt,        // Flush when the prompt is sent and after local echo, the default.
+    BricliFlushAfterHandler,    // Additionally flush at the end of every command handler.
+    BricliFlushExplicit         // Only flush when the buffer is full or Bricli_Flush is called.
+} BricliFlushPolicy_t;
+
+/**
+ * @brief Progress of paged output started with Bricli_StartPaged.
+ */
+typedef enum _BricliPageStates_t
+{
+    BricliPageRunning,          // Output is being pulled from the producer.
+    BricliPagePaused,           // Waiting at the --More-- prompt for a key press.
+    BricliPageContinue,         // A key was pressed, the next page is sent on the next Bricli_Parse.
+    BricliPageQuit              // 'q' was pressed, paging ends on the next Bricli_Parse.
+} BricliPageStates_t;
+
+/**
+ * @brief How records written with the Bricli_Emit functions are rendered.
+ */
+typedef enum _BricliOutputModes_t
+{
+    BricliOutputHuman,          // One aligned "key: value" line per field, the default.
+    BricliOutputJsonLines,      // One JSON object per record, followed by the send EOL.
+    BricliOutputCbor            // One CBOR map per record, with no separators.
+} BricliOutputModes_t;
+
 /**
  * @brief States that BriCLI can be in during execution.
  */
@@ -253,7 +400,9 @@ typedef enum _BricliStates_t
     BricliStateIdle,            // BriCLI is idle and receiving characters.
     BricliStateParsing,         // BriCLI is parsing a buffer looking a valid handler to run.
     BricliStateHandlerRunning,  // BriCLI is executing a command handler.
-    BricliStateFinished
+    BricliStateFinished,
+    BricliStatePaging,          // BriCLI is sending paged output, further commands wait until it finishes.
+    BricliStatePending          // A deferred command has not completed yet, further commands wait until it does.
 } BricliStates_t;
 
 /**
@@ -262,11 +411,41 @@ typedef enum _BricliStates_t
  * This should be a wrapper function for your underlying peripheral. This
  * may be a UART, USB or any other communication stack you have.
  *
+ * When the instance's NonBlockingTx option is set this must not wait, instead returning the
+ * number of characters it accepted, 0 if it is busy. Accepted characters must have been copied
+ * or sent before returning. After accepting fewer characters than requested the transport is not
+ * called again until Bricli_OnTxComplete has been called.
+ *
  * @param length    The number of characters in \c data.
  * @param data      The data to be written.
  */
 typedef int (*Bricli_BspWrite)(uint32_t length, const char* data);
 
+/**
+ * @brief Optional BSP function for writing several pieces of data in one transaction.
+ *
+ * This maps directly onto writev/sendmsg style transports so colour codes, static strings
+ * and user buffers can be sent without being copied together first.
+ *
+ * @param vectors   Array of data pieces to be written in order.
+ * @param count     The number of entries in \c vectors.
+ */
+typedef int (*Bricli_BspWriteV)(const BricliIoVec_t* vectors, uint32_t count);
+
+struct _BricliHandle_t;
+
+/**
+ * @brief Optional session aware BSP write, used in place of Bricli_BspWrite when set.
+ *
+ * Lets one transport function serve many instances, the instance's UserData can hold
+ * the connection the output belongs to. Follows the same contract as Bricli_BspWrite.
+ *
+ * @param cli       The instance the data is being written for.
+ * @param length    The number of characters in \c data.
+ * @param data      The data to be written.
+ */
+typedef int (*Bricli_BspSessionWrite)(struct _BricliHandle_t* cli, uint32_t length, const char* data);
+
 /**
  * @brief Command handler function, one should be provided for every command.
  *
@@ -275,6 +454,76 @@ typedef int (*Bricli_BspWrite)(uint32_t length, const char* data);
  */
 typedef int (*Bricli_CommandHandler)(uint32_t numberOfArgs, char* args[]);
 
+/**
+ * @brief Span based command handler, an alternative to Bricli_CommandHandler that receives argument lengths.
+ *
+ * @param numberOfArgs The number of arguments found.
+ * @param args         Array of argument spans found.
+ */
+typedef int (*Bricli_SpanCommandHandler)(uint32_t numberOfArgs, const BricliSpan_t args[]);
+
+/**
+ * @brief Handle aware command handler, an alternative to Bricli_CommandHandler for handlers shared between instances.
+ *
+ * @param cli          The instance the command was received on, output should be written here.
+ * @param context      The command's Context pointer.
+ * @param numberOfArgs The number of arguments found.
+ * @param args         Array of argument string found.
+ */
+typedef int (*Bricli_ContextCommandHandler)(struct _BricliHandle_t* cli, void* context, uint32_t numberOfArgs, char* args[]);
+
+/**
+ * @brief Stream reader for commands that accept arguments larger than the RX buffer.
+ *
+ * Raw argument bytes are delivered in chunks as the RX buffer fills, from within
+ * Bricli_ReceiveCharacter, and the remainder is delivered when the command is parsed.
+ * No quote or escape processing is applied to streamed arguments.
+ *
+ * @param data      Pointer to the chunk of argument bytes, only valid during the call.
+ * @param length    The number of bytes in \c data.
+ * @param isFinal   True for the last chunk, its return value is used as the command result.
+ *
+ * @return Negative to report an error, any further chunks are then discarded.
+ */
+typedef int (*Bricli_StreamReader)(const char* data, uint32_t length, bool isFinal);
+
+/**
+ * @brief Producer for paged output, called each time the transport can take more output.
+ *
+ * @param context   The context pointer given to Bricli_StartPaged.
+ * @param buffer    Space to write the next piece of output into.
+ * @param capacity  The number of characters that can be written to \c buffer.
+ *
+ * @return The number of characters written, 0 when there is no more output or negative on error.
+ */
+typedef int32_t (*Bricli_PageProducer)(void* context, char* buffer, uint32_t capacity);
+
+/**
+ * @brief Millisecond tick source used to enforce command time budgets, it is allowed to wrap.
+ *
+ * @return The current tick in milliseconds.
+ */
+typedef uint32_t (*Bricli_TickSource)(void);
+
+struct _BricliJob_t;
+
+/**
+ * @brief Hands a job to the application's worker pool.
+ *
+ * A worker should call Bricli_RunJob on the job. Its output is released in submission order
+ * by Bricli_ReleaseJobs, or Bricli_Parse, on the thread that owns the instance.
+ *
+ * @param job   The job to be run.
+ *
+ * @return Negative if the job could not be queued, it is then run inline instead.
+ */
+typedef int (*Bricli_JobSubmit)(struct _BricliJob_t* job);
+
+/**
+ * @brief Called while the owning thread waits for a worker to finish a job, e.g. to yield or sleep.
+ */
+typedef void (*Bricli_JobWait)(void);
+
 /**
  * @brief StateChanged event callback. Used to notify an application of internal state changes.
  *
@@ -290,59 +539,373 @@ typedef void (*Bricli_StateChanged)(BricliStates_t oldState, BricliStates_t newS
  * @param MaxArguments  Maximum number of arguments to look for.
  * @param Handler       Handler function for this command.
  * @param HelpMessage   Optional message to display with the built-in help command.
+ * @param SpanHandler   Optional span based handler, used in place of Handler when set.
+ * @param Flags         Optional BricliCommandFlags_t options for this command.
+ * @param StreamReader  Optional reader that receives the arguments in chunks, used in place of Handler when set.
+ * @param ContextHandler Optional handle aware handler, used in place of Handler and SpanHandler when set.
+ * @param Context       Optional pointer passed to ContextHandler.
+ * @param TimeoutMs     Optional time budget in milliseconds, the command is reported as timed out once it overruns.
  */
 typedef struct _BricliCommand_t
 {
     const char*             Name;           /*<< Command name. */
     Bricli_CommandHandler  Handler;        /*<< Handler function for this command. */
     const char*             HelpMessage;    /*<< Optional message to be displayed by the help command. */
+    Bricli_SpanCommandHandler SpanHandler;  /*<< Optional span based handler, used in place of Handler when set. */
+    uint32_t                Flags;          /*<< Optional BricliCommandFlags_t options. */
+    Bricli_StreamReader    StreamReader;   /*<< Optional reader for streamed arguments, used in place of Handler when set. */
+    Bricli_ContextCommandHandler ContextHandler; /*<< Optional handle aware handler, used in place of Handler and SpanHandler when set. */
+    void*                   Context;        /*<< Optional pointer passed to ContextHandler. */
+    uint32_t                TimeoutMs;      /*<< Optional time budget in milliseconds, 0 for none. */
 } BricliCommand_t;
 
 /**
- * @brief Initializer for BriCLI to set the commands, bsp functions and EOL.
+ * @brief Configuration that can be shared, read only, between many instances.
  *
- * @param LastError       Determines whether the last error came from BriCLI or a command.
- * @param CommandList     The list of CLI commands.
- * @param BspWrite        BSP function for writing out data.
- * @param Eol             The End of Line character BriCLI should look for.
+ * A server hosting many sessions keeps a single copy and each session only carries its own
+ * buffers and state.
+ *
+ * @param CommandList       The list of CLI commands.
+ * @param CommandListLength The number of entries in CommandList.
+ * @param Eol               The End of Line sequence to look for, "\n" when NULL.
+ * @param SendEol           Optional End of Line sequence used when sending, Eol is used when NULL.
+ * @param Prompt            Optional prompt sent after each command.
  */
-typedef struct _BricliHandle_t
+typedef struct _BricliConfig_t
 {
-    BricliLastError_t      LastError;
     BricliCommand_t*       CommandList;
     uint32_t                CommandListLength;
+    const char*             Eol;
+    const char*             SendEol;
+    const char*             Prompt;
+} BricliConfig_t;
+
+/**
+ * @brief A slot in the queue of messages posted by other threads.
+ *
+ * @param Sequence  Tracks whether the slot is free or holds a message, starts at zero.
+ * @param Length    The number of characters in Data.
+ * @param Data      The message.
+ */
+typedef struct _BricliPost_t
+{
+    BRICLI_ATOMIC(uint32_t) Sequence;
+    uint32_t                Length;
+    char                    Data[BRICLI_POST_SIZE];
+} BricliPost_t;
+
+/**
+ * @brief State for paged output, needed by instances that use Bricli_StartPaged.
+ *
+ * @param Lines     Optional page length, output pauses at a --More-- prompt every Lines lines.
+ * @param Producer  The producer output is being pulled from, NULL when not paging.
+ * @param Context   The context pointer passed to Producer.
+ * @param LineCount The number of lines sent since the last pause.
+ * @param Held      The number of characters past the end of the last page, kept at the end of the TX buffer.
+ * @param State     Whether the output is running, paused or should stop.
+ */
+typedef struct _BricliPager_t
+{
+    uint32_t                Lines;
+    Bricli_PageProducer    Producer;
+    void*                   Context;
+    uint32_t                LineCount;
+    uint32_t                Held;
+    BricliPageStates_t     State;
+} BricliPager_t;
+
+/**
+ * @brief Where Bricli_ExecuteCaptured collects a command's output.
+ *
+ * @param Buffer        The caller's buffer.
+ * @param Size          The size of Buffer.
+ * @param Length        The number of characters captured so far.
+ * @param IsTruncated   True once output has been dropped because Buffer was full.
+ * @param IsNested      True when run from within another command's handler, which keeps its cancellation and time budget.
+ */
+typedef struct _BricliCapture_t
+{
+    char*                   Buffer;
+    uint32_t                Size;
+    uint32_t                Length;
+    bool                    IsTruncated;
+    bool                    IsNested;
+} BricliCapture_t;
+
+/**
+ * @brief Cache of rendered help text, reused until the command list changes.
+ *
+ * @param Buffer            Buffer the help text is rendered into.
+ * @param Size              The size of Buffer.
+ * @param Length            The length of the cached text, 0 when nothing is cached.
+ * @param CommandList       The command list the cached text was rendered from.
+ * @param CommandListLength The length of the command list the cached text was rendered from.
+ */
+typedef struct _BricliHelpCache_t
+{
+    char*                   Buffer;
+    uint32_t                Size;
+    uint32_t                Length;
+    BricliCommand_t*       CommandList;
+    uint32_t                CommandListLength;
+} BricliHelpCache_t;
+
+/**
+ * @brief Job slots for commands run on the application's workers or in the background.
+ *
+ * @param Jobs                  Optional pool of job slots, commands flagged BricliCommandOffload run on workers when set.
+ * @param JobCount              The number of entries in Jobs.
+ * @param JobHead               Count of jobs released, the oldest job in flight is Jobs[JobHead % JobCount].
+ * @param JobTail               Count of jobs submitted.
+ * @param SubmitJob             Hands a job to the application's worker pool.
+ * @param WaitJob               Optional idle hook called while Bricli_ExecuteBatch waits on a worker, it spins when NULL.
+ * @param BackgroundJobs        Optional pool of job slots for commands started with a trailing "&".
+ * @param BackgroundJobCount    The number of entries in BackgroundJobs.
+ * @param NextJobId             The id given to the most recently started background job.
+ */
+typedef struct _BricliJobPool_t
+{
+    struct _BricliJob_t*   Jobs;
+    uint32_t                JobCount;
+    uint32_t                JobHead;
+    uint32_t                JobTail;
+    Bricli_JobSubmit       SubmitJob;
+    Bricli_JobWait         WaitJob;
+    struct _BricliJob_t*   BackgroundJobs;
+    uint32_t                BackgroundJobCount;
+    uint32_t                NextJobId;
+} BricliJobPool_t;
+
+/**
+ * @brief Queues that let other threads pass input and output to the owning thread.
+ *
+ * @param InputRing     Optional ring that Bricli_PostReceive fills from another thread, its size must be a power of two.
+ * @param InputRingSize The size of InputRing.
+ * @param InputHead     The number of characters Bricli_Parse has taken from InputRing.
+ * @param InputTail     The number of characters Bricli_PostReceive has placed in InputRing.
+ * @param Posts         Optional queue of messages posted by other threads, its length must be a power of two.
+ * @param PostCount     The number of entries in Posts.
+ * @param PostHead      The number of messages written out from Posts.
+ * @param PostTail      The number of messages claimed in Posts.
+ */
+typedef struct _BricliMailbox_t
+{
+    char*                   InputRing;
+    uint32_t                InputRingSize;
+    BRICLI_ATOMIC(uint32_t) InputHead;
+    BRICLI_ATOMIC(uint32_t) InputTail;
+    BricliPost_t*          Posts;
+    uint32_t                PostCount;
+    uint32_t                PostHead;
+    BRICLI_ATOMIC(uint32_t) PostTail;
+} BricliMailbox_t;
+
+/**
+ * @brief Output mode for records written with the Bricli_Emit functions.
+ *
+ * @param Mode  How records are rendered.
+ * @param Count The number of fields in the current record.
+ */
+typedef struct _BricliEmitter_t
+{
+    BricliOutputModes_t    Mode;
+    uint32_t                Count;
+} BricliEmitter_t;
+
+/**
+ * @brief A BriCLI instance. Every field defaults to zero, see BRICLI_HANDLE_DEFAULT.
+ *
+ * Optional features keep their state behind a pointer, so an instance only pays for the
+ * features it uses.
+ *
+ * @param LastError         Determines whether the last error came from BriCLI or a command.
+ * @param State             The current state of the instance.
+ * @param Config            The command list, EOLs and prompt, may be shared between instances.
+ *                          Without one there are no commands, the EOL is "\n" and the prompt ">> ".
+ * @param BspWrite          BSP function for writing out data.
+ * @param BspWriteV         Optional scatter-gather BSP write, BspWrite is used when this is NULL.
+ * @param SessionWrite      Optional session aware BSP write, used in place of BspWrite and BspWriteV when set.
+ * @param UserData          Application data for this instance, BriCLI never touches it.
+ * @param OnStateChanged    Optional callback for state changes.
+ * @param RxBuffer          Buffer received characters are placed in.
+ * @param RxBufferSize      The size of RxBuffer.
+ * @param PendingBytes      The number of characters waiting in RxBuffer.
+ * @param CommandLength     Length of the command line currently being parsed, used to locate the next command.
+ * @param SplitCommands     Commands already split off in RxBuffer that are still to be run.
+ * @param ArgumentCursor    Position of the next untokenised argument for lazy commands.
+ * @param StreamCommand     The streaming command currently receiving arguments, NULL when not streaming.
+ * @param StreamOffset      Offset in the RX buffer where the streamed arguments start.
+ * @param StreamResult      The first error returned by the stream reader, delivered as the command result.
+ * @param TxBuffer          Optional buffer used to coalesce writes into fewer BspWrite calls.
+ * @param TxBufferSize      The size of TxBuffer in bytes.
+ * @param TxPending         The number of bytes waiting in TxBuffer.
+ * @param TxHead            Offset of the first byte in TxBuffer not yet taken by a non-blocking transport.
+ * @param TxFlushPolicy     When the TX buffer is automatically flushed.
+ * @param GetTick           Optional tick source, commands with a TimeoutMs are only timed when this is set.
+ * @param Deadline          Tick at which the running or pending command times out.
+ * @param PendingToken      Token issued to the most recently deferred command.
+ * @param Parent            The instance a worker job's shadow was created from, whose cancellation it follows.
+ * @param Pager             Optional paged output state, needed by Bricli_StartPaged.
+ * @param Capture           Set while Bricli_ExecuteCaptured collects output.
+ * @param HelpCache         Optional cache of the rendered help text.
+ * @param JobPool           Optional job slots for worker and background jobs.
+ * @param Mailbox           Optional queues used by Bricli_PostReceive, Bricli_PostWrite and Bricli_PostF.
+ * @param Emitter           Optional record output mode, records are written for people when NULL.
+ * @param Binding           Used by language bindings such as bricli.hpp, BriCLI never touches it.
+ * @param ColourState       The colour the terminal was last set to.
+ * @param IsHandlingEscape  True while an escape sequence is being received.
+ * @param LocalEcho         Echo received characters back to the terminal.
+ * @param IsColourDeferred  True when the reset of an uncoloured write has been left until it is needed.
+ * @param NonBlockingTx     The transport takes output asynchronously, see Bricli_OnTxComplete.
+ * @param IsTxBusy          True while a non-blocking transport has not finished with its last write.
+ * @param IsPending         True while a deferred command is waiting for Bricli_Complete.
+ * @param IsCancelled       Set by Ctrl-C or Bricli_Cancel, polled by handlers through Bricli_IsCancelled.
+ * @param HasDeadline       True while Deadline applies.
+ * @param IsTimedOut        True once the running or pending command has overrun its time budget.
+ * @param IsMidLine         True when the last character written did not end a line.
+ */
+typedef struct _BricliHandle_t
+{
+    BricliLastError_t      LastError;
+    BricliStates_t         State;
+    const BricliConfig_t*  Config;
     Bricli_BspWrite        BspWrite;
-    char*                   Eol;
+    Bricli_BspWriteV       BspWriteV;
+    Bricli_BspSessionWrite SessionWrite;
+    void*                   UserData;
+    Bricli_StateChanged    OnStateChanged;
     char*                   RxBuffer;
     uint32_t                RxBufferSize;
     uint32_t                PendingBytes;
-    char*                   Prompt;
+    uint32_t                CommandLength;
+    uint32_t                SplitCommands;
+    char*                   ArgumentCursor;
+    BricliCommand_t*       StreamCommand;
+    uint32_t                StreamOffset;
+    int                     StreamResult;
+    char*                   TxBuffer;
+    uint32_t                TxBufferSize;
+    uint32_t                TxPending;
+    uint32_t                TxHead;
+    BricliFlushPolicy_t    TxFlushPolicy;
+    Bricli_TickSource      GetTick;
+    uint32_t                Deadline;
+    uint32_t                PendingToken;
+    struct _BricliHandle_t* Parent;
+    BricliPager_t*         Pager;
+    BricliCapture_t*       Capture;
+    BricliHelpCache_t*     HelpCache;
+    BricliJobPool_t*       JobPool;
+    BricliMailbox_t*       Mailbox;
+    BricliEmitter_t*       Emitter;
+    void*                   Binding;
+    BricliColourState_t    ColourState;
     bool                    IsHandlingEscape;
-    BricliStates_t         State;
-    Bricli_StateChanged    OnStateChanged;
     bool                    LocalEcho;
-    char *                  SendEol;
+    bool                    IsColourDeferred;
+    bool                    NonBlockingTx;
+    bool                    IsTxBusy;
+    bool                    IsPending;
+    BRICLI_ATOMIC(bool)     IsCancelled;
+    bool                    HasDeadline;
+    bool                    IsTimedOut;
+    bool                    IsMidLine;
 } BricliHandle_t;
 
 /**
- * @brief Default settings for BriCLI for quick initialisation.
+ * @brief A command handed to a worker, with a private handle capturing its output.
+ *
+ * @param Shadow        Capture only instance the handler runs against, sharing the parent's configuration.
+ * @param Emitter       The shadow's record output mode, copied from the parent's.
+ * @param Line          Copy of the command line, tokenised in place by the worker.
+ * @param Output        The handler's output, held until the job is released.
+ * @param OutputLength  The number of characters in Output.
+ * @param IsTruncated   True if output was dropped because Output was full, reported when the job is released.
+ * @param Result        The handler's result.
+ * @param IsDone        Set by the worker once Output and Result are final.
+ * @param Command       The command being run, used to name background jobs.
+ * @param Id            The number background jobs are listed and killed by.
+ * @param StartTick     The tick the background job was started at.
+ * @param IsActive      True while the background job's slot is in use.
+ * @param IsClaimed     Set by whichever thread runs the job, so it is only ever run once.
+ */
+typedef struct _BricliJob_t
+{
+    BricliHandle_t         Shadow;
+    BricliEmitter_t        Emitter;
+    char                    Line[BRICLI_JOB_LINE_SIZE];
+    char                    Output[BRICLI_JOB_OUTPUT_SIZE];
+    uint32_t                OutputLength;
+    bool                    IsTruncated;
+    int                     Result;
+    BRICLI_ATOMIC(bool)     IsDone;
+    BricliCommand_t*       Command;
+    uint32_t                Id;
+    uint32_t                StartTick;
+    bool                    IsActive;
+    BRICLI_ATOMIC(bool)     IsClaimed;
+} BricliJob_t;
+
+/**
+ * @brief Default settings for BriCLI for quick initialisation, every field starts at zero.
  */
-#define BRICLI_HANDLE_DEFAULT { BricliErrorNone, NULL, 0, NULL, (char*)"\n", NULL, 0, 0, (char*)">> ", false, BricliStateIdle, NULL, false, NULL }
+#ifdef __cplusplus
+    #define BRICLI_HANDLE_DEFAULT {}
+#else
+    #define BRICLI_HANDLE_DEFAULT { 0 }
+#endif // __cplusplus
 
 /* FUNCTION DECLARATIONS */
 
 int Bricli_ParseCommand(BricliHandle_t* cli);
+int Bricli_ParseLine(BricliHandle_t *cli, char *line);
+int Bricli_ExecuteCaptured(BricliHandle_t *cli, char *line, char *buffer, uint32_t capacity, uint32_t *captured);
+int Bricli_ExecuteBatch(BricliHandle_t *cli, char *script);
 int Bricli_Parse(BricliHandle_t* cli);
 BricliErrors_t Bricli_ReceiveCharacter(BricliHandle_t* cli, char rxChar);
 BricliErrors_t Bricli_ReceiveIndexedArray(BricliHandle_t *cli, uint32_t index, uint32_t length, char *array);
+BricliErrors_t Bricli_PostReceive(BricliHandle_t *cli, uint32_t length, const char *data);
+int Bricli_PostWrite(BricliHandle_t *cli, uint32_t length, const char *data);
+int Bricli_PostF(BricliHandle_t *cli, const char *format, ...);
+int Bricli_PublishPosts(BricliHandle_t *cli);
 bool Bricli_CheckForEol(BricliHandle_t* cli, bool replaceEol);
 void Bricli_Backspace(BricliHandle_t* cli);
 size_t Bricli_SplitOnEol(BricliHandle_t *cli);
 int Bricli_PrintHelp(BricliHandle_t* cli);
+int Bricli_PrintCommandHelp(BricliHandle_t *cli, const char *prefix);
+int Bricli_BuildHelp(BricliHandle_t *cli);
+void Bricli_InvalidateHelp(BricliHandle_t *cli);
 int Bricli_PrintF(BricliHandle_t* cli, const char* format, ...);
+int Bricli_VPrintF(BricliHandle_t *cli, const char *format, va_list args);
 void Bricli_SetColour(BricliHandle_t* cli, BricliColours_t colourId);
+void Bricli_ReleaseColour(BricliHandle_t *cli);
 void Bricli_Reset(BricliHandle_t *cli);
 void Bricli_ClearCommand(BricliHandle_t *cli);
+int Bricli_BufferWrite(BricliHandle_t *cli, uint32_t length, const char *data);
+int Bricli_Flush(BricliHandle_t *cli);
+int Bricli_OnTxComplete(BricliHandle_t *cli);
+int Bricli_Defer(BricliHandle_t *cli, uint32_t *token);
+int Bricli_Complete(BricliHandle_t *cli, uint32_t token, int result);
+int Bricli_RunJob(BricliJob_t *job);
+int Bricli_ReleaseJobs(BricliHandle_t *cli);
+void Bricli_Cancel(BricliHandle_t *cli);
+bool Bricli_IsCancelled(BricliHandle_t *cli);
+int Bricli_ListJobs(BricliHandle_t *cli);
+int Bricli_KillJob(BricliHandle_t *cli, uint32_t id);
+int Bricli_CaptureWrite(BricliHandle_t *cli, uint32_t length, const char *data);
+int Bricli_StartPaged(BricliHandle_t *cli, Bricli_PageProducer producer, void *context);
+bool Bricli_ServicePaged(BricliHandle_t *cli);
+int Bricli_EmitBegin(BricliHandle_t *cli);
+int Bricli_EmitString(BricliHandle_t *cli, const char *key, const char *value);
+int Bricli_EmitInt(BricliHandle_t *cli, const char *key, int64_t value);
+int Bricli_EmitUInt(BricliHandle_t *cli, const char *key, uint64_t value);
+int Bricli_EmitBool(BricliHandle_t *cli, const char *key, bool value);
+int Bricli_EmitEnd(BricliHandle_t *cli);
+int Bricli_WriteV(BricliHandle_t *cli, const BricliIoVec_t *vectors, uint32_t count);
+int Bricli_WriteColouredSegments(BricliHandle_t *cli, uint32_t length, const char *data, BricliColours_t colour, bool appendEol);
+bool Bricli_NextArg(BricliHandle_t *cli, BricliSpan_t *arg);
+BricliErrors_t Bricli_DecodeHex(char *argument, BricliBlob_t *blob);
+BricliErrors_t Bricli_DecodeBase64(char *argument, BricliBlob_t *blob);
 
 /**
  * @brief Helper macro for calling Bricli_PrintF with colour support.
@@ -354,10 +917,122 @@ void Bricli_ClearCommand(BricliHandle_t *cli);
  *
  * @return The error code from the instance's BSP write.
  */
-#define BRICLI_PRINTF_COLOURED(cli, colour, format, ...) ({ Bricli_SetColour(cli, colour); int macroResult = Bricli_PrintF(cli, format, __VA_ARGS__); Bricli_SetColour(cli, BricliColourReset); macroResult; })
+#define BRICLI_PRINTF_COLOURED(cli, colour, format, ...) ({ Bricli_SetColour(cli, colour); int macroResult = Bricli_PrintF(cli, format, __VA_ARGS__); Bricli_ReleaseColour(cli); macroResult; })
 
 /**
-* @brief Helper function for writing out data on the CLI's write function.
+ * @brief Gets the EOL to look for in received data.
+ *
+ * @param cli Pointer to the CLI instance to use.
+ *
+ * @return The configuration's Eol, "\n" if there is no configuration or it has no Eol.
+ */
+static inline const char* Bricli_GetEol(BricliHandle_t* cli)
+{
+    return (cli->Config != NULL && cli->Config->Eol != NULL) ? cli->Config->Eol : "\n";
+}
+
+/**
+ * @brief Gets the EOL to be used when sending data.
+ *
+ * @param cli Pointer to the CLI instance to use.
+ *
+ * @return The configuration's SendEol if one has been set, the receive EOL otherwise.
+ */
+static inline const char* Bricli_GetSendEol(BricliHandle_t* cli)
+{
+    return (cli->Config != NULL && cli->Config->SendEol != NULL) ? cli->Config->SendEol : Bricli_GetEol(cli);
+}
+
+/**
+ * @brief Gets the prompt sent after each command.
+ *
+ * @param cli Pointer to the CLI instance to use.
+ *
+ * @return The configuration's Prompt, ">> " if there is no configuration.
+ */
+static inline const char* Bricli_GetPrompt(BricliHandle_t* cli)
+{
+    return (cli->Config != NULL) ? cli->Config->Prompt : ">> ";
+}
+
+/**
+ * @brief Gets the command list in use.
+ *
+ * @param cli Pointer to the CLI instance to use.
+ *
+ * @return The configuration's CommandList, NULL if there is no configuration.
+ */
+static inline BricliCommand_t* Bricli_GetCommandList(BricliHandle_t* cli)
+{
+    return (cli->Config != NULL) ? cli->Config->CommandList : NULL;
+}
+
+/**
+ * @brief Gets the number of entries in the command list in use.
+ *
+ * @param cli Pointer to the CLI instance to use.
+ *
+ * @return The configuration's CommandListLength, 0 if there is no configuration.
+ */
+static inline uint32_t Bricli_GetCommandListLength(BricliHandle_t* cli)
+{
+    return (cli->Config != NULL) ? cli->Config->CommandListLength : 0;
+}
+
+/**
+ * @brief Gets how records written with the Bricli_Emit functions are rendered.
+ *
+ * @param cli Pointer to the CLI instance to use.
+ *
+ * @return The emitter's Mode, BricliOutputHuman if there is no emitter.
+ */
+static inline BricliOutputModes_t Bricli_GetOutputMode(BricliHandle_t* cli)
+{
+    return (cli->Emitter != NULL) ? cli->Emitter->Mode : BricliOutputHuman;
+}
+
+/**
+ * @brief Checks whether output is meant for a machine rather than a terminal.
+ *
+ * Machine readable modes get no prompt, colour or echo, and errors are reported as records.
+ *
+ * @param cli Pointer to the CLI instance to use.
+ *
+ * @return True for JSON Lines and CBOR output.
+ */
+static inline bool Bricli_IsMachineOutput(BricliHandle_t* cli)
+{
+    return Bricli_GetOutputMode(cli) != BricliOutputHuman;
+}
+
+/**
+ * @brief Checks whether the instance has a transport to write to.
+ *
+ * @param cli Pointer to the CLI instance to use.
+ *
+ * @return True if either BspWrite or SessionWrite has been set.
+ */
+static inline bool Bricli_HasTransport(BricliHandle_t* cli)
+{
+    return cli->BspWrite != NULL || cli->SessionWrite != NULL;
+}
+
+/**
+ * @brief Passes data to the instance's transport, preferring SessionWrite when set.
+ *
+ * @param cli Pointer to the CLI instance to use.
+ * @param length The number of characters in the buffer to be sent.
+ * @param data Pointer to the buffer to be sent.
+ *
+ * @return The result of the transport call.
+ */
+static inline int Bricli_TransportWrite(BricliHandle_t* cli, uint32_t length, const char* data)
+{
+    return (cli->SessionWrite != NULL) ? cli->SessionWrite(cli, length, data) : cli->BspWrite(length, data);
+}
+
+/**
+* @brief Writes data on the CLI's write function without touching the colour state.
 *
 * @param cli Pointer to the CLI instance to use.
 * @param length The number of characters in the buffer to be sent.
@@ -365,12 +1040,38 @@ void Bricli_ClearCommand(BricliHandle_t *cli);
 *
 * @return An error code, negative indicates a problem occurred.
 */
-static inline int Bricli_Write(BricliHandle_t* cli, uint32_t length, const char* data)
+static inline int Bricli_WriteRaw(BricliHandle_t* cli, uint32_t length, const char* data)
 {
+    // Output from Bricli_ExecuteCaptured goes straight into the caller's buffer.
+    if (cli != NULL && cli->Capture != NULL)
+    {
+        return Bricli_CaptureWrite(cli, length, data);
+    }
+
     // Make sure we actually have a write function.
-    if (cli != NULL && cli->BspWrite != NULL)
+    if (cli != NULL && Bricli_HasTransport(cli))
     {
-        return cli->BspWrite(length, data);
+        // Remember whether the line was left open, posted messages must start on a line of their own.
+        // Escape sequences do not move the cursor so they are ignored, machine output has none so
+        // a CBOR head starting with 0x1B is not mistaken for one.
+        if (length > 0 && (data[0] != '\x1b' || Bricli_IsMachineOutput(cli)))
+        {
+            cli->IsMidLine = (data[length - 1] != '\n' && data[length - 1] != '\r');
+        }
+
+        // Coalesce into the TX buffer when one is provided.
+        if (cli->TxBuffer != NULL)
+        {
+            return Bricli_BufferWrite(cli, length, data);
+        }
+
+        // A non-blocking transport may take only part of the data, which needs a TX buffer to resume from.
+        if (cli->NonBlockingTx)
+        {
+            cli->LastError = BricliErrorInternal;
+            return BricliBadHandle;
+        }
+        return Bricli_TransportWrite(cli, length, data);
     }
     else
     {
@@ -379,6 +1080,26 @@ static inline int Bricli_Write(BricliHandle_t* cli, uint32_t length, const char*
     }
 }
 
+/**
+* @brief Helper function for writing out data on the CLI's write function.
+*
+* Any colour left active by an earlier coloured write is reset first.
+*
+* @param cli Pointer to the CLI instance to use.
+* @param length The number of characters in the buffer to be sent.
+* @param data Pointer to the buffer to be sent.
+*
+* @return An error code, negative indicates a problem occurred.
+*/
+static inline int Bricli_Write(BricliHandle_t* cli, uint32_t length, const char* data)
+{
+    if (cli != NULL && cli->IsColourDeferred)
+    {
+        Bricli_SetColour(cli, BricliColourReset);
+    }
+    return Bricli_WriteRaw(cli, length, data);
+}
+
 /**
  * @brief Helper function for writing out data with automatic EOL appending.
  * 
@@ -390,17 +1111,10 @@ static inline int Bricli_Write(BricliHandle_t* cli, uint32_t length, const char*
  */
 static inline int Bricli_WriteLine(BricliHandle_t* cli, uint32_t length, const char* data)
 {
-    Bricli_Write(cli, length, data);
+    const char *sendEol = Bricli_GetSendEol(cli);
+    BricliIoVec_t line[2] = { { data, length }, { sendEol, (uint32_t)strlen(sendEol) } };
 
-    if (cli->SendEol == NULL)
-    {
-        return Bricli_Write(cli, strlen(cli->Eol), cli->Eol);
-    }
-    else
-    {
-        return Bricli_Write(cli, strlen(cli->SendEol), cli->SendEol);
-    }
-    
+    return Bricli_WriteV(cli, line, 2);
 }
 
 /**
@@ -415,10 +1129,7 @@ static inline int Bricli_WriteLine(BricliHandle_t* cli, uint32_t length, const c
 */
 static inline int Bricli_WriteColoured(BricliHandle_t* cli, uint32_t length, const char* data, BricliColours_t colour)
 {
-    Bricli_SetColour(cli, colour);
-    int writeColouredResult = Bricli_Write(cli, length, data);
-    Bricli_SetColour(cli, BricliColourReset);
-    return writeColouredResult;
+    return Bricli_WriteColouredSegments(cli, length, data, colour, false);
 }
 
 /**
@@ -433,10 +1144,7 @@ static inline int Bricli_WriteColoured(BricliHandle_t* cli, uint32_t length, con
 */
 static inline int Bricli_WriteColouredLine(BricliHandle_t* cli, uint32_t length, const char* data, BricliColours_t colour)
 {
-    Bricli_SetColour(cli, colour);
-    int writeColouredResult = Bricli_WriteLine(cli, length, data);
-    Bricli_SetColour(cli, BricliColourReset);
-    return writeColouredResult;
+    return Bricli_WriteColouredSegments(cli, length, data, colour, true);
 }
 
 /**
@@ -477,10 +1185,7 @@ static inline int Bricli_WriteStringLine(BricliHandle_t* cli, const char* data)
 */
 static inline int Bricli_WriteStringColoured(BricliHandle_t* cli, const char* data, BricliColours_t colour)
 {
-    Bricli_SetColour(cli, colour);
-    int result = Bricli_Write(cli, strlen(data), data);
-    Bricli_SetColour(cli, BricliColourReset);
-    return result;
+    return Bricli_WriteColouredSegments(cli, strlen(data), data, colour, false);
 }
 
 /**
@@ -494,10 +1199,7 @@ static inline int Bricli_WriteStringColoured(BricliHandle_t* cli, const char* da
 */
 static inline int Bricli_WriteStringColouredLine(BricliHandle_t* cli, const char* data, BricliColours_t colour)
 {
-    Bricli_SetColour(cli, colour);
-    int result = Bricli_WriteStringLine(cli, data);
-    Bricli_SetColour(cli, BricliColourReset);
-    return result;
+    return Bricli_WriteColouredSegments(cli, strlen(data), data, colour, true);
 }
 
 /**
@@ -517,9 +1219,16 @@ static inline void Bricli_ClearBuffer(BricliHandle_t* cli)
  */
 static inline void Bricli_SendPrompt(BricliHandle_t* cli)
 {
-    if (cli->Prompt != NULL)
+    const char *prompt = Bricli_GetPrompt(cli);
+    if (prompt != NULL && !Bricli_IsMachineOutput(cli))
+    {
+        Bricli_WriteString(cli, prompt);
+    }
+
+    // The prompt marks the end of a command's output so send anything still buffered.
+    if (cli->TxFlushPolicy != BricliFlushExplicit)
     {
-        Bricli_WriteString(cli, cli->Prompt);
+        Bricli_Flush(cli);
     }
 }
 
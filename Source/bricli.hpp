@@ -0,0 +1,616 @@
+/**
+ * @file    bricli.hpp
+ * @brief   C++20 coroutine adapter for the BriCLI library.
+ *
+ * Lets command handlers be written as coroutines that co_await transport, timer and input
+ * events. Suspended handlers are deferred through Bricli_Defer and completed with
+ * Bricli_Complete, so no threads or hand written state machines are needed.
+ *
+ * Copyright (C) 2025 Anthony Wall.
+ * All rights reserved.
+ *
+ **/
+
+#ifndef __BRICLI_HPP__
+#define __BRICLI_HPP__
+
+/* INCLUDES */
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "bricli.h"
+
+namespace Bricli
+{
+    /**
+     * @brief Fixed block allocator that coroutine frames are taken from.
+     *
+     * Each block carries a small header so frames can be returned without knowing their pool.
+     */
+    class FramePool
+    {
+    public:
+        /**
+         * @brief Builds the free list over caller provided storage.
+         *
+         * @param storage       Storage for the blocks, aligned to std::max_align_t.
+         * @param blockSize     The size of each block in bytes, including the block header.
+         * @param blockCount    The number of blocks in \c storage.
+         */
+        FramePool(void* storage, std::size_t blockSize, std::size_t blockCount) noexcept
+            : _free(nullptr), _blockSize(blockSize), _inUse(0)
+        {
+            unsigned char* block = static_cast<unsigned char*>(storage);
+
+            for (std::size_t i = 0; i < blockCount; i++)
+            {
+                Header* header = reinterpret_cast<Header*>(block + (i * blockSize));
+                header->Owner = this;
+                header->NextFree = _free;
+                _free = header;
+            }
+        }
+
+        FramePool(const FramePool&) = delete;
+        FramePool& operator=(const FramePool&) = delete;
+
+        /**
+         * @brief Takes a block from the pool.
+         *
+         * @param size The number of bytes needed.
+         *
+         * @return The usable part of the block, nullptr if the pool is empty or the blocks are too small.
+         */
+        void* Allocate(std::size_t size) noexcept
+        {
+            Header* header = _free;
+
+            if (header == nullptr || size + sizeof(Header) > _blockSize)
+            {
+                return nullptr;
+            }
+
+            _free = header->NextFree;
+            _inUse++;
+            return header + 1;
+        }
+
+        /**
+         * @brief Returns a block to the pool it was taken from.
+         *
+         * @param frame Pointer returned by Allocate.
+         */
+        static void Release(void* frame) noexcept
+        {
+            Header* header = static_cast<Header*>(frame) - 1;
+            FramePool* owner = header->Owner;
+
+            header->NextFree = owner->_free;
+            owner->_free = header;
+            owner->_inUse--;
+        }
+
+        /**
+         * @brief Gets the number of blocks currently in use.
+         */
+        std::size_t InUse() const noexcept
+        {
+            return _inUse;
+        }
+
+    protected:
+        struct alignas(std::max_align_t) Header
+        {
+            FramePool*  Owner;
+            Header*     NextFree;
+        };
+
+    private:
+        Header*         _free;
+        std::size_t     _blockSize;
+        std::size_t     _inUse;
+    };
+
+    /**
+     * @brief Storage for a StaticFramePool, a separate base so it exists before the pool is built.
+     */
+    template <std::size_t BlockSize, std::size_t BlockCount>
+    struct StaticFrameStorage
+    {
+        alignas(std::max_align_t) unsigned char Blocks[BlockSize * BlockCount];
+    };
+
+    /**
+     * @brief Frame pool that owns its storage.
+     *
+     * @tparam BlockSize    The size of each block in bytes, rounded up to the alignment of std::max_align_t.
+     * @tparam BlockCount   The number of blocks, and so the number of coroutine frames alive at once.
+     */
+    template <std::size_t BlockSize, std::size_t BlockCount>
+    class StaticFramePool
+        : private StaticFrameStorage<(BlockSize + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t), BlockCount>
+        , public FramePool
+    {
+        static constexpr std::size_t AlignedSize = (BlockSize + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+    public:
+        StaticFramePool() noexcept
+            : FramePool(StaticFrameStorage<AlignedSize, BlockCount>::Blocks, AlignedSize, BlockCount)
+        {
+        }
+    };
+
+    class Waiter;
+
+    /**
+     * @brief Connects a BriCLI instance to a frame pool and the coroutines waiting on it.
+     *
+     * The session is found from the instance through its Binding member, which it owns while alive.
+     */
+    class Session
+    {
+    public:
+        Session(BricliHandle_t& cli, FramePool& frames) noexcept
+            : _cli(cli), _frames(frames), _waiters(nullptr)
+        {
+            cli.Binding = this;
+        }
+
+        ~Session()
+        {
+            _cli.Binding = nullptr;
+        }
+
+        Session(const Session&) = delete;
+        Session& operator=(const Session&) = delete;
+
+        /**
+         * @brief Gets the session an instance belongs to.
+         *
+         * @return The session, nullptr for instances without one such as worker job shadows.
+         */
+        static Session* From(BricliHandle_t* cli) noexcept
+        {
+            return (cli == nullptr) ? nullptr : static_cast<Session*>(cli->Binding);
+        }
+
+        BricliHandle_t& Handle() noexcept
+        {
+            return _cli;
+        }
+
+        FramePool& Frames() noexcept
+        {
+            return _frames;
+        }
+
+        void Poll() noexcept;
+
+    private:
+        friend class Waiter;
+
+        BricliHandle_t&     _cli;
+        FramePool&          _frames;
+        Waiter*             _waiters;
+    };
+
+    /**
+     * @brief Return type for coroutine command handlers.
+     *
+     * Handlers are free functions taking the Bricli_ContextCommandHandler parameters, their frames
+     * come from the instance's session. Arguments point into the RX buffer so anything needed after
+     * the first co_await must be copied first.
+     */
+    class Task
+    {
+    public:
+        struct promise_type;
+        using Handle = std::coroutine_handle<promise_type>;
+
+        /**
+         * @brief Completes deferred handlers as they finish, handlers that never suspended are left for Run.
+         */
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+
+            void await_suspend(Handle handle) noexcept
+            {
+                promise_type& promise = handle.promise();
+
+                if (promise.IsDeferred)
+                {
+                    BricliHandle_t* cli = promise.Cli;
+                    uint32_t token = promise.Token;
+                    int result = promise.Result;
+
+                    // Free the frame first so the next command can use it.
+                    handle.destroy();
+                    Bricli_Complete(cli, token, result);
+                }
+            }
+
+            void await_resume() noexcept
+            {
+            }
+        };
+
+        struct promise_type
+        {
+            BricliHandle_t*     Cli;
+            int                 Result = BricliOk;
+            uint32_t            Token = 0;
+            bool                IsDeferred = false;
+
+            template <typename... Args>
+            promise_type(BricliHandle_t* cli, Args&&...) noexcept
+                : Cli(cli)
+            {
+            }
+
+            template <typename... Args>
+            static void* operator new(std::size_t size, BricliHandle_t* cli, Args&&...) noexcept
+            {
+                Session* session = Session::From(cli);
+                return (session == nullptr) ? nullptr : session->Frames().Allocate(size);
+            }
+
+            static void operator delete(void* frame, std::size_t) noexcept
+            {
+                FramePool::Release(frame);
+            }
+
+            static Task get_return_object_on_allocation_failure() noexcept
+            {
+                return Task();
+            }
+
+            Task get_return_object() noexcept
+            {
+                return Task(Handle::from_promise(*this));
+            }
+
+            std::suspend_never initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            FinalAwaiter final_suspend() noexcept
+            {
+                return {};
+            }
+
+            void return_value(int result) noexcept
+            {
+                Result = result;
+            }
+
+            void unhandled_exception() noexcept
+            {
+                Result = BricliUnknown;
+            }
+        };
+
+        Task(Task&& other) noexcept
+            : _handle(other._handle)
+        {
+            other._handle = nullptr;
+        }
+
+        ~Task()
+        {
+            if (_handle)
+            {
+                _handle.destroy();
+            }
+        }
+
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+        /**
+         * @brief Hands the handler's outcome back to BriCLI, deferring the command if it has suspended.
+         *
+         * @return The handler's result, BricliPending if it has suspended, or BricliBusy if no frame was available.
+         */
+        int Run() noexcept
+        {
+            int result;
+
+            if (!_handle)
+            {
+                return BricliBusy;
+            }
+
+            promise_type& promise = _handle.promise();
+            if (_handle.done())
+            {
+                result = promise.Result;
+            }
+            else
+            {
+                // Ownership passes to the frame, which completes the command once it finishes.
+                result = Bricli_Defer(promise.Cli, &promise.Token);
+                if (result == BricliPending)
+                {
+                    promise.IsDeferred = true;
+                    _handle = nullptr;
+                    return result;
+                }
+            }
+
+            _handle.destroy();
+            _handle = nullptr;
+            return result;
+        }
+
+    private:
+        explicit Task(Handle handle = nullptr) noexcept
+            : _handle(handle)
+        {
+        }
+
+        Handle _handle;
+    };
+
+    /**
+     * @brief Base for the awaitable events, links suspended coroutines into their session.
+     */
+    class Waiter
+    {
+    public:
+        explicit Waiter(BricliHandle_t* cli) noexcept
+            : Cli(cli)
+        {
+        }
+
+        virtual ~Waiter()
+        {
+            Unlink();
+        }
+
+        Waiter(const Waiter&) = delete;
+        Waiter& operator=(const Waiter&) = delete;
+
+        bool await_suspend(Task::Handle handle) noexcept
+        {
+            _session = Session::From(Cli);
+            _promise = &handle.promise();
+
+            // Nothing could ever resume the coroutine, so carry on as though it was cancelled.
+            if (_session == nullptr || IsOrphaned() || Bricli_IsCancelled(Cli))
+            {
+                IsCancelled = true;
+                return false;
+            }
+
+            _handle = handle;
+            _next = _session->_waiters;
+            _session->_waiters = this;
+            return true;
+        }
+
+    protected:
+        /**
+         * @brief Checks whether the event being waited for has happened.
+         */
+        virtual bool IsReady() noexcept = 0;
+
+        BricliHandle_t*     Cli;
+        bool                IsCancelled = false;
+
+    private:
+        friend class Session;
+
+        // The command was completed without the coroutine, e.g. by its time budget running out.
+        bool IsOrphaned() const noexcept
+        {
+            return _promise != nullptr && _promise->IsDeferred &&
+                   (!Cli->IsPending || Cli->PendingToken != _promise->Token);
+        }
+
+        void Unlink() noexcept
+        {
+            Waiter** link = (_session == nullptr) ? nullptr : &_session->_waiters;
+
+            while (link != nullptr && *link != nullptr)
+            {
+                if (*link == this)
+                {
+                    *link = _next;
+                    break;
+                }
+                link = &(*link)->_next;
+            }
+            _next = nullptr;
+        }
+
+        Session*                _session = nullptr;
+        Task::promise_type*     _promise = nullptr;
+        Waiter*                 _next = nullptr;
+        std::coroutine_handle<> _handle;
+    };
+
+    /**
+     * @brief Resumes every coroutine whose event has happened, call this from the application's loop.
+     *
+     * Cancelled commands, through Ctrl-C or their time budget, have their coroutines resumed so they can finish.
+     */
+    inline void Session::Poll() noexcept
+    {
+        bool isResumed = true;
+
+        // Resuming a coroutine can add or remove waiters, so start again after each one.
+        while (isResumed)
+        {
+            isResumed = false;
+            for (Waiter* waiter = _waiters; waiter != nullptr; waiter = waiter->_next)
+            {
+                if (waiter->IsOrphaned() || Bricli_IsCancelled(&_cli))
+                {
+                    waiter->IsCancelled = true;
+                }
+
+                if (waiter->IsCancelled || waiter->IsReady())
+                {
+                    std::coroutine_handle<> handle = waiter->_handle;
+
+                    waiter->Unlink();
+                    handle.resume();
+                    isResumed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Waits until everything written so far has been taken by the transport.
+     */
+    class TxReady : public Waiter
+    {
+    public:
+        explicit TxReady(BricliHandle_t* cli) noexcept
+            : Waiter(cli)
+        {
+        }
+
+        bool await_ready() noexcept
+        {
+            return IsReady();
+        }
+
+        void await_resume() noexcept
+        {
+        }
+
+    protected:
+        bool IsReady() noexcept override
+        {
+            if (Cli->TxPending > 0 && !Cli->IsTxBusy)
+            {
+                Bricli_Flush(Cli);
+            }
+            return !Cli->IsTxBusy && Cli->TxPending == 0;
+        }
+    };
+
+    /**
+     * @brief Waits for a number of milliseconds measured with the instance's GetTick, returns at once without one.
+     *
+     * co_await gives false if the command was cancelled before the time was up.
+     */
+    class Delay : public Waiter
+    {
+    public:
+        Delay(BricliHandle_t* cli, uint32_t milliseconds) noexcept
+            : Waiter(cli), _deadline((cli->GetTick == nullptr) ? 0 : cli->GetTick() + milliseconds)
+        {
+        }
+
+        bool await_ready() noexcept
+        {
+            return IsReady();
+        }
+
+        bool await_resume() noexcept
+        {
+            return !IsCancelled;
+        }
+
+    protected:
+        bool IsReady() noexcept override
+        {
+            // Wrapping ticks are handled by comparing the signed difference.
+            return Cli->GetTick == nullptr || static_cast<int32_t>(Cli->GetTick() - _deadline) >= 0;
+        }
+
+    private:
+        uint32_t _deadline;
+    };
+
+    /**
+     * @brief Waits for the next line of input and takes it from the RX buffer, for multi-step commands.
+     *
+     * co_await gives the length of the line copied into the buffer, which is always NUL terminated,
+     * or BricliCancelled if the command was cancelled first.
+     */
+    class ReadLine : public Waiter
+    {
+    public:
+        ReadLine(BricliHandle_t* cli, char* buffer, uint32_t size) noexcept
+            : Waiter(cli), _buffer(buffer), _size(size), _length(0)
+        {
+        }
+
+        bool await_ready() noexcept
+        {
+            return IsReady();
+        }
+
+        int await_resume() noexcept
+        {
+            return IsCancelled ? static_cast<int>(BricliCancelled) : static_cast<int>(_length);
+        }
+
+    protected:
+        bool IsReady() noexcept override
+        {
+            const char* eol = Bricli_GetEol(Cli);
+            uint32_t lineLength;
+
+            if (Cli->RxBuffer == nullptr || eol == nullptr || _size == 0)
+            {
+                return false;
+            }
+
+            // Lines already split by Bricli_Parse are NUL terminated, otherwise look for the EOL.
+            if (Cli->SplitCommands > 0)
+            {
+                lineLength = static_cast<uint32_t>(std::strlen(Cli->RxBuffer));
+                Cli->SplitCommands--;
+            }
+            else
+            {
+                char* end = std::strstr(Cli->RxBuffer, eol);
+                if (end == nullptr)
+                {
+                    return false;
+                }
+                lineLength = static_cast<uint32_t>(end - Cli->RxBuffer);
+                std::memset(end, '\0', std::strlen(eol));
+            }
+
+            _length = (lineLength < _size) ? lineLength : _size - 1;
+            std::memcpy(_buffer, Cli->RxBuffer, _length);
+            _buffer[_length] = '\0';
+
+            Cli->CommandLength = lineLength;
+            Bricli_ClearCommand(Cli);
+            return true;
+        }
+
+    private:
+        char*       _buffer;
+        uint32_t    _size;
+        uint32_t    _length;
+    };
+
+    /**
+     * @brief Adapts a coroutine handler to a Bricli_ContextCommandHandler for use in a command list.
+     *
+     * @tparam Handler The coroutine handler.
+     */
+    template <Task (*Handler)(BricliHandle_t*, void*, uint32_t, char**)>
+    int Coroutine(BricliHandle_t* cli, void* context, uint32_t numberOfArgs, char* args[])
+    {
+        return Handler(cli, context, numberOfArgs, args).Run();
+    }
+}
+
+#endif /* __BRICLI_HPP__ */
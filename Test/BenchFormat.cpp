@@ -0,0 +1,114 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdarg>
+#include <string>
+#include <iostream>
+
+#include "bricli.h"
+
+// Simple throughput comparison between Bricli_PrintF and formatting with vsnprintf first, as
+// Bricli_PrintF did before the built-in formatter. Not registered with CTest, run it by hand.
+
+namespace {
+
+    constexpr uint32_t Iterations = 200000;
+    constexpr uint32_t Rounds = 9;
+
+    // Output from the transport, kept so the work cannot be optimised away.
+    std::string _output;
+    uint64_t _bytesWritten = 0;
+
+    int CountingWrite(uint32_t length, const char *data)
+    {
+        _bytesWritten += length;
+        if (_output.size() < 4096)
+        {
+            _output.append(data, length);
+        }
+        return BricliOk;
+    }
+
+    // Formats a message with vsnprintf and writes it, the reference implementation.
+    int VsnprintfPrint(BricliHandle_t *cli, const char *format, ...)
+    {
+        char message[BRICLI_PRINT_MESSAGE_SIZE];
+        va_list args;
+
+        va_start(args, format);
+        int length = vsnprintf(message, sizeof(message), format, args);
+        va_end(args);
+
+        if (length > 0 && length < BRICLI_PRINT_MESSAGE_SIZE)
+        {
+            return Bricli_Write(cli, (uint32_t)length, message);
+        }
+        return -1;
+    }
+
+    // Times a single round of the given print function.
+    template <typename Function>
+    double TimeRound(Function function)
+    {
+        _bytesWritten = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < Iterations; i++)
+        {
+            function(i);
+        }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Reports the best round for a print function.
+    double Report(const char *name, double elapsed)
+    {
+        double rate = (_bytesWritten / elapsed) / (1024.0 * 1024.0);
+
+        std::printf("%-14s %8.2f ms %8.2f MiB/s\n", name, elapsed * 1000.0, rate);
+        return rate;
+    }
+}
+
+int main()
+{
+    BricliHandle_t cli = BRICLI_HANDLE_DEFAULT;
+    cli.BspWrite = CountingWrite;
+
+    // A typical telemetry row.
+    const char *format = "%s %5d %u 0x%08x %d\n";
+    auto row = [](uint32_t i) { return (int)(i * 2654435761u); };
+
+    // Check both paths agree before timing them.
+    std::string reference;
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        _output.clear();
+        VsnprintfPrint(&cli, format, "adc", row(i) % 4096, i, i * 40503u, row(i));
+        reference = _output;
+        _output.clear();
+        Bricli_PrintF(&cli, format, "adc", row(i) % 4096, i, i * 40503u, row(i));
+        if (_output != reference)
+        {
+            std::cerr << "Output mismatch: \"" << _output << "\" != \"" << reference << "\"" << std::endl;
+            return 1;
+        }
+    }
+
+    // Alternate between the two so both see the same machine load, keeping the best round of each.
+    double baselineTime = 0;
+    double fastTime = 0;
+    for (uint32_t round = 0; round < Rounds; round++)
+    {
+        double elapsed = TimeRound([&](uint32_t i) { VsnprintfPrint(&cli, format, "adc", row(i) % 4096, i, i * 40503u, row(i)); });
+        baselineTime = (round == 0 || elapsed < baselineTime) ? elapsed : baselineTime;
+        elapsed = TimeRound([&](uint32_t i) { Bricli_PrintF(&cli, format, "adc", row(i) % 4096, i, i * 40503u, row(i)); });
+        fastTime = (round == 0 || elapsed < fastTime) ? elapsed : fastTime;
+    }
+
+    // Both functions write the same bytes, so the last round's count applies to each.
+    double baseline = Report("vsnprintf", baselineTime);
+    double fast = Report("Bricli_PrintF", fastTime);
+
+    std::printf("Speed up: %.2fx (BRICLI_USE_FAST_FORMAT=%d)\n", fast / baseline, BRICLI_USE_FAST_FORMAT);
+    return 0;
+}
@@ -0,0 +1,160 @@
+#include <string>
+#include <cstring>
+#include <gtest/gtest.h>
+
+#include "bricli.hpp"
+
+namespace Cli {
+
+    using namespace Bricli;
+
+    // Everything written by the instance under test.
+    static std::string _output;
+
+    static int RecordingWrite(uint32_t length, const char *data)
+    {
+        _output.append(data, length);
+        return (int)BricliOk;
+    }
+
+    static uint32_t _tick;
+
+    static uint32_t TestTick(void)
+    {
+        return _tick;
+    }
+
+    // Asks for confirmation, then waits for a slow operation before finishing.
+    Task Erase_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char *args[])
+    {
+        char answer[8];
+
+        Bricli_WriteString(cli, "Erase? ");
+        co_await TxReady(cli);
+
+        int length = co_await ReadLine(cli, answer, sizeof(answer));
+        if (length < 0)
+        {
+            co_return length;
+        }
+        if (strcmp(answer, "y") != 0)
+        {
+            co_return BricliOk;
+        }
+
+        if (!co_await Delay(cli, 10))
+        {
+            co_return BricliCancelled;
+        }
+        Bricli_WriteString(cli, "Erased\n");
+        co_return BricliOk;
+    }
+
+    // Finishes without ever suspending.
+    Task Sync_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char *args[])
+    {
+        co_return (numberOfArgs > 0) ? atoi(args[0]) : BricliOk;
+    }
+
+    class CoroutineTest: public ::testing::Test
+    {
+    protected:
+        BricliCommand_t _commandList[2] =
+        {
+            {"erase", NULL, "Erases flash.", NULL, 0, NULL, Coroutine<Erase_Handler>},
+            {"sync", NULL, "Returns its argument.", NULL, 0, NULL, Coroutine<Sync_Handler>}
+        };
+        BricliConfig_t _config = { _commandList, BRICLI_STATIC_ARRAY_SIZE(_commandList), "\n", NULL, ">> " };
+        BricliHandle_t _cli = BRICLI_HANDLE_DEFAULT;
+        char _buffer[100] = {0};
+        StaticFramePool<512, 2> _frames;
+
+        virtual void SetUp()
+        {
+            _output.clear();
+            _tick = 0;
+
+            _cli.Config = &_config;
+            _cli.RxBuffer = _buffer;
+            _cli.RxBufferSize = sizeof(_buffer);
+            _cli.BspWrite = RecordingWrite;
+            _cli.GetTick = TestTick;
+        }
+
+        void Receive(const std::string &text)
+        {
+            Bricli_ReceiveArray(&_cli, text.length(), (char *)text.c_str());
+        }
+    };
+
+    TEST_F(CoroutineTest, MultiStepCommand)
+    {
+        Session session(_cli, _frames);
+
+        // The handler suspends waiting for an answer, deferring the command.
+        Receive("erase\n");
+        EXPECT_EQ(Bricli_Parse(&_cli), BricliPending);
+        EXPECT_EQ(_frames.InUse(), 1u);
+        session.Poll();
+        EXPECT_EQ(_output, "Erase? ");
+
+        // The answer is held by the parser until the coroutine takes it.
+        Receive("y\n");
+        Bricli_Parse(&_cli);
+        session.Poll();
+        EXPECT_TRUE(_cli.IsPending);
+        EXPECT_EQ(_cli.PendingBytes, 0u);
+
+        // Once the delay is over the command completes and its frame is freed.
+        _tick += 10;
+        session.Poll();
+        EXPECT_FALSE(_cli.IsPending);
+        EXPECT_EQ(_frames.InUse(), 0u);
+        EXPECT_EQ(_output, std::string("Erase? Erased\n") + _config.Prompt);
+    }
+
+    TEST_F(CoroutineTest, SynchronousCommand)
+    {
+        Session session(_cli, _frames);
+
+        Receive("sync 0\n");
+        EXPECT_EQ(Bricli_Parse(&_cli), BricliOk);
+        EXPECT_FALSE(_cli.IsPending);
+        EXPECT_EQ(_frames.InUse(), 0u);
+        EXPECT_EQ(_output, _config.Prompt);
+    }
+
+    TEST_F(CoroutineTest, NoFrameAvailable)
+    {
+        StaticFramePool<32, 1> tiny;
+        Session session(_cli, tiny);
+
+        // Frames that do not fit fail the command instead of allocating from the heap.
+        Receive("erase\n");
+        EXPECT_EQ(Bricli_Parse(&_cli), BricliBusy);
+        EXPECT_FALSE(_cli.IsPending);
+        EXPECT_EQ(tiny.InUse(), 0u);
+    }
+
+    TEST_F(CoroutineTest, CancelWhileWaiting)
+    {
+        Session session(_cli, _frames);
+
+        Receive("erase\n");
+        Bricli_Parse(&_cli);
+        session.Poll();
+
+        // Ctrl-C resumes the waiting coroutine, which finishes the command as cancelled.
+        Bricli_ReceiveCharacter(&_cli, BRICLI_CANCEL_CHAR);
+        session.Poll();
+        EXPECT_FALSE(_cli.IsPending);
+        EXPECT_EQ(_frames.InUse(), 0u);
+        EXPECT_NE(_output.find("Command cancelled"), std::string::npos);
+
+        // The instance is usable again afterwards.
+        _output.clear();
+        Receive("sync 0\n");
+        EXPECT_EQ(Bricli_Parse(&_cli), BricliOk);
+        EXPECT_EQ(_output, _config.Prompt);
+    }
+}
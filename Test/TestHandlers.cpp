@@ -1,5 +1,7 @@
 #include <string>
 #include <iostream>
+#include <thread>
+#include <vector>
 #include <gtest/gtest.h>
 #include <FFF/fff.h>
 DEFINE_FFF_GLOBALS;
@@ -7,7 +9,6 @@ DEFINE_FFF_GLOBALS;
 // Ensure command errors are turned on.
 #define BRICLI_SHOW_COMMAND_ERRORS 1
 #define BRICLI_SHOW_HELP_ON_ERROR 1
-#define BRICLI_USE_REENTRANT 0
 
 #include "bricli.h"
 
@@ -30,15 +31,349 @@ namespace Cli {
         return 0;
     }
 
+    // Decoded output of the last call to BlobTest_Handler, copied out before the RX buffer is cleared.
+    static BricliBlob_t _lastBlob;
+    static uint8_t _lastBlobData[64];
+
+    // Test function used for checking in place hex decoding.
+    int BlobTest_Handler(uint32_t numberOfArgs, char **args)
+    {
+        if (numberOfArgs < 1)
+        {
+            return -1;
+        }
+
+        int result = Bricli_DecodeHex(args[0], &_lastBlob);
+        if (result == BricliOk && _lastBlob.Length <= sizeof(_lastBlobData))
+        {
+            memcpy(_lastBlobData, _lastBlob.Data, _lastBlob.Length);
+        }
+        return result;
+    }
+
+    // Arguments seen by the last call to SpanTest_Handler.
+    static std::string _lastSpans[BRICLI_MAX_ARGUMENTS];
+    static uint32_t _lastSpanCount;
+
+    // Test function used for checking span based handlers.
+    int SpanTest_Handler(uint32_t numberOfArgs, const BricliSpan_t args[])
+    {
+        _lastSpanCount = numberOfArgs;
+        for (uint32_t i = 0; i < numberOfArgs; i++)
+        {
+            _lastSpans[i].assign(args[i].Data, args[i].Length);
+        }
+        return 0;
+    }
+
+    // State captured by the lazy argument handlers.
+    static BricliHandle_t *_lazyCli;
+    static std::string _lazyFirst;
+    static std::string _lazyRemaining;
+    static uint32_t _lazyCount;
+
+    // Test function that only inspects the first argument.
+    int LazyFirst_Handler(uint32_t numberOfArgs, const BricliSpan_t args[])
+    {
+        BricliSpan_t arg;
+
+        EXPECT_EQ(numberOfArgs, 0);
+        if (Bricli_NextArg(_lazyCli, &arg))
+        {
+            _lazyFirst.assign(arg.Data, arg.Length);
+
+            // Everything after the first argument must still be untouched text.
+            _lazyRemaining.assign(arg.Data + arg.Length + 1);
+        }
+        return 0;
+    }
+
+    // Test function that walks every argument.
+    int LazyAll_Handler(uint32_t numberOfArgs, const BricliSpan_t args[])
+    {
+        BricliSpan_t arg;
+
+        _lazyCount = 0;
+        while (Bricli_NextArg(_lazyCli, &arg))
+        {
+            _lazyCount++;
+        }
+        return 0;
+    }
+
+    // Data received by StreamTest_Reader.
+    static std::string _streamData;
+    static uint32_t _streamChunks;
+    static uint32_t _streamFinals;
+
+    // Test reader used for streamed arguments.
+    int StreamTest_Reader(const char *data, uint32_t length, bool isFinal)
+    {
+        _streamData.append(data, length);
+        _streamChunks++;
+        if (isFinal)
+        {
+            _streamFinals++;
+        }
+        return 0;
+    }
+
+    // Handle used by the output test handler.
+    static BricliHandle_t *_outputCli;
+
+    // Test function that writes several pieces of output.
+    int OutputTest_Handler(uint32_t numberOfArgs, char **args)
+    {
+        Bricli_WriteStringColouredLine(_outputCli, "Status", BricliTextGreen);
+        Bricli_PrintF(_outputCli, "Value: %d\n", 42);
+        return 0;
+    }
+
+    // Output captured by the last call to NestedCapture_Handler.
+    static char _nestedOutput[64];
+
+    // Test function that captures the output of another command.
+    int NestedCapture_Handler(uint32_t numberOfArgs, char **args)
+    {
+        char line[] = "output";
+        uint32_t captured = 0;
+
+        int result = Bricli_ExecuteCaptured(_outputCli, line, _nestedOutput, sizeof(_nestedOutput), &captured);
+        Bricli_PrintF(_outputCli, "Inner: %u", captured);
+        return result;
+    }
+
+    // Output and lines produced by the paged output test producer.
+    static std::string _pagedOutput;
+    static uint32_t _pagedLines;
+
+    static int RecordingWrite(uint32_t length, const char *data)
+    {
+        _pagedOutput.append(data, length);
+        return BricliOk;
+    }
+
+    // Produces ten numbered lines, one per call.
+    static int32_t LineProducer(void *context, char *buffer, uint32_t capacity)
+    {
+        uint32_t *linesLeft = (uint32_t *)context;
+
+        if (*linesLeft == 0)
+        {
+            return 0;
+        }
+        (*linesLeft)--;
+        _pagedLines++;
+        return snprintf(buffer, capacity, "Line %u\n", _pagedLines);
+    }
+
+    static uint32_t _linesLeft;
+
+    // Produces the remaining numbered lines three to a call, as many as fit.
+    static int32_t BlockProducer(void *context, char *buffer, uint32_t capacity)
+    {
+        uint32_t *linesLeft = (uint32_t *)context;
+        int32_t produced = 0;
+
+        for (uint32_t i = 0; i < 3 && *linesLeft > 0; i++)
+        {
+            (*linesLeft)--;
+            _pagedLines++;
+            produced += snprintf(&buffer[produced], capacity - (uint32_t)produced, "Line %u\n", _pagedLines);
+        }
+        return produced;
+    }
+
+    // Test function that dumps its output through the pager several lines at a time.
+    int BlockPagedTest_Handler(uint32_t numberOfArgs, char **args)
+    {
+        _linesLeft = 10;
+        return Bricli_StartPaged(_outputCli, BlockProducer, &_linesLeft);
+    }
+
+    // Test function that dumps its output through the pager.
+    int PagedTest_Handler(uint32_t numberOfArgs, char **args)
+    {
+        _linesLeft = 10;
+        return Bricli_StartPaged(_outputCli, LineProducer, &_linesLeft);
+    }
+
+    // Output written by each session in the shared configuration test, indexed by UserData.
+    static std::string _sessionOutput[2];
+
+    static int SessionWrite(BricliHandle_t *cli, uint32_t length, const char *data)
+    {
+        _sessionOutput[(uintptr_t)cli->UserData].append(data, length);
+        return BricliOk;
+    }
+
+    // Calls seen by ContextTest_Handler.
+    static BricliHandle_t *_contextCli;
+    static void *_contextPointer;
+    static std::string _contextArgument;
+
+    // Test function used for checking handle aware handlers.
+    int ContextTest_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char **args)
+    {
+        _contextCli = cli;
+        _contextPointer = context;
+        _contextArgument = (numberOfArgs > 0) ? args[0] : "";
+        return (int)numberOfArgs;
+    }
+
+    // Token handed out by DeferTest_Handler.
+    static uint32_t _deferToken;
+
+    // Test function that finishes later through Bricli_Complete.
+    int DeferTest_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char **args)
+    {
+        return Bricli_Defer(cli, &_deferToken);
+    }
+
+    // Jobs handed to the test worker pool, run by hand on separate threads.
+    static std::vector<BricliJob_t *> _submittedJobs;
+
+    static int QueueJob(BricliJob_t *job)
+    {
+        _submittedJobs.push_back(job);
+        return BricliOk;
+    }
+
+    static void RunOnWorker(BricliJob_t *job)
+    {
+        std::thread worker(Bricli_RunJob, job);
+        worker.join();
+    }
+
+    // Submit function that starts a thread per job, joined by the test.
+    static std::vector<std::thread> _workers;
+
+    static int SpawnJob(BricliJob_t *job)
+    {
+        _workers.emplace_back(Bricli_RunJob, job);
+        return 0;
+    }
+
+    // Submit function that hands only the first job to a worker, which has claimed it on return.
+    static int SpawnFirstJob(BricliJob_t *job)
+    {
+        if (!_workers.empty())
+        {
+            return QueueJob(job);
+        }
+        _workers.emplace_back(Bricli_RunJob, job);
+        while (!__atomic_load_n(&job->IsClaimed, __ATOMIC_ACQUIRE))
+        {
+        }
+        return 0;
+    }
+
+    // Set by SignalTest_Handler, awaited by WaitTest_Handler.
+    static bool _isSignalled;
+
+    // Idle hook that releases WaitTest_Handler, so it only returns if the caller waits through the hook.
+    static uint32_t _jobWaits;
+    static void SignalJobWait(void)
+    {
+        _jobWaits++;
+        __atomic_store_n(&_isSignalled, true, __ATOMIC_RELEASE);
+    }
+
+    int WaitTest_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char **args)
+    {
+        while (!__atomic_load_n(&_isSignalled, __ATOMIC_ACQUIRE))
+        {
+        }
+        Bricli_PrintF(cli, "waited\n");
+        return BricliOk;
+    }
+
+    int SignalTest_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char **args)
+    {
+        __atomic_store_n(&_isSignalled, true, __ATOMIC_RELEASE);
+        Bricli_PrintF(cli, "signalled\n");
+        return BricliOk;
+    }
+
+    // Test function that runs as a worker job.
+    int ChecksumTest_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char **args)
+    {
+        Bricli_PrintF(cli, "sum %s\n", args[0]);
+        return BricliOk;
+    }
+
+    // Test function that runs as a worker job and writes more than a job can hold.
+    int FloodTest_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char **args)
+    {
+        std::string flood(BRICLI_JOB_OUTPUT_SIZE + 10, 'x');
+        return Bricli_WriteString(cli, flood.c_str());
+    }
+
+    // Tick source for the timeout tests, advanced by the handlers themselves.
+    static uint32_t _tick;
+
+    static uint32_t TestTick(void)
+    {
+        return _tick;
+    }
+
+    // Test function that works until it is cancelled, advancing time as it goes.
+    static uint32_t _slowIterations;
+    int SlowTest_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char **args)
+    {
+        bool interrupt = (context != NULL);
+
+        for (_slowIterations = 0; _slowIterations < 1000; _slowIterations++)
+        {
+            _tick += 10;
+            if (interrupt && _slowIterations == 3)
+            {
+                Bricli_ReceiveCharacter(cli, BRICLI_CANCEL_CHAR);
+            }
+            if (Bricli_IsCancelled(cli))
+            {
+                return BricliCancelled;
+            }
+        }
+        return BricliOk;
+    }
+
+    // As SlowTest_Handler, but captures another command's output on every iteration.
+    int NestedSlowTest_Handler(BricliHandle_t *cli, void *context, uint32_t numberOfArgs, char **args)
+    {
+        bool interrupt = (context != NULL);
+
+        for (_slowIterations = 0; _slowIterations < 1000; _slowIterations++)
+        {
+            char line[] = "output";
+
+            _tick += 10;
+            if (interrupt && _slowIterations == 3)
+            {
+                Bricli_ReceiveCharacter(cli, BRICLI_CANCEL_CHAR);
+            }
+            Bricli_ExecuteCaptured(cli, line, _nestedOutput, sizeof(_nestedOutput), NULL);
+            if (Bricli_IsCancelled(cli))
+            {
+                return BricliCancelled;
+            }
+        }
+        return BricliOk;
+    }
+
     class HandlerTest: public ::testing::Test
     {
     protected:
-        BricliCommand_t _commandList[2] =
+        BricliCommand_t _commandList[3] =
         {
             {"test", Test_Handler, "Tests."},
-            {"args", Argument_Handler, "Test Arguments"}
+            {"args", Argument_Handler, "Test Arguments"},
+            {"blob", BlobTest_Handler, "Test Blobs"}
         };
+        BricliConfig_t _config = { _commandList, BRICLI_STATIC_ARRAY_SIZE(_commandList), "\n", NULL, ">> " };
         BricliHandle_t _cli = BRICLI_HANDLE_DEFAULT;
+        BricliJobPool_t _jobPool = {};
+        BricliMailbox_t _mailbox = {};
         char _buffer[100] = {0};
 
         HandlerTest() { }
@@ -58,8 +393,7 @@ namespace Cli {
             Argument_Handler_fake.return_val = (int)BricliOk;
 
             // Configure our default BriCLI settings.
-            _cli.CommandList = _commandList;
-            _cli.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(_commandList);
+            _cli.Config = &_config;
             _cli.RxBuffer = _buffer;
             _cli.RxBufferSize = 100;
             _cli.BspWrite = BspWrite;
@@ -178,6 +512,18 @@ namespace Cli {
         EXPECT_EQ(Argument_Handler_fake.call_count, 3);
         EXPECT_EQ(_cli.PendingBytes, 0);
         EXPECT_EQ(error, BricliOk);
+
+        // Lines are split on the whole EOL, a lone part of it stays in the command.
+        _config.Eol = (char *)"\r\n";
+        error = Bricli_ReceiveArray(&_cli, 16, (char *)"args a\rb\r\ntest\r\n");
+        EXPECT_EQ(error, BricliOk);
+        error = (BricliErrors_t)Bricli_Parse(&_cli);
+        EXPECT_EQ(Argument_Handler_fake.call_count, 4);
+        EXPECT_EQ(Argument_Handler_fake.arg0_val, 1u);
+        EXPECT_EQ(Test_Handler_fake.call_count, 5);
+        EXPECT_EQ(_cli.PendingBytes, 0);
+        EXPECT_EQ(error, BricliOk);
+        _config.Eol = (char *)"\n";
     }
 
     TEST_F(HandlerTest, CommandNotFound)
@@ -190,8 +536,8 @@ namespace Cli {
         error = (BricliErrors_t)Bricli_Parse(&_cli);
         EXPECT_EQ(error, BricliBadCommand);
 
-        // Should have 8 calls: Error, 4 help messages with 2 automatic eols, Prompt
-        EXPECT_EQ(BspWrite_fake.call_count, 8);
+        // Should have 9 calls: Error, 5 help messages with 2 automatic eols, Prompt
+        EXPECT_EQ(BspWrite_fake.call_count, 9);
         // Make sure our system commands are called.
         EXPECT_STREQ(BspWrite_fake.arg1_history[1], "help - Displays this help message");
         EXPECT_STREQ(BspWrite_fake.arg1_history[3], "clear - Clears the terminal");
@@ -218,4 +564,953 @@ namespace Cli {
         EXPECT_EQ(_cli.LastError, BricliErrorCommand);
         EXPECT_EQ(BspWrite_fake.call_count, 4);
     }
-}
\ No newline at end of file
+
+    TEST_F(HandlerTest, BlobArguments)
+    {
+        // 40 bytes of hex is longer than the old argument buffer and covers both the vectorised and scalar paths.
+        std::string payload("00112233445566778899AABBCCDDEEFF0123456789abcdef0011223344556677deadbeefcafef00d");
+        std::string blobCommand = "blob " + payload + "\n";
+        BricliErrors_t error = BricliUnknown;
+
+        memset(&_lastBlob, 0, sizeof(_lastBlob));
+        error = Bricli_ReceiveArray(&_cli, blobCommand.length(), (char *)blobCommand.c_str());
+        EXPECT_EQ(error, BricliOk);
+
+        error = (BricliErrors_t)Bricli_Parse(&_cli);
+        EXPECT_EQ(error, BricliOk);
+        EXPECT_EQ(_lastBlob.Length, payload.length() / 2);
+
+        // The decoded data must live inside the receive buffer rather than a copy.
+        EXPECT_GE((char *)_lastBlob.Data, _buffer);
+        EXPECT_LT((char *)_lastBlob.Data, _buffer + sizeof(_buffer));
+        EXPECT_EQ(_lastBlobData[0], 0x00);
+        EXPECT_EQ(_lastBlobData[15], 0xFF);
+        EXPECT_EQ(_lastBlobData[16], 0x01);
+        EXPECT_EQ(_lastBlobData[39], 0x0D);
+    }
+
+    TEST_F(HandlerTest, BlobDecoding)
+    {
+        BricliBlob_t blob = {0};
+        char hex[] = "0x0aFf";
+        char badHex[] = "0x0g";
+        char oddHex[] = "abc";
+        char longBadHex[] = "000102030405060708090a0b0c0d0e0z";
+        char base64[] = "SGVsbG8gV29ybGQ=";
+        char base64NoPad[] = "SGVsbG8";
+        char badBase64[] = "SGV*";
+
+        EXPECT_EQ(Bricli_DecodeHex(hex, &blob), BricliOk);
+        EXPECT_EQ(blob.Length, 2);
+        EXPECT_EQ(blob.Data[0], 0x0A);
+        EXPECT_EQ(blob.Data[1], 0xFF);
+
+        EXPECT_EQ(Bricli_DecodeHex(badHex, &blob), BricliBadParameter);
+        EXPECT_EQ(Bricli_DecodeHex(oddHex, &blob), BricliBadParameter);
+        EXPECT_EQ(Bricli_DecodeHex(longBadHex, &blob), BricliBadParameter);
+
+        EXPECT_EQ(Bricli_DecodeBase64(base64, &blob), BricliOk);
+        EXPECT_EQ(blob.Length, 11);
+        EXPECT_EQ(memcmp(blob.Data, "Hello World", 11), 0);
+
+        EXPECT_EQ(Bricli_DecodeBase64(base64NoPad, &blob), BricliOk);
+        EXPECT_EQ(blob.Length, 5);
+        EXPECT_EQ(memcmp(blob.Data, "Hello", 5), 0);
+
+        EXPECT_EQ(Bricli_DecodeBase64(badBase64, &blob), BricliBadParameter);
+    }
+
+    TEST_F(HandlerTest, SpanArguments)
+    {
+        BricliCommand_t spanCommands[] =
+        {
+            {"span", NULL, "Test Spans", SpanTest_Handler}
+        };
+        std::string spanCommand("span abc \"Hello World\" 12345\n");
+        BricliErrors_t error = BricliUnknown;
+
+        _config.CommandList = spanCommands;
+        _config.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(spanCommands);
+        _lastSpanCount = 0;
+
+        error = Bricli_ReceiveArray(&_cli, spanCommand.length(), (char *)spanCommand.c_str());
+        EXPECT_EQ(error, BricliOk);
+
+        // The span handler should be used and be given each argument's length.
+        error = (BricliErrors_t)Bricli_Parse(&_cli);
+        EXPECT_EQ(error, BricliOk);
+        EXPECT_EQ(_lastSpanCount, 3);
+        EXPECT_EQ(_lastSpans[0], "abc");
+        EXPECT_EQ(_lastSpans[1], "Hello World");
+        EXPECT_EQ(_lastSpans[2], "12345");
+    }
+
+    TEST_F(HandlerTest, LazyArguments)
+    {
+        BricliCommand_t lazyCommands[] =
+        {
+            {"first", NULL, "Reads one argument", LazyFirst_Handler, BricliCommandLazyArguments},
+            {"all", NULL, "Reads every argument", LazyAll_Handler, BricliCommandLazyArguments}
+        };
+        std::string firstCommand("first get a b \"c d\"\n");
+        std::string allCommand("all 1 2 \"3 4\" 5 6\n");
+
+        _config.CommandList = lazyCommands;
+        _config.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(lazyCommands);
+        _lazyCli = &_cli;
+
+        // Only the first argument should be tokenised.
+        Bricli_ReceiveArray(&_cli, firstCommand.length(), (char *)firstCommand.c_str());
+        EXPECT_EQ(Bricli_Parse(&_cli), BricliOk);
+        EXPECT_EQ(_lazyFirst, "get");
+        EXPECT_EQ(_lazyRemaining, "a b \"c d\"");
+
+        // Lazy iteration is not limited by BRICLI_MAX_ARGUMENTS.
+        Bricli_ReceiveArray(&_cli, allCommand.length(), (char *)allCommand.c_str());
+        EXPECT_EQ(Bricli_Parse(&_cli), BricliOk);
+        EXPECT_EQ(_lazyCount, 5);
+        EXPECT_EQ(_cli.ArgumentCursor, nullptr);
+    }
+
+    TEST_F(HandlerTest, EscapedArguments)
+    {
+        BricliCommand_t spanCommands[] =
+        {
+            {"span", NULL, "Test Spans", SpanTest_Handler}
+        };
+        std::string escapedCommand("span \"say \\\"hi\\\"\" a\\ b c\\\\d\n");
+        BricliErrors_t error = BricliUnknown;
+
+        _config.CommandList = spanCommands;
+        _config.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(spanCommands);
+        _lastSpanCount = 0;
+
+        error = Bricli_ReceiveArray(&_cli, escapedCommand.length(), (char *)escapedCommand.c_str());
+        EXPECT_EQ(error, BricliOk);
+
+        // Escapes should be resolved both inside and outside of quotes.
+        error = (BricliErrors_t)Bricli_Parse(&_cli);
+        EXPECT_EQ(error, BricliOk);
+        EXPECT_EQ(_lastSpanCount, 3);
+        EXPECT_EQ(_lastSpans[0], "say \"hi\"");
+        EXPECT_EQ(_lastSpans[1], "a b");
+        EXPECT_EQ(_lastSpans[2], "c\\d");
+    }
+
+    TEST_F(HandlerTest, StreamingArguments)
+    {
+        BricliCommand_t streamCommands[] =
+        {
+            {"test", Test_Handler, "Tests."},
+            {"upload", NULL, "Streams data", NULL, 0, StreamTest_Reader}
+        };
+        std::string payload;
+        BricliErrors_t error = BricliUnknown;
+
+        // Build a payload far larger than the RX buffer.
+        for (int i = 0; i < 40; i++)
+        {
+            payload += "0123456789";
+        }
+        std::string uploadCommand = "upload " + payload + "\r\n";
+
+        _config.CommandList = streamCommands;
+        _config.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(streamCommands);
+        _config.Eol = (char *)"\r\n";
+        _cli.RxBufferSize = 24;
+        _streamData.clear();
+        _streamChunks = 0;
+        _streamFinals = 0;
+
+        // Chunks should be handed over as the buffer fills, before the EOL is seen.
+        error = Bricli_ReceiveArray(&_cli, uploadCommand.length() - 2, (char *)uploadCommand.c_str());
+        EXPECT_EQ(error, BricliOk);
+        EXPECT_GT(_streamChunks, 1);
+        EXPECT_EQ(_streamFinals, 0);
+
+        // The EOL completes the stream and parsing delivers the final chunk.
+        error = Bricli_ReceiveArray(&_cli, 2, (char *)"\r\n");
+        EXPECT_EQ(error, BricliOk);
+        error = (BricliErrors_t)Bricli_Parse(&_cli);
+        EXPECT_EQ(error, BricliOk);
+        EXPECT_EQ(_streamFinals, 1);
+        EXPECT_EQ(_streamData, payload);
+        EXPECT_EQ(_cli.PendingBytes, 0);
+
+        // Normal commands should be unaffected.
+        error = Bricli_ReceiveArray(&_cli, 6, (char *)"test\r\n");
+        EXPECT_EQ(error, BricliOk);
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(Test_Handler_fake.call_count, 1);
+        _config.Eol = (char *)"\n";
+    }
+
+    TEST_F(HandlerTest, CoalescedOutput)
+    {
+        BricliCommand_t outputCommands[] =
+        {
+            {"output", OutputTest_Handler, "Writes output"}
+        };
+        char txBuffer[64] = {0};
+        std::string outputCommand("output\noutput\n");
+
+        _config.CommandList = outputCommands;
+        _config.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(outputCommands);
+        _cli.TxBuffer = txBuffer;
+        _cli.TxBufferSize = sizeof(txBuffer);
+        _outputCli = &_cli;
+
+        // All output and the prompt should go out as a single transport call.
+        Bricli_ReceiveArray(&_cli, 7, (char *)outputCommand.c_str());
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(BspWrite_fake.call_count, 1);
+
+        // Flushing after every handler adds a call per command.
+        RESET_FAKE(BspWrite);
+        _cli.TxFlushPolicy = BricliFlushAfterHandler;
+        Bricli_ReceiveArray(&_cli, outputCommand.length(), (char *)outputCommand.c_str());
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(BspWrite_fake.call_count, 3);
+        _cli.TxFlushPolicy = BricliFlushOnPrompt;
+        _cli.TxBuffer = NULL;
+    }
+
+    TEST_F(HandlerTest, LargeCommandList)
+    {
+        std::vector<std::string> names;
+        std::vector<BricliCommand_t> commands(300);
+        char line[] = "c299";
+
+        for (size_t i = 0; i < commands.size(); i++)
+        {
+            names.push_back("c" + std::to_string(i));
+        }
+        for (size_t i = 0; i < commands.size(); i++)
+        {
+            commands[i].Name = names[i].c_str();
+            commands[i].Handler = Test_Handler;
+        }
+        _config.CommandList = commands.data();
+        _config.CommandListLength = (uint32_t)commands.size();
+
+        // Commands past the 255th are still found and listed, help takes two writes per system command and one per user command.
+        EXPECT_EQ(Bricli_ParseLine(&_cli, line), BricliOk);
+        EXPECT_EQ(Test_Handler_fake.call_count, 1);
+        RESET_FAKE(BspWrite);
+        Bricli_PrintHelp(&_cli);
+        EXPECT_EQ(BspWrite_fake.call_count, 4 + (int)commands.size());
+    }
+
+    TEST_F(HandlerTest, HelpCache)
+    {
+        BricliCommand_t ledCommands[] =
+        {
+            {"led_on", Test_Handler, "Turns the LED on"},
+            {"led_off", Test_Handler, "Turns the LED off"},
+            {"ledger", Test_Handler, NULL},
+            {"reset", Test_Handler, NULL}
+        };
+        char helpBuffer[256] = {0};
+        char smallBuffer[16] = {0};
+        BricliHelpCache_t helpCache = { helpBuffer, sizeof(helpBuffer) };
+        std::string helpCommand("help\n");
+        std::string wrongCommand("lde\n");
+        std::string subtreeCommand("help led\n");
+        std::string expected("help - Displays this help message\nclear - Clears the terminal\n"
+                             "led_on - Turns the LED on\nled_off - Turns the LED off\nledger\nreset\n");
+
+        _config.CommandList = ledCommands;
+        _config.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(ledCommands);
+        _cli.HelpCache = &helpCache;
+
+        // Help should be rendered once and sent as a single write.
+        Bricli_ReceiveArray(&_cli, helpCommand.length(), (char *)helpCommand.c_str());
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(BspWrite_fake.call_count, 2);
+        EXPECT_EQ(BspWrite_fake.arg0_history[0], expected.length());
+        EXPECT_EQ(std::string(BspWrite_fake.arg1_history[0], BspWrite_fake.arg0_history[0]), expected);
+
+        // A mistyped command reuses the rendered text: error, help and prompt.
+        RESET_FAKE(BspWrite);
+        Bricli_ReceiveArray(&_cli, wrongCommand.length(), (char *)wrongCommand.c_str());
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(BspWrite_fake.call_count, 3);
+        EXPECT_EQ(BspWrite_fake.arg1_history[1], helpBuffer);
+
+        // A subtree narrows the output to its commands, names that only share its letters do not match.
+        RESET_FAKE(BspWrite);
+        Bricli_ReceiveArray(&_cli, subtreeCommand.length(), (char *)subtreeCommand.c_str());
+        EXPECT_EQ(Bricli_Parse(&_cli), BricliOk);
+        EXPECT_EQ(BspWrite_fake.call_count, 3);
+        EXPECT_EQ(BspWrite_fake.arg0_history[0], strlen("led_on - Turns the LED on\n"));
+        EXPECT_EQ(BspWrite_fake.arg0_history[1], strlen("led_off - Turns the LED off\n"));
+        EXPECT_EQ(Bricli_PrintCommandHelp(&_cli, "le"), BricliBadCommand);
+
+        // Shortening the list invalidates the rendered text.
+        _config.CommandListLength = 1;
+        EXPECT_EQ(Bricli_PrintHelp(&_cli), BricliOk);
+        EXPECT_EQ(helpCache.Length, expected.find("led_off"));
+
+        // A buffer that is too small falls back to a write per line.
+        RESET_FAKE(BspWrite);
+        helpCache.Buffer = smallBuffer;
+        helpCache.Size = sizeof(smallBuffer);
+        Bricli_InvalidateHelp(&_cli);
+        EXPECT_EQ(Bricli_BuildHelp(&_cli), BricliCopyWouldOverflow);
+        Bricli_PrintHelp(&_cli);
+        EXPECT_EQ(BspWrite_fake.call_count, 5);
+        _cli.HelpCache = NULL;
+    }
+
+    TEST_F(HandlerTest, CapturedExecution)
+    {
+        BricliCommand_t outputCommands[] =
+        {
+            {"output", OutputTest_Handler, "Writes output"},
+            {"nested", NestedCapture_Handler, "Captures output"}
+        };
+        std::string expected(BRICLI_TEXT_GREEN "Status\n" BRICLI_COLOUR_RESET "Value: 42\n");
+        char outputLine[] = "output";
+        char nestedLine[] = "nested";
+        char smallLine[] = "output";
+        char output[64] = {0};
+        char smallOutput[8] = {0};
+        uint32_t captured = 0;
+
+        _config.CommandList = outputCommands;
+        _config.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(outputCommands);
+        _outputCli = &_cli;
+
+        // Output should be captured without reaching the transport.
+        EXPECT_EQ(Bricli_ExecuteCaptured(&_cli, outputLine, output, sizeof(output), &captured), BricliOk);
+        EXPECT_EQ(BspWrite_fake.call_count, 0);
+        EXPECT_EQ(captured, expected.length());
+        EXPECT_STREQ(output, expected.c_str());
+        EXPECT_EQ(_cli.ColourState.Foreground, 0);
+        EXPECT_EQ(_cli.ColourState.Background, 0);
+        EXPECT_EQ(_cli.ColourState.Attributes, 0);
+        EXPECT_EQ(_cli.Capture, nullptr);
+
+        // Nested captures keep their output separate.
+        EXPECT_EQ(Bricli_ExecuteCaptured(&_cli, nestedLine, output, sizeof(output), &captured), BricliOk);
+        EXPECT_STREQ(_nestedOutput, expected.c_str());
+        EXPECT_EQ(std::string(output), "Inner: " + std::to_string(expected.length()));
+
+        // Output that does not fit is truncated and reported.
+        EXPECT_EQ(Bricli_ExecuteCaptured(&_cli, smallLine, smallOutput, sizeof(smallOutput), &captured), BricliCopyWouldOverflow);
+        EXPECT_EQ(captured, sizeof(smallOutput));
+        EXPECT_EQ(std::string(smallOutput, sizeof(smallOutput)), expected.substr(0, sizeof(smallOutput)));
+        EXPECT_EQ(BspWrite_fake.call_count, 0);
+    }
+
+    TEST_F(HandlerTest, PagedOutput)
+    {
+        BricliCommand_t pagedCommands[] =
+        {
+            {"dump", PagedTest_Handler, "Dumps a log"},
+            {"test", Test_Handler, "Test command"}
+        };
+        char txBuffer[16] = {0};
+        BricliPager_t pager = { 4 };
+        std::string dumpCommand("dump\ntest\n");
+        std::string dumpOnly("dump\n");
+        char space = ' ';
+        char quit = 'q';
+
+        _config.CommandList = pagedCommands;
+        _config.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(pagedCommands);
+        _cli.TxBuffer = txBuffer;
+        _cli.TxBufferSize = sizeof(txBuffer);
+        _cli.Pager = &pager;
+        _outputCli = &_cli;
+        BspWrite_fake.custom_fake = RecordingWrite;
+        _pagedOutput.clear();
+        _pagedLines = 0;
+
+        // Output pauses after a page, holding back the prompt and the next command.
+        Bricli_ReceiveArray(&_cli, dumpCommand.length(), (char *)dumpCommand.c_str());
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(_pagedOutput, "Line 1\nLine 2\nLine 3\nLine 4\n" BRICLI_MORE_PROMPT);
+        EXPECT_EQ(_cli.State, BricliStatePaging);
+        EXPECT_EQ(Test_Handler_fake.call_count, 0);
+
+        // The pause holds until a key is pressed.
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(_pagedLines, 4);
+
+        // Any key continues with the next page.
+        _pagedOutput.clear();
+        Bricli_ReceiveCharacter(&_cli, space);
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(_pagedOutput, "\r" BRICLI_DELETE_CHAR "Line 5\nLine 6\nLine 7\nLine 8\n" BRICLI_MORE_PROMPT);
+
+        // 'q' stops the output, then the waiting command runs and the prompt is sent.
+        _pagedOutput.clear();
+        Bricli_ReceiveCharacter(&_cli, quit);
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(_pagedLines, 8);
+        EXPECT_EQ(Test_Handler_fake.call_count, 1);
+        EXPECT_EQ(_pagedOutput, std::string("\r" BRICLI_DELETE_CHAR) + _config.Prompt);
+
+        // Without a page length everything is sent in one go, a buffer's worth at a time.
+        _pagedOutput.clear();
+        _pagedLines = 0;
+        pager.Lines = 0;
+        Bricli_ReceiveArray(&_cli, dumpOnly.length(), (char *)dumpOnly.c_str());
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(_pagedLines, 10);
+        std::string ending = std::string("Line 10\n") + _config.Prompt;
+        EXPECT_EQ(_pagedOutput.substr(_pagedOutput.length() - ending.length()), ending);
+        EXPECT_EQ(pager.Producer, nullptr);
+        _cli.TxBuffer = NULL;
+    }
+
+    TEST_F(HandlerTest, PagedOutputSeveralLinesAtOnce)
+    {
+        BricliCommand_t pagedCommands[] =
+        {
+            {"dump", BlockPagedTest_Handler, "Dumps a log"}
+        };
+        char txBuffer[48] = {0};
+        BricliPager_t pager = { 4 };
+        std::string dumpCommand("dump\n");
+        char space = ' ';
+
+        _config.CommandList = pagedCommands;
+        _config.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(pagedCommands);
+        _cli.TxBuffer = txBuffer;
+        _cli.TxBufferSize = sizeof(txBuffer);
+        _cli.Pager = &pager;
+        _outputCli = &_cli;
+        BspWrite_fake.custom_fake = RecordingWrite;
+        _pagedOutput.clear();
+        _pagedLines = 0;
+
+        // The page stops at the fourth line even though it arrived with the fifth and sixth.
+        Bricli_ReceiveArray(&_cli, dumpCommand.length(), (char *)dumpCommand.c_str());
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(_pagedOutput, "Line 1\nLine 2\nLine 3\nLine 4\n" BRICLI_MORE_PROMPT);
+        EXPECT_EQ(_pagedLines, 6);
+        EXPECT_EQ(pager.Held, strlen("Line 5\nLine 6\n"));
+
+        // The held lines start the next page.
+        _pagedOutput.clear();
+        Bricli_ReceiveCharacter(&_cli, space);
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(_pagedOutput, "\r" BRICLI_DELETE_CHAR "Line 5\nLine 6\nLine 7\nLine 8\n" BRICLI_MORE_PROMPT);
+
+        // The last page is short, then the prompt is sent.
+        _pagedOutput.clear();
+        Bricli_ReceiveCharacter(&_cli, space);
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(_pagedOutput, std::string("\r" BRICLI_DELETE_CHAR "Line 9\nLine 10\n") + _config.Prompt);
+        EXPECT_EQ(pager.Producer, nullptr);
+        _cli.TxBuffer = NULL;
+    }
+
+    TEST_F(HandlerTest, SharedConfig)
+    {
+        BricliCommand_t sharedCommands[] =
+        {
+            {"test", Test_Handler, "Tests."}
+        };
+        const BricliConfig_t config = { sharedCommands, BRICLI_STATIC_ARRAY_SIZE(sharedCommands), "\r", "\r\n", "$ " };
+        BricliHandle_t sessions[2] = { BRICLI_HANDLE_DEFAULT, BRICLI_HANDLE_DEFAULT };
+        char buffers[2][32] = {0};
+        std::string command("test\r");
+        std::string unknown("nope\r");
+
+        for (uintptr_t i = 0; i < 2; i++)
+        {
+            sessions[i].Config = &config;
+            sessions[i].RxBuffer = buffers[i];
+            sessions[i].RxBufferSize = sizeof(buffers[i]);
+            sessions[i].SessionWrite = SessionWrite;
+            sessions[i].UserData = (void *)i;
+            _sessionOutput[i].clear();
+        }
+
+        // The shared configuration supplies the command list, EOL and prompt.
+        Bricli_ReceiveArray(&sessions[0], command.length(), (char *)command.c_str());
+        EXPECT_EQ(Bricli_Parse(&sessions[0]), BricliOk);
+        EXPECT_EQ(Test_Handler_fake.call_count, 1);
+        EXPECT_EQ(_sessionOutput[0], "$ ");
+
+        // Each session keeps its own buffers and routes output to its own connection.
+        Bricli_ReceiveArray(&sessions[1], unknown.length(), (char *)unknown.c_str());
+        Bricli_Parse(&sessions[1]);
+        EXPECT_EQ(_sessionOutput[0], "$ ");
+        EXPECT_NE(_sessionOutput[1].find("Unknown Command nope\r\n"), std::string::npos);
+        EXPECT_EQ(BspWrite_fake.call_count, 0);
+        EXPECT_EQ(sessions[0].PendingBytes, 0);
+    }
+
+    TEST_F(HandlerTest, ContextHandler)
+    {
+        int counter = 0;
+        BricliCommand_t contextCommands[] =
+        {
+            {"count", Test_Handler, "Counts.", NULL, 0, NULL, ContextTest_Handler, &counter}
+        };
+        BricliHandle_t other = BRICLI_HANDLE_DEFAULT;
+        char otherBuffer[32] = {0};
+        std::string command("count first\n");
+
+        _config.CommandList = contextCommands;
+        _config.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(contextCommands);
+        other = _cli;
+        other.RxBuffer = otherBuffer;
+        other.RxBufferSize = sizeof(otherBuffer);
+
+        // The handler receives the instance the command arrived on and the command's context.
+        Bricli_ReceiveArray(&_cli, command.length(), (char *)command.c_str());
+        EXPECT_EQ(Bricli_Parse(&_cli), 1);
+        EXPECT_EQ(_contextCli, &_cli);
+        EXPECT_EQ(_contextPointer, &counter);
+        EXPECT_EQ(_contextArgument, "first");
+        EXPECT_EQ(Test_Handler_fake.call_count, 0);
+
+        // The same handler serves a second instance without any globals.
+        Bricli_ReceiveArray(&other, command.length(), (char *)command.c_str());
+        EXPECT_EQ(Bricli_Parse(&other), 1);
+        EXPECT_EQ(_contextCli, &other);
+        EXPECT_EQ(_contextPointer, &counter);
+    }
+
+    TEST_F(HandlerTest, DeferredCompletion)
+    {
+        BricliCommand_t deferCommands[] =
+        {
+            {"erase", NULL, "Erases flash.", NULL, 0, NULL, DeferTest_Handler},
+            {"test", Test_Handler, "Tests."},
+            {"args", Argument_Handler, "Concurrent.", NULL, BricliCommandConcurrent}
+        };
+        std::string commands("erase\ntest\nargs\n");
+        std::string later("test\n");
+
+        _config.CommandList = deferCommands;
+        _config.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(deferCommands);
+
+        // The deferred command holds back the prompt and the commands queued behind it.
+        Bricli_ReceiveArray(&_cli, commands.length(), (char *)commands.c_str());
+        EXPECT_EQ(Bricli_Parse(&_cli), BricliPending);
+        EXPECT_TRUE(_cli.IsPending);
+        EXPECT_EQ(_cli.State, BricliStatePending);
+        EXPECT_EQ(Test_Handler_fake.call_count, 0);
+        EXPECT_EQ(BspWrite_fake.call_count, 0);
+
+        // Further input keeps being buffered while the command is pending.
+        Bricli_ReceiveArray(&_cli, later.length(), (char *)later.c_str());
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(Test_Handler_fake.call_count, 0);
+
+        // Only the matching token completes the command, the error is reported then.
+        EXPECT_EQ(Bricli_Complete(&_cli, _deferToken + 1, BricliOk), BricliBadParameter);
+        EXPECT_EQ(Bricli_Complete(&_cli, _deferToken, -9), BricliOk);
+        EXPECT_FALSE(_cli.IsPending);
+        EXPECT_EQ(_cli.LastError, BricliErrorCommand);
+        EXPECT_EQ(Bricli_Complete(&_cli, _deferToken, BricliOk), BricliBadParameter);
+
+        // The held commands then run in order, followed by the one received later.
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(Test_Handler_fake.call_count, 1);
+        EXPECT_EQ(Argument_Handler_fake.call_count, 1);
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(Test_Handler_fake.call_count, 2);
+        EXPECT_EQ(_cli.PendingBytes, 0);
+
+        // Concurrent commands are dispatched while another command is pending.
+        std::string concurrent("erase\nargs\n");
+        Bricli_ReceiveArray(&_cli, concurrent.length(), (char *)concurrent.c_str());
+        BspWrite_fake.call_count = 0;
+        Bricli_Parse(&_cli);
+        EXPECT_TRUE(_cli.IsPending);
+        EXPECT_EQ(Argument_Handler_fake.call_count, 2);
+        EXPECT_EQ(BspWrite_fake.call_count, 0);
+        EXPECT_EQ(Bricli_Complete(&_cli, _deferToken, BricliOk), BricliOk);
+        EXPECT_EQ(BspWrite_fake.call_count, 1);
+        EXPECT_STREQ(BspWrite_fake.arg1_val, _config.Prompt);
+    }
+
+    TEST_F(HandlerTest, WorkerJobs)
+    {
+        BricliCommand_t jobCommands[] =
+        {
+            {"sum", NULL, "Checksums.", NULL, BricliCommandOffload, NULL, ChecksumTest_Handler},
+            {"test", Test_Handler, "Tests."},
+            {"flood", NULL, "Floods.", NULL, BricliCommandOffload, NULL, FloodTest_Handler}
+        };
+        BricliJob_t jobs[2];
+        std::string commands("sum a\nsum b\nsum c\ntest\n");
+        std::string floodCommand("flood\n");
+
+        _config.CommandList = jobCommands;
+        _config.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(jobCommands);
+        _cli.JobPool = &_jobPool;
+        _jobPool.Jobs = jobs;
+        _jobPool.JobCount = BRICLI_STATIC_ARRAY_SIZE(jobs);
+        _jobPool.SubmitJob = QueueJob;
+        BspWrite_fake.custom_fake = RecordingWrite;
+        _pagedOutput.clear();
+        _submittedJobs.clear();
+
+        // Jobs are submitted until the pool is full, the rest wait their turn.
+        Bricli_ReceiveArray(&_cli, commands.length(), (char *)commands.c_str());
+        EXPECT_EQ(Bricli_Parse(&_cli), BricliPending);
+        ASSERT_EQ(_submittedJobs.size(), 2);
+        EXPECT_EQ(_cli.SplitCommands, 2);
+        EXPECT_EQ(BspWrite_fake.call_count, 0);
+
+        // A later job finishing first is held until the earlier one is released.
+        RunOnWorker(_submittedJobs[1]);
+        EXPECT_EQ(Bricli_ReleaseJobs(&_cli), 0);
+        EXPECT_EQ(_pagedOutput, "");
+        RunOnWorker(_submittedJobs[0]);
+        EXPECT_EQ(Bricli_ReleaseJobs(&_cli), 2);
+        EXPECT_EQ(_pagedOutput, "sum a\nsum b\n");
+
+        // The freed slots take the next job, and the inline command waits for it.
+        Bricli_Parse(&_cli);
+        ASSERT_EQ(_submittedJobs.size(), 3);
+        EXPECT_EQ(Test_Handler_fake.call_count, 0);
+        RunOnWorker(_submittedJobs[2]);
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(Test_Handler_fake.call_count, 1);
+        EXPECT_EQ(_pagedOutput, std::string("sum a\nsum b\nsum c\n") + _config.Prompt);
+        EXPECT_EQ(_jobPool.JobHead, _jobPool.JobTail);
+
+        // Output that does not fit in the job is marked as truncated when it is released.
+        _pagedOutput.clear();
+        _cli.LastError = BricliErrorNone;
+        Bricli_ReceiveArray(&_cli, floodCommand.length(), (char *)floodCommand.c_str());
+        Bricli_Parse(&_cli);
+        ASSERT_EQ(_submittedJobs.size(), 4);
+        RunOnWorker(_submittedJobs[3]);
+        EXPECT_EQ(_submittedJobs[3]->Result, BricliCopyWouldOverflow);
+        EXPECT_EQ(Bricli_ReleaseJobs(&_cli), 1);
+        EXPECT_EQ(_pagedOutput.find(std::string(BRICLI_JOB_OUTPUT_SIZE, 'x') + "\n"), 0u);
+        EXPECT_NE(_pagedOutput.find("Output truncated\n"), std::string::npos);
+        EXPECT_EQ(_cli.LastError, BricliErrorCommand);
+    }
+
+    TEST_F(HandlerTest, BatchExecution)
+    {
+        BricliCommand_t batchCommands[] =
+        {
+            {"set", NULL, "Sets a value.", NULL, BricliCommandIndependent, NULL, ChecksumTest_Handler},
+            {"test", Test_Handler, "Tests."}
+        };
+        BricliJob_t jobs[2];
+        char script[] = "set a\nset b\nset c\ntest\n\nset d\nset e";
+        char failing[] = "set a\ntest\nset b\n";
+
+        _config.CommandList = batchCommands;
+        _config.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(batchCommands);
+        _cli.JobPool = &_jobPool;
+        _jobPool.Jobs = jobs;
+        _jobPool.JobCount = BRICLI_STATIC_ARRAY_SIZE(jobs);
+        _jobPool.SubmitJob = SpawnJob;
+        BspWrite_fake.custom_fake = RecordingWrite;
+        _pagedOutput.clear();
+
+        // Independent commands run on workers, yet their output keeps the script's order.
+        EXPECT_EQ(Bricli_ExecuteBatch(&_cli, script), BricliOk);
+        for (std::thread &worker : _workers)
+        {
+            worker.join();
+        }
+        _workers.clear();
+        Bricli_Flush(&_cli);
+        EXPECT_EQ(_pagedOutput, "sum a\nsum b\nsum c\nsum d\nsum e\n");
+        EXPECT_EQ(Test_Handler_fake.call_count, 1);
+        EXPECT_EQ(_jobPool.JobHead, _jobPool.JobTail);
+
+        // Jobs no worker picks up are run by the caller, and only ever once.
+        _jobPool.SubmitJob = QueueJob;
+        _submittedJobs.clear();
+        _pagedOutput.clear();
+        Test_Handler_fake.return_val = -3;
+        EXPECT_EQ(Bricli_ExecuteBatch(&_cli, failing), -3);
+        Bricli_Flush(&_cli);
+        EXPECT_EQ(_pagedOutput, std::string("sum a\n") + BRICLI_TEXT_RED "Command returned error: -3\n" BRICLI_COLOUR_RESET "sum b\n");
+        ASSERT_EQ(_submittedJobs.size(), 2);
+        EXPECT_EQ(Bricli_RunJob(_submittedJobs[1]), BricliBusy);
+
+        // While a worker holds the head job the caller runs the unclaimed jobs behind it.
+        BricliCommand_t waitCommands[] =
+        {
+            {"wait", NULL, "Waits for signal.", NULL, BricliCommandIndependent, NULL, WaitTest_Handler},
+            {"signal", NULL, "Signals wait.", NULL, BricliCommandIndependent, NULL, SignalTest_Handler}
+        };
+        char waiting[] = "wait\nsignal\n";
+
+        _config.CommandList = waitCommands;
+        _config.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(waitCommands);
+        _jobPool.SubmitJob = SpawnFirstJob;
+        _submittedJobs.clear();
+        _pagedOutput.clear();
+        _isSignalled = false;
+        EXPECT_EQ(Bricli_ExecuteBatch(&_cli, waiting), BricliOk);
+        for (std::thread &worker : _workers)
+        {
+            worker.join();
+        }
+        _workers.clear();
+        Bricli_Flush(&_cli);
+        EXPECT_EQ(_pagedOutput, "waited\nsignalled\n");
+        ASSERT_EQ(_submittedJobs.size(), 1);
+        EXPECT_EQ(Bricli_RunJob(_submittedJobs[0]), BricliBusy);
+
+        // With nothing left to take on, the caller waits for the worker through the idle hook.
+        char waitOnly[] = "wait\n";
+
+        _jobPool.WaitJob = SignalJobWait;
+        _submittedJobs.clear();
+        _pagedOutput.clear();
+        _isSignalled = false;
+        _jobWaits = 0;
+        EXPECT_EQ(Bricli_ExecuteBatch(&_cli, waitOnly), BricliOk);
+        for (std::thread &worker : _workers)
+        {
+            worker.join();
+        }
+        _workers.clear();
+        Bricli_Flush(&_cli);
+        EXPECT_EQ(_pagedOutput, "waited\n");
+        EXPECT_GT(_jobWaits, 0u);
+    }
+
+    TEST_F(HandlerTest, ConcurrentProducers)
+    {
+        BricliPost_t posts[8] = {0};
+        char inputRing[16];
+        std::vector<std::thread> loggers;
+        std::vector<std::string> expected;
+        std::string typed("te");
+
+        _cli.Mailbox = &_mailbox;
+        _mailbox.Posts = posts;
+        _mailbox.PostCount = BRICLI_STATIC_ARRAY_SIZE(posts);
+        _mailbox.InputRing = inputRing;
+        _mailbox.InputRingSize = sizeof(inputRing);
+        _cli.LocalEcho = true;
+        BspWrite_fake.custom_fake = RecordingWrite;
+        _pagedOutput.clear();
+
+        // Several loggers post at once, retrying while the queue is full.
+        for (int thread = 0; thread < 4; thread++)
+        {
+            loggers.emplace_back([this, thread]()
+            {
+                for (int line = 0; line < 100; line++)
+                {
+                    while (Bricli_PostF(&_cli, "logger %d line %d\n", thread, line) == BricliBusy)
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+
+        // Every message arrives whole, on a line of its own and in each logger's order.
+        uint32_t published = 0;
+        while (published < 400)
+        {
+            published += (uint32_t)Bricli_PublishPosts(&_cli);
+        }
+        for (std::thread &logger : loggers)
+        {
+            logger.join();
+        }
+
+        std::vector<int> nextLine(4, 0);
+        size_t start = 0;
+        for (size_t end = _pagedOutput.find('\n'); end != std::string::npos; end = _pagedOutput.find('\n', start))
+        {
+            int thread = -1;
+            int line = -1;
+            ASSERT_EQ(sscanf(_pagedOutput.substr(start, end - start).c_str(), "logger %d line %d", &thread, &line), 2);
+            ASSERT_TRUE(thread >= 0 && thread < 4);
+            EXPECT_EQ(line, nextLine[thread]++);
+            start = end + 1;
+        }
+        EXPECT_EQ(start, _pagedOutput.length());
+
+        // Input posted from another thread is parsed by the owner.
+        std::thread reader([this]()
+        {
+            EXPECT_EQ(Bricli_PostReceive(&_cli, 5, "test\n"), BricliOk);
+        });
+        reader.join();
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(Test_Handler_fake.call_count, 1);
+
+        // A message posted while a line is being typed is written above the restored prompt and line.
+        Bricli_PostReceive(&_cli, typed.length(), typed.c_str());
+        Bricli_Parse(&_cli);
+        _pagedOutput.clear();
+        Bricli_PostWrite(&_cli, 4, "log!");
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(_pagedOutput, std::string("\nlog!\n") + _config.Prompt + "te");
+
+        // A post that does not fit is refused whole.
+        std::string flood(sizeof(inputRing) + 1, 'x');
+        EXPECT_EQ(Bricli_PostReceive(&_cli, flood.length(), flood.c_str()), BricliCopyWouldOverflow);
+        EXPECT_EQ(_mailbox.InputTail - _mailbox.InputHead, 0u);
+
+        // A posted Ctrl-C drops the partly typed line but keeps complete lines posted before it.
+        Bricli_Parse(&_cli);
+        Bricli_ClearBuffer(&_cli);
+        RESET_FAKE(Test_Handler);
+        _pagedOutput.clear();
+        EXPECT_EQ(Bricli_PostReceive(&_cli, 8, "test\nte\x03"), BricliOk);
+        EXPECT_TRUE(Bricli_IsCancelled(&_cli));
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(Test_Handler_fake.call_count, 1);
+        EXPECT_FALSE(Bricli_IsCancelled(&_cli));
+        EXPECT_EQ(_cli.PendingBytes, 0u);
+        EXPECT_EQ(_pagedOutput, std::string("test\nte^C\n") + _config.Prompt);
+    }
+
+    TEST_F(HandlerTest, Cancellation)
+    {
+        int interrupt = 1;
+        BricliCommand_t slowCommands[] =
+        {
+            {"selftest", NULL, "Runs a self-test.", NULL, 0, NULL, SlowTest_Handler, NULL, 100},
+            {"stop", NULL, "Is interrupted.", NULL, 0, NULL, SlowTest_Handler, &interrupt},
+            {"erase", NULL, "Erases flash.", NULL, 0, NULL, DeferTest_Handler, NULL, 50},
+            {"output", OutputTest_Handler, "Writes output."},
+            {"nslow", NULL, "Nests captures.", NULL, 0, NULL, NestedSlowTest_Handler, NULL, 100},
+            {"nstop", NULL, "Nests captures.", NULL, 0, NULL, NestedSlowTest_Handler, &interrupt}
+        };
+        std::string selfTest("selftest\n");
+        std::string nestedSlow("nslow\n");
+        std::string nestedStop("nstop\n");
+        std::string stop("stop\n");
+        std::string erase("erase\n");
+        std::string partial("sel");
+
+        _config.CommandList = slowCommands;
+        _config.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(slowCommands);
+        _cli.GetTick = TestTick;
+        _tick = 0xFFFFFFC0;
+        BspWrite_fake.custom_fake = RecordingWrite;
+        _pagedOutput.clear();
+
+        // A command that overruns its budget is stopped and reported, even across a tick wrap.
+        Bricli_ReceiveArray(&_cli, selfTest.length(), (char *)selfTest.c_str());
+        EXPECT_EQ(Bricli_Parse(&_cli), BricliTimedOut);
+        EXPECT_EQ(_slowIterations, 9);
+        EXPECT_NE(_pagedOutput.find("Command timed out"), std::string::npos);
+        EXPECT_FALSE(_cli.HasDeadline);
+
+        // Ctrl-C received while a handler runs is seen by its next poll.
+        _pagedOutput.clear();
+        Bricli_ReceiveArray(&_cli, stop.length(), (char *)stop.c_str());
+        EXPECT_EQ(Bricli_Parse(&_cli), BricliCancelled);
+        EXPECT_EQ(_slowIterations, 3);
+        EXPECT_NE(_pagedOutput.find("Command cancelled"), std::string::npos);
+
+        // Commands captured from within a handler share its time budget and cancellation.
+        _outputCli = &_cli;
+        Bricli_ReceiveArray(&_cli, nestedSlow.length(), (char *)nestedSlow.c_str());
+        EXPECT_EQ(Bricli_Parse(&_cli), BricliTimedOut);
+        EXPECT_EQ(_slowIterations, 9);
+        EXPECT_FALSE(_cli.HasDeadline);
+        Bricli_ReceiveArray(&_cli, nestedStop.length(), (char *)nestedStop.c_str());
+        EXPECT_EQ(Bricli_Parse(&_cli), BricliCancelled);
+        EXPECT_EQ(_slowIterations, 3);
+        EXPECT_FALSE(Bricli_IsCancelled(&_cli));
+
+        // Without a running command Ctrl-C discards the partly typed line.
+        _pagedOutput.clear();
+        Bricli_ReceiveArray(&_cli, partial.length(), (char *)partial.c_str());
+        Bricli_ReceiveCharacter(&_cli, BRICLI_CANCEL_CHAR);
+        EXPECT_EQ(_cli.PendingBytes, 0);
+        EXPECT_FALSE(Bricli_IsCancelled(&_cli));
+        EXPECT_EQ(_pagedOutput, std::string("^C\n") + _config.Prompt);
+
+        // A deferred command that is never completed times out on a later parse.
+        _pagedOutput.clear();
+        Bricli_ReceiveArray(&_cli, erase.length(), (char *)erase.c_str());
+        EXPECT_EQ(Bricli_Parse(&_cli), BricliPending);
+        _tick += 20;
+        Bricli_Parse(&_cli);
+        EXPECT_TRUE(_cli.IsPending);
+        _tick += 40;
+        Bricli_Parse(&_cli);
+        EXPECT_FALSE(_cli.IsPending);
+        EXPECT_EQ(Bricli_Complete(&_cli, _deferToken, BricliOk), BricliBadParameter);
+        EXPECT_EQ(_pagedOutput, std::string(BRICLI_TEXT_RED "Command timed out\n" BRICLI_COLOUR_RESET) + _config.Prompt);
+    }
+
+    TEST_F(HandlerTest, BackgroundJobs)
+    {
+        BricliCommand_t jobCommands[] =
+        {
+            {"sum", NULL, "Checksums.", NULL, 0, NULL, ChecksumTest_Handler},
+            {"test", Test_Handler, "Tests."}
+        };
+        BricliJob_t backgroundJobs[1];
+        std::string start("sum a &\n");
+        std::string inline_("test\n");
+        std::string jobs("jobs\n");
+        std::string kill("kill 1\n");
+        std::string killUnknown("kill 9\n");
+        std::string killInvalid("kill 1x\n");
+
+        _config.CommandList = jobCommands;
+        _config.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(jobCommands);
+        _cli.JobPool = &_jobPool;
+        _jobPool.BackgroundJobs = backgroundJobs;
+        _jobPool.BackgroundJobCount = BRICLI_STATIC_ARRAY_SIZE(backgroundJobs);
+        _jobPool.SubmitJob = QueueJob;
+        _cli.GetTick = TestTick;
+        _tick = 1000;
+        BspWrite_fake.custom_fake = RecordingWrite;
+        _pagedOutput.clear();
+        _submittedJobs.clear();
+        memset(backgroundJobs, 0, sizeof(backgroundJobs));
+
+        // The prompt comes back straight away and the job runs without the "&".
+        Bricli_ReceiveArray(&_cli, start.length(), (char *)start.c_str());
+        EXPECT_EQ(Bricli_Parse(&_cli), BricliOk);
+        ASSERT_EQ(_submittedJobs.size(), 1);
+        EXPECT_STREQ(_submittedJobs[0]->Line, "sum a");
+        EXPECT_EQ(_pagedOutput, std::string("[1] sum\n") + _config.Prompt);
+
+        // Interactive commands are not held back by the background job.
+        Bricli_ReceiveArray(&_cli, inline_.length(), (char *)inline_.c_str());
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(Test_Handler_fake.call_count, 1);
+
+        // The pool is fixed, a second job has to wait for the slot.
+        _pagedOutput.clear();
+        Bricli_ReceiveArray(&_cli, start.length(), (char *)start.c_str());
+        EXPECT_EQ(Bricli_Parse(&_cli), BricliBusy);
+        EXPECT_EQ(_pagedOutput, std::string("No free job slots\n") + _config.Prompt);
+
+        // Running jobs are listed with their elapsed time and can be killed by id.
+        _tick += 250;
+        _pagedOutput.clear();
+        Bricli_ReceiveArray(&_cli, jobs.length(), (char *)jobs.c_str());
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(_pagedOutput, std::string("[1] Running      250ms sum\n") + _config.Prompt);
+        Bricli_ReceiveArray(&_cli, kill.length(), (char *)kill.c_str());
+        EXPECT_EQ(Bricli_Parse(&_cli), BricliOk);
+        EXPECT_TRUE(Bricli_IsCancelled(&_submittedJobs[0]->Shadow));
+        EXPECT_FALSE(Bricli_IsCancelled(&_cli));
+        Bricli_ReceiveArray(&_cli, killUnknown.length(), (char *)killUnknown.c_str());
+        EXPECT_EQ(Bricli_Parse(&_cli), BricliBadParameter);
+        Bricli_ReceiveArray(&_cli, killInvalid.length(), (char *)killInvalid.c_str());
+        EXPECT_EQ(Bricli_Parse(&_cli), BricliBadParameter);
+
+        // Finished jobs are announced along with their output.
+        _pagedOutput.clear();
+        RunOnWorker(_submittedJobs[0]);
+        EXPECT_EQ(Bricli_ReleaseJobs(&_cli), 1);
+        EXPECT_EQ(_pagedOutput, std::string("[1] Done sum\nsum a\n") + _config.Prompt);
+        EXPECT_FALSE(backgroundJobs[0].IsActive);
+    }
+}
@@ -12,6 +12,14 @@ FAKE_VALUE_FUNC(int, Test_Handler, uint32_t, char **);
 
 namespace Cli {
 
+    // Everything written through BspWrite, for tests that check the text.
+    static std::string _writtenText;
+    static int RecordingWrite(uint32_t length, const char *data)
+    {
+        _writtenText.append(data, length);
+        return BricliOk;
+    }
+
     class ReceiveTest: public ::testing::Test
     {
     protected:
@@ -19,6 +27,7 @@ namespace Cli {
         {
             {"test", Test_Handler, "Tests."}
         };
+        BricliConfig_t _config = { _commandList, BRICLI_STATIC_ARRAY_SIZE(_commandList), "\n", NULL, ">> " };
         BricliHandle_t _cli = BRICLI_HANDLE_DEFAULT;
         char _buffer[100] = {0};
 
@@ -36,8 +45,7 @@ namespace Cli {
             Test_Handler_fake.return_val = (int)BricliOk;
 
             // Configure our default BriCLI settings.
-            _cli.CommandList = _commandList;
-            _cli.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(_commandList);
+            _cli.Config = &_config;
             _cli.RxBuffer = _buffer;
             _cli.RxBufferSize = 100;
             _cli.BspWrite = BspWrite;
@@ -52,11 +60,18 @@ namespace Cli {
 
     TEST_F(ReceiveTest, Init)
     {
-        EXPECT_EQ(_cli.Eol, "\n");
+        BricliHandle_t defaults = BRICLI_HANDLE_DEFAULT;
+
+        EXPECT_STREQ(Bricli_GetEol(&_cli), "\n");
         EXPECT_EQ(_cli.RxBufferSize, 100);
         EXPECT_EQ(_cli.RxBuffer, _buffer);
-        EXPECT_EQ(_cli.Prompt, ">> ");
+        EXPECT_STREQ(Bricli_GetPrompt(&_cli), ">> ");
         EXPECT_EQ(_cli.State, BricliStateIdle);
+
+        // Without a configuration the EOL and prompt fall back to their defaults.
+        EXPECT_STREQ(Bricli_GetEol(&defaults), "\n");
+        EXPECT_STREQ(Bricli_GetPrompt(&defaults), ">> ");
+        EXPECT_EQ(Bricli_GetCommandListLength(&defaults), 0u);
     }
 
     TEST_F(ReceiveTest, ReceiveLine)
@@ -199,4 +214,49 @@ namespace Cli {
         EXPECT_EQ(_cli.PendingBytes, 8);
         EXPECT_EQ(BspWrite_fake.call_count, 0);
     }
-}
\ No newline at end of file
+
+    TEST_F(ReceiveTest, LineContinuation)
+    {
+        std::string continuedCommand("test a \\\nb \\\nc\n");
+        std::string escapedBackslash("test d\\\\\n");
+
+        // Continued lines should be joined straight onto the command in the RX buffer.
+        Bricli_ReceiveArray(&_cli, continuedCommand.length(), (char *)continuedCommand.c_str());
+        EXPECT_STREQ(_buffer, "test a b c\n");
+        EXPECT_EQ(_cli.PendingBytes, 11);
+
+        // An escaped backslash before the EOL must not continue the line.
+        Bricli_Reset(&_cli);
+        Bricli_ReceiveArray(&_cli, escapedBackslash.length(), (char *)escapedBackslash.c_str());
+        EXPECT_STREQ(_buffer, escapedBackslash.c_str());
+        EXPECT_TRUE(Bricli_CheckForEol(&_cli, false));
+    }
+
+    TEST_F(ReceiveTest, EmptyLines)
+    {
+        std::string blankLineBetween("test\n\ntest\n");
+        std::string blankLinesOnly("\n\n\n");
+
+        BspWrite_fake.custom_fake = RecordingWrite;
+        _cli.LocalEcho = false;
+        _writtenText.clear();
+
+        // An empty line between two commands is skipped rather than run as an unknown command.
+        Bricli_ReceiveArray(&_cli, blankLineBetween.length(), (char *)blankLineBetween.c_str());
+        EXPECT_EQ(Bricli_SplitOnEol(&_cli), 2u);
+        Bricli_Reset(&_cli);
+        Bricli_ReceiveArray(&_cli, blankLineBetween.length(), (char *)blankLineBetween.c_str());
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(Test_Handler_fake.call_count, 2);
+        EXPECT_EQ(_writtenText.find("Unknown Command"), std::string::npos);
+        EXPECT_EQ(_cli.PendingBytes, 0);
+
+        // Several empty lines on their own just give the prompt, like a lone EOL.
+        _writtenText.clear();
+        Bricli_ReceiveArray(&_cli, blankLinesOnly.length(), (char *)blankLinesOnly.c_str());
+        Bricli_Parse(&_cli);
+        EXPECT_EQ(Test_Handler_fake.call_count, 2);
+        EXPECT_EQ(_writtenText, _config.Prompt);
+        EXPECT_EQ(_cli.PendingBytes, 0);
+    }
+}
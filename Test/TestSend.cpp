@@ -1,4 +1,5 @@
 #include <string>
+#include <vector>
 #include <iostream>
 #include <gtest/gtest.h>
 #include <FFF/fff.h>
@@ -9,6 +10,7 @@ DEFINE_FFF_GLOBALS;
 // Setup fake functions
 FAKE_VALUE_FUNC(int, BspWrite, uint32_t, const char*);
 FAKE_VALUE_FUNC(int, Test_Handler, uint32_t, char **);
+FAKE_VALUE_FUNC(int, BspWriteV, const BricliIoVec_t *, uint32_t);
 
 namespace Cli {
 
@@ -19,6 +21,7 @@ namespace Cli {
         {
             {"test", Test_Handler, "Tests."}
         };
+        BricliConfig_t _config = { _commandList, BRICLI_STATIC_ARRAY_SIZE(_commandList), "\n", NULL, ">> " };
         BricliHandle_t _cli;
         char _buffer[100] = {0};
 
@@ -30,6 +33,7 @@ namespace Cli {
             // Reset fake functions.
             RESET_FAKE(BspWrite);
             RESET_FAKE(Test_Handler);
+            RESET_FAKE(BspWriteV);
             FFF_RESET_HISTORY();
 
             // Pre-load return values for the fakes.
@@ -38,13 +42,10 @@ namespace Cli {
 
             // Configure our default BriCLI settings.
             memset(&_cli, 0, sizeof(BricliHandle_t));
-            _cli.Eol = (char *)"\n";
-            _cli.CommandList = _commandList;
-            _cli.CommandListLength = BRICLI_STATIC_ARRAY_SIZE(_commandList);
+            _cli.Config = &_config;
             _cli.RxBuffer = _buffer;
             _cli.RxBufferSize = 100;
             _cli.BspWrite = BspWrite;
-            _cli.Prompt = (char *)">> ";
         }
 
         virtual void TearDown() 
@@ -81,8 +82,8 @@ namespace Cli {
         BRICLI_PRINTF_COLOURED(&_cli, BricliTextYellow, "%s", testCommand.c_str());
         EXPECT_EQ(testCommand.length(), BspWrite_fake.arg0_history[10]);
 
-        // Make sure total calls match.
-        EXPECT_EQ(BspWrite_fake.call_count, 12);
+        // Make sure total calls match, the last colour reset is deferred until the next uncoloured write.
+        EXPECT_EQ(BspWrite_fake.call_count, 11);
     }
 
     TEST_F(SendTest, WriteLine)
@@ -95,31 +96,31 @@ namespace Cli {
         Bricli_WriteLine(&_cli, testCommand.length(), (char *)testCommand.c_str());
         EXPECT_EQ(testCommand.length(), BspWrite_fake.arg0_history[0]);
         EXPECT_STREQ(testCommand.c_str(), BspWrite_fake.arg1_history[0]);
-        EXPECT_STREQ(_cli.Eol, BspWrite_fake.arg1_history[1]);
+        EXPECT_STREQ(_config.Eol, BspWrite_fake.arg1_history[1]);
         
-        // 2: colour, 3: command, 4: eol, 5: colour reset
+        // 2: colour, 3: command, 4: eol
         Bricli_WriteColouredLine(&_cli, testCommand.length(), (char *)testCommand.c_str(), BricliTextRed);
         EXPECT_EQ(testCommand.length(), BspWrite_fake.arg0_history[3]);
         EXPECT_STREQ(testCommand.c_str(), BspWrite_fake.arg1_history[3]);
-        EXPECT_STREQ(_cli.Eol, BspWrite_fake.arg1_history[4]);
+        EXPECT_STREQ(_config.Eol, BspWrite_fake.arg1_history[4]);
 
         // Change the Eol to make sure \r\n works
-        _cli.Eol = (char *)"\r\n";
+        _config.Eol = (char *)"\r\n";
 
-        // 6: command, 7: eol
+        // 5: deferred colour reset, 6: command, 7: eol
         Bricli_WriteStringLine(&_cli, (char *)testCommand.c_str());
         EXPECT_EQ(testCommand.length(), BspWrite_fake.arg0_history[6]);
         EXPECT_STREQ(testCommand.c_str(), BspWrite_fake.arg1_history[6]);
-        EXPECT_STREQ(_cli.Eol, BspWrite_fake.arg1_history[7]);
+        EXPECT_STREQ(_config.Eol, BspWrite_fake.arg1_history[7]);
         
-        // 8: colour, 9: command, 10: eol, 11: colour reset
+        // 8: colour, 9: command, 10: eol
         Bricli_WriteStringColouredLine(&_cli, (char *)testCommand.c_str(), BricliTextRed);
         EXPECT_EQ(testCommand.length(), BspWrite_fake.arg0_history[9]);
         EXPECT_STREQ(testCommand.c_str(), BspWrite_fake.arg1_history[9]);
-        EXPECT_STREQ(_cli.Eol, BspWrite_fake.arg1_history[10]);
+        EXPECT_STREQ(_config.Eol, BspWrite_fake.arg1_history[10]);
 
-        // Make sure total calls match.
-        EXPECT_EQ(BspWrite_fake.call_count, 12);
+        // Make sure total calls match, the last colour reset is deferred until the next uncoloured write.
+        EXPECT_EQ(BspWrite_fake.call_count, 11);
 
         for (size_t i = 0; i < BspWrite_fake.call_count; i++)
         {
@@ -133,13 +134,13 @@ namespace Cli {
         Bricli_SendPrompt(&_cli);
 
         EXPECT_EQ(BspWrite_fake.call_count, 1);
-        EXPECT_EQ(BspWrite_fake.arg0_val, strlen(_cli.Prompt));
-        EXPECT_STREQ(BspWrite_fake.arg1_val, _cli.Prompt);
+        EXPECT_EQ(BspWrite_fake.arg0_val, strlen(_config.Prompt));
+        EXPECT_STREQ(BspWrite_fake.arg1_val, _config.Prompt);
     }
 
     TEST_F(SendTest, Help)
     {
-        uint32_t NumberOfCommands = (4 + _cli.CommandListLength); // 4 system commands with automatic Eols plus however many custom commands.
+        uint32_t NumberOfCommands = (4 + _config.CommandListLength); // 4 system commands with automatic Eols plus however many custom commands.
 
         // Print the help message and make sure BspWrite is called.
         Bricli_PrintHelp(&_cli);
@@ -155,19 +156,381 @@ namespace Cli {
         std::string testCommand("Hello World");
         
         // Test EoL passthrough
-        _cli.SendEol = NULL;
+        _config.SendEol = NULL;
         Bricli_WriteStringLine(&_cli, testCommand.c_str());
 
         // Expect 2 calls, one for the command and one for the EoL.
         EXPECT_EQ(BspWrite_fake.call_count, 2);
         EXPECT_STREQ(BspWrite_fake.arg1_history[0], "Hello World");
-        EXPECT_STREQ(BspWrite_fake.arg1_history[1], _cli.Eol);
+        EXPECT_STREQ(BspWrite_fake.arg1_history[1], _config.Eol);
 
         // Test SendEol
-        _cli.SendEol = (char*)"\r";
+        _config.SendEol = (char*)"\r";
         Bricli_WriteStringLine(&_cli, testCommand.c_str());
         EXPECT_EQ(BspWrite_fake.call_count, 4);
         EXPECT_STREQ(BspWrite_fake.arg1_history[2], "Hello World");
-        EXPECT_STREQ(BspWrite_fake.arg1_history[3], _cli.SendEol);
+        EXPECT_STREQ(BspWrite_fake.arg1_history[3], _config.SendEol);
+    }
+
+    TEST_F(SendTest, TxBuffer)
+    {
+        char txBuffer[64] = {0};
+        std::string testCommand("Some Response Data");
+        std::string largeData(100, 'a');
+
+        _cli.TxBuffer = txBuffer;
+        _cli.TxBufferSize = sizeof(txBuffer);
+
+        // Writes should be held in the TX buffer until flushed.
+        Bricli_WriteColouredLine(&_cli, testCommand.length(), testCommand.c_str(), BricliTextRed);
+        EXPECT_EQ(BspWrite_fake.call_count, 0);
+        EXPECT_EQ(Bricli_Flush(&_cli), BricliOk);
+        EXPECT_EQ(BspWrite_fake.call_count, 1);
+        EXPECT_EQ(BspWrite_fake.arg0_val, strlen(BRICLI_TEXT_RED) + testCommand.length() + 1);
+        EXPECT_EQ(_cli.TxPending, 0);
+
+        // Flushing an empty buffer should not call BspWrite.
+        Bricli_Flush(&_cli);
+        EXPECT_EQ(BspWrite_fake.call_count, 1);
+
+        // The prompt flushes by default, the deferred colour reset goes out with the next line.
+        Bricli_WriteStringLine(&_cli, testCommand.c_str());
+        Bricli_SendPrompt(&_cli);
+        EXPECT_EQ(BspWrite_fake.call_count, 2);
+        EXPECT_EQ(BspWrite_fake.arg0_val, strlen(BRICLI_COLOUR_RESET) + testCommand.length() + 1 + strlen(_config.Prompt));
+
+        // Unless only explicit flushes are allowed.
+        _cli.TxFlushPolicy = BricliFlushExplicit;
+        Bricli_SendPrompt(&_cli);
+        EXPECT_EQ(BspWrite_fake.call_count, 2);
+        Bricli_Flush(&_cli);
+        EXPECT_EQ(BspWrite_fake.call_count, 3);
+
+        // Data that does not fit flushes the buffer, data larger than the buffer goes straight out.
+        Bricli_WriteString(&_cli, testCommand.c_str());
+        Bricli_Write(&_cli, largeData.length(), largeData.c_str());
+        EXPECT_EQ(BspWrite_fake.call_count, 5);
+        EXPECT_EQ(BspWrite_fake.arg0_history[3], testCommand.length());
+        EXPECT_EQ(BspWrite_fake.arg0_history[4], largeData.length());
+        EXPECT_EQ(_cli.TxPending, 0);
+    }
+
+    // Vectors seen by the last call to BspWriteV, copied before the caller's array goes out of scope.
+    static std::vector<BricliIoVec_t> _lastVectors;
+
+    static int RecordingWriteV(const BricliIoVec_t *vectors, uint32_t count)
+    {
+        _lastVectors.assign(vectors, vectors + count);
+        return BricliOk;
+    }
+
+    TEST_F(SendTest, WriteV)
+    {
+        std::string testCommand("Some Response Data");
+        std::string largeData(100, 'a');
+        char txBuffer[64] = {0};
+
+        _cli.BspWriteV = BspWriteV;
+        BspWriteV_fake.custom_fake = RecordingWriteV;
+
+        // A coloured line should be a single vectored write pointing at the caller's data.
+        Bricli_WriteColouredLine(&_cli, testCommand.length(), testCommand.c_str(), BricliTextRed);
+        EXPECT_EQ(BspWrite_fake.call_count, 0);
+        EXPECT_EQ(BspWriteV_fake.call_count, 1);
+        ASSERT_EQ(_lastVectors.size(), 3);
+        EXPECT_STREQ(_lastVectors[0].Data, BRICLI_TEXT_RED);
+        EXPECT_EQ(_lastVectors[1].Data, testCommand.c_str());
+        EXPECT_EQ(_lastVectors[1].Length, testCommand.length());
+        EXPECT_STREQ(_lastVectors[2].Data, _config.Eol);
+
+        // With a TX buffer, small writes are coalesced and large ones flush then go out as vectors.
+        _cli.TxBuffer = txBuffer;
+        _cli.TxBufferSize = sizeof(txBuffer);
+        Bricli_WriteStringLine(&_cli, testCommand.c_str());
+        EXPECT_EQ(BspWriteV_fake.call_count, 1);
+        Bricli_WriteLine(&_cli, largeData.length(), largeData.c_str());
+        EXPECT_EQ(BspWrite_fake.call_count, 1);
+        EXPECT_EQ(BspWrite_fake.arg0_val, strlen(BRICLI_COLOUR_RESET) + testCommand.length() + 1);
+        EXPECT_EQ(BspWriteV_fake.call_count, 2);
+        EXPECT_EQ(_lastVectors[0].Data, largeData.c_str());
+
+        // Without the vector hook each piece falls back to BspWrite.
+        _cli.BspWriteV = NULL;
+        _cli.TxBuffer = NULL;
+        Bricli_WriteLine(&_cli, testCommand.length(), testCommand.c_str());
+        EXPECT_EQ(BspWrite_fake.call_count, 3);
+    }
+
+    static std::string _writtenText;
+
+    static int RecordingWrite(uint32_t length, const char *data)
+    {
+        _writtenText.append(data, length);
+        return BricliOk;
+    }
+
+    TEST_F(SendTest, PrintF)
+    {
+        std::string longText(200, 'b');
+        char expected[1024] = {0};
+        int count = 0;
+
+        _cli.BspWrite = BspWrite;
+        BspWrite_fake.custom_fake = RecordingWrite;
+        _writtenText.clear();
+
+        // Conversions should match the standard library, and short messages stay a single write.
+        Bricli_PrintF(&_cli, "[%-6s|%5d|%08.3f|%#x|%lu|%c|%%|%*d|%.*s]", "ab", -42, 3.14159, 255u, 123456789ul, 'z', -4, 7, 2, "xyz");
+        snprintf(expected, sizeof(expected), "[%-6s|%5d|%08.3f|%#x|%lu|%c|%%|%*d|%.*s]", "ab", -42, 3.14159, 255u, 123456789ul, 'z', -4, 7, 2, "xyz");
+        EXPECT_EQ(BspWrite_fake.call_count, 1);
+        EXPECT_EQ(_writtenText, expected);
+
+        // Messages longer than BRICLI_PRINT_MESSAGE_SIZE are sent in pieces rather than dropped.
+        _writtenText.clear();
+        Bricli_PrintF(&_cli, "%s %d %s%n %llx", longText.c_str(), 12345, longText.c_str(), &count, 0x1234567890abcdefull);
+        snprintf(expected, sizeof(expected), "%s %d %s %llx", longText.c_str(), 12345, longText.c_str(), 0x1234567890abcdefull);
+        EXPECT_GT(BspWrite_fake.call_count, 2);
+        EXPECT_EQ(_writtenText, expected);
+        EXPECT_EQ(count, (int)(2 * longText.length() + 7));
+
+        // Conversions crossing the end of a chunk, or padded wider than one, are neither truncated nor split.
+        _writtenText.clear();
+        Bricli_PrintF(&_cli, "%.75s%e|%100.2f|%-90.3e|%#100o|", longText.c_str(), 1234.5678, -3.5, 1e300, 8u);
+        snprintf(expected, sizeof(expected), "%.75s%e|%100.2f|%-90.3e|%#100o|", longText.c_str(), 1234.5678, -3.5, 1e300, 8u);
+        EXPECT_EQ(_writtenText, expected);
+
+        // Conversions whose bound reaches a chunk are measured, and really long ones are formatted in a second pass.
+        _writtenText.clear();
+        EXPECT_EQ(Bricli_PrintF(&_cli, "a%.60e|%.80f|%f|%-120.100f|%140.3fb", 1.5, 0.25, 1e80, 2.0, -1e100), BricliOk);
+        snprintf(expected, sizeof(expected), "a%.60e|%.80f|%f|%-120.100f|%140.3fb", 1.5, 0.25, 1e80, 2.0, -1e100);
+        EXPECT_EQ(_writtenText, expected);
+
+        // A conversion too long even for the scratch is cut short and reported rather than dropped.
+        _writtenText.clear();
+        EXPECT_EQ(Bricli_PrintF(&_cli, "a%.400fb", 1.0), BricliCopyWouldOverflow);
+        std::string cutShort = "a1." + std::string(BRICLI_PRINT_LONG_SIZE - 3, '0') + "...b";
+        EXPECT_EQ(_writtenText, cutShort);
+    }
+
+    TEST_F(SendTest, ColourState)
+    {
+        std::string testCommand("Cell");
+
+        _cli.BspWrite = BspWrite;
+        BspWrite_fake.custom_fake = RecordingWrite;
+        _writtenText.clear();
+
+        // Consecutive output in the same colour only needs the colour code once.
+        Bricli_WriteStringColoured(&_cli, testCommand.c_str(), BricliTextGreen);
+        Bricli_WriteStringColoured(&_cli, testCommand.c_str(), BricliTextGreen);
+        BRICLI_PRINTF_COLOURED(&_cli, BricliTextGreen, "%s", testCommand.c_str());
+        EXPECT_EQ(_writtenText, BRICLI_TEXT_GREEN "CellCellCell");
+
+        // Changing colour sends the new code, a background keeps the text colour and attributes.
+        Bricli_WriteStringColoured(&_cli, testCommand.c_str(), BricliTextBoldRed);
+        Bricli_WriteStringColoured(&_cli, testCommand.c_str(), BricliBackgroundBlue);
+        EXPECT_EQ(_writtenText, BRICLI_TEXT_GREEN "CellCellCell" BRICLI_BOLD_RED "Cell" BRICLI_BKGND_BLUE "Cell");
+
+
+        // Uncoloured output sends the deferred reset once, resetting again sends nothing.
+        _writtenText.clear();
+        Bricli_SendPrompt(&_cli);
+        Bricli_SetColour(&_cli, BricliColourReset);
+        EXPECT_EQ(_writtenText, std::string(BRICLI_COLOUR_RESET) + _config.Prompt);
+
+        // An explicitly set colour is kept across uncoloured writes.
+        _writtenText.clear();
+        Bricli_SetColour(&_cli, BricliTextCyan);
+        Bricli_SetColour(&_cli, BricliTextCyan);
+        Bricli_WriteString(&_cli, testCommand.c_str());
+        EXPECT_EQ(_writtenText, BRICLI_TEXT_CYAN "Cell");
+
+        // Only codes that change what is shown are sent.
+        _writtenText.clear();
+        Bricli_SetColour(&_cli, BricliColourReset);
+        Bricli_SetColour(&_cli, BricliTextRed);
+        Bricli_SetColour(&_cli, BricliBackgroundBlue);
+        Bricli_SetColour(&_cli, BricliBackgroundBlue);
+        Bricli_SetColour(&_cli, BricliTextBoldRed);
+        Bricli_SetColour(&_cli, BricliTextBoldRed);
+        EXPECT_EQ(_writtenText, BRICLI_COLOUR_RESET BRICLI_TEXT_RED BRICLI_BKGND_BLUE BRICLI_BOLD_RED);
+        EXPECT_EQ(_cli.ColourState.Background, BricliBackgroundBlue - BricliBackgroundBlack + 1);
+        Bricli_SetColour(&_cli, BricliColourReset);
+    }
+
+    // Number of bytes the fake non-blocking transport will accept before reporting busy.
+    static uint32_t _txSpace;
+
+    static int NonBlockingWrite(uint32_t length, const char *data)
+    {
+        uint32_t accepted = (length < _txSpace) ? length : _txSpace;
+
+        _writtenText.append(data, accepted);
+        _txSpace -= accepted;
+        return (int)accepted;
+    }
+
+    TEST_F(SendTest, NonBlockingTx)
+    {
+        char txBuffer[32] = {0};
+        std::string firstLine("0123456789");
+        std::string secondLine("abcdefghijklmnop");
+        std::string largeData(40, 'x');
+
+        _cli.BspWrite = BspWrite;
+        _cli.TxBuffer = txBuffer;
+        _cli.TxBufferSize = sizeof(txBuffer);
+        _cli.NonBlockingTx = true;
+        BspWrite_fake.custom_fake = NonBlockingWrite;
+        _writtenText.clear();
+
+        // A partial write leaves the remainder queued and marks the transport busy.
+        _txSpace = 4;
+        EXPECT_EQ(Bricli_WriteString(&_cli, firstLine.c_str()), BricliOk);
+        EXPECT_EQ(Bricli_Flush(&_cli), BricliOk);
+        EXPECT_TRUE(_cli.IsTxBusy);
+        EXPECT_EQ(_writtenText, "0123");
+
+        // Nothing is offered to a busy transport, more output simply queues behind it.
+        EXPECT_EQ(Bricli_WriteString(&_cli, secondLine.c_str()), BricliOk);
+        Bricli_Flush(&_cli);
+        EXPECT_EQ(BspWrite_fake.call_count, 1);
+
+        // Output that cannot be queued is refused rather than waited on.
+        EXPECT_EQ(Bricli_Write(&_cli, largeData.length(), largeData.c_str()), BricliCopyWouldOverflow);
+        EXPECT_EQ(BspWrite_fake.call_count, 1);
+
+        // Completion resumes from where the transport stopped.
+        _txSpace = 100;
+        EXPECT_EQ(Bricli_OnTxComplete(&_cli), BricliOk);
+        EXPECT_FALSE(_cli.IsTxBusy);
+        EXPECT_EQ(_writtenText, firstLine + secondLine);
+        EXPECT_EQ(_cli.TxPending, 0);
+
+        // Queued data is compacted so the whole buffer can be reused.
+        _writtenText.clear();
+        _txSpace = 20;
+        Bricli_WriteString(&_cli, secondLine.c_str());
+        Bricli_WriteString(&_cli, secondLine.c_str());
+        Bricli_Flush(&_cli);
+        EXPECT_EQ(Bricli_WriteString(&_cli, secondLine.c_str()), BricliOk);
+        _txSpace = 100;
+        Bricli_OnTxComplete(&_cli);
+        EXPECT_EQ(_writtenText, secondLine + secondLine + secondLine);
+
+        // Data larger than the buffer that the transport partly takes keeps its remainder queued.
+        _writtenText.clear();
+        _txSpace = 10;
+        EXPECT_EQ(Bricli_Write(&_cli, largeData.length(), largeData.c_str()), BricliOk);
+        _txSpace = 100;
+        Bricli_OnTxComplete(&_cli);
+        EXPECT_EQ(_writtenText, largeData);
+
+        // When even the remainder is too large, the number of characters accepted is returned.
+        std::string hugeData(80, 'y');
+        _writtenText.clear();
+        _txSpace = 10;
+        EXPECT_EQ(Bricli_Write(&_cli, hugeData.length(), hugeData.c_str()), 10 + (int)sizeof(txBuffer));
+        _txSpace = 100;
+        Bricli_OnTxComplete(&_cli);
+        EXPECT_EQ(_writtenText, hugeData.substr(0, 10 + sizeof(txBuffer)));
+
+        // Without a TX buffer a partial write could not be resumed, so it is refused.
+        _cli.TxBuffer = NULL;
+        EXPECT_EQ(Bricli_Write(&_cli, firstLine.length(), firstLine.c_str()), BricliBadHandle);
+        _cli.NonBlockingTx = false;
+    }
+
+    TEST_F(SendTest, FastFormat)
+    {
+        const char *formats[] = { "%d", "%i", "%5d", "%-5d|", "%05d", "%-05d|", "%u", "%08u", "%x", "%X", "%-6x|", "%04X", "%+d", "% d", "%#x", "%.3d" };
+        int values[] = { 0, 1, 9, 10, 99, 100, 12345, -1, -99, -100, -12345, 2147483647, (-2147483647 - 1) };
+        char expected[128] = {0};
+
+        _cli.BspWrite = BspWrite;
+        BspWrite_fake.custom_fake = RecordingWrite;
+
+        // The built-in formatter must match snprintf exactly, including the cases it hands over.
+        for (const char *format : formats)
+        {
+            for (int value : values)
+            {
+                _writtenText.clear();
+                Bricli_PrintF(&_cli, format, value);
+                snprintf(expected, sizeof(expected), format, value);
+                EXPECT_EQ(_writtenText, expected) << format << " " << value;
+            }
+        }
+
+        // Wider and narrower integer types.
+        _writtenText.clear();
+        Bricli_PrintF(&_cli, "%lld %llu %llx %hhd %hu %zu", -9223372036854775807ll - 1, 18446744073709551615ull, 0xfedcba9876543210ull, 300, 70000, (size_t)42);
+        snprintf(expected, sizeof(expected), "%lld %llu %llx %hhd %hu %zu", -9223372036854775807ll - 1, 18446744073709551615ull, 0xfedcba9876543210ull, 300, 70000, (size_t)42);
+        EXPECT_EQ(_writtenText, expected);
+    }
+
+    // Writes the same record in the handle's current output mode.
+    static void EmitRecord(BricliHandle_t *cli)
+    {
+        Bricli_EmitBegin(cli);
+        Bricli_EmitString(cli, "name", "adc \"0\"");
+        Bricli_EmitInt(cli, "offset", -500);
+        Bricli_EmitUInt(cli, "count", 70000);
+        Bricli_EmitBool(cli, "ok", true);
+        Bricli_EmitEnd(cli);
+    }
+
+    TEST_F(SendTest, StructuredOutput)
+    {
+        const char cbor[] = "\xBF" "\x64" "name" "\x67" "adc \"0\"" "\x66" "offset" "\x39\x01\xF3"
+                            "\x65" "count" "\x1A\x00\x01\x11\x70" "\x62" "ok" "\xF5" "\xFF";
+        BricliEmitter_t emitter = { BricliOutputHuman, 0 };
+
+        _cli.BspWrite = BspWrite;
+        BspWrite_fake.custom_fake = RecordingWrite;
+
+        // Human mode lines up the values.
+        _writtenText.clear();
+        EmitRecord(&_cli);
+        EXPECT_EQ(_writtenText, "name            : adc \"0\"\n"
+                                "offset          : -500\n"
+                                "count           : 70000\n"
+                                "ok              : true\n");
+
+        // JSON Lines writes one escaped object per line.
+        _writtenText.clear();
+        _cli.Emitter = &emitter;
+        emitter.Mode = BricliOutputJsonLines;
+        EmitRecord(&_cli);
+        EXPECT_EQ(_writtenText, "{\"name\":\"adc \\\"0\\\"\",\"offset\":-500,\"count\":70000,\"ok\":true}\n");
+
+        // CBOR writes an indefinite length map using the shortest encodings.
+        _writtenText.clear();
+        emitter.Mode = BricliOutputCbor;
+        EmitRecord(&_cli);
+        EXPECT_EQ(_writtenText, std::string(cbor, sizeof(cbor) - 1));
+
+        // A CBOR head starting with 0x1B is data, not an escape sequence.
+        Bricli_Write(&_cli, 1, "\n");
+        Bricli_Write(&_cli, 9, "\x1B\x00\x00\x01\x00\x00\x00\x00\x01");
+        EXPECT_TRUE(_cli.IsMidLine);
+
+        // Missing keys and values are rejected before anything is written.
+        _writtenText.clear();
+        EXPECT_EQ(Bricli_EmitString(&_cli, "key", NULL), BricliBadParameter);
+        EXPECT_EQ(Bricli_EmitInt(&_cli, NULL, 1), BricliBadParameter);
+        EXPECT_EQ(_writtenText, "");
+
+        // Machine modes get no prompt, colour or echo, and errors are records.
+        char line[] = "nosuch";
+        emitter.Mode = BricliOutputJsonLines;
+        _cli.LocalEcho = true;
+        Bricli_ReceiveCharacter(&_cli, 'x');
+        Bricli_SendPrompt(&_cli);
+        BRICLI_PRINTF_COLOURED(&_cli, BricliTextRed, "%s", "plain");
+        EXPECT_EQ(Bricli_ParseLine(&_cli, line), BricliBadCommand);
+        EXPECT_EQ(_writtenText, "plain{\"error\":-4,\"message\":\"Unknown Command\",\"command\":\"nosuch\"}\n");
+        _cli.LocalEcho = false;
+        _cli.Emitter = NULL;
     }
 }
\ No newline at end of file